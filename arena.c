@@ -0,0 +1,124 @@
+#include <arena.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Functions in this file implement a bump allocator: memory is handed out from large chunks
+// and only given back all at once, when the arena is cleared.
+
+/*!
+ * @brief init_arena initializes an empty arena
+ * @param arena is a pointer to the arena to initialize
+ */
+void init_arena(arena_t *arena) {
+    arena->chunks = NULL;
+    arena->reserved_size = 0;
+    arena->used_size = 0;
+    arena->peak_reserved_size = 0;
+}
+
+
+/*!
+ * @brief arena_alloc reserves memory in an arena
+ * @param arena is a pointer to the arena to allocate from
+ * @param size is the number of bytes to reserve
+ * @param alignment is the required alignment (a power of 2), 1 for strings
+ * @return a pointer to the reserved memory, NULL if a new chunk cannot be allocated
+ */
+void *arena_alloc(arena_t *arena, size_t size, size_t alignment) {
+    arena_chunk_t *chunk = arena->chunks;
+    if (chunk != NULL) {
+        uintptr_t position = ((uintptr_t) (chunk->data + chunk->used) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+        size_t offset = position - (uintptr_t) chunk->data;
+        if (offset + size <= chunk->size) { // Cas courant : il reste de la place dans le bloc courant
+            chunk->used = offset + size;
+            arena->used_size += size;
+            return chunk->data + offset;
+        }
+    }
+
+    // Nouveau bloc, assez grand pour la demande et son alignement
+    size_t chunk_size = ARENA_CHUNK_SIZE;
+    if (size + alignment > chunk_size) {
+        chunk_size = size + alignment;
+    }
+    arena_chunk_t *new_chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+    if (new_chunk == NULL) {
+        return NULL;
+    }
+    new_chunk->size = chunk_size;
+    new_chunk->used = 0;
+    new_chunk->next = chunk;
+    arena->chunks = new_chunk;
+    arena->reserved_size += chunk_size;
+    if (arena->reserved_size > arena->peak_reserved_size) {
+        arena->peak_reserved_size = arena->reserved_size;
+    }
+    return arena_alloc(arena, size, alignment);
+}
+
+
+/*!
+ * @brief arena_strndup copies a string into an arena
+ * @param arena is a pointer to the arena to allocate from
+ * @param string is the string to copy
+ * @param length is the length of the string (without its terminating '\0')
+ * @return a pointer to the copy, NULL if out of memory
+ */
+char *arena_strndup(arena_t *arena, const char *string, size_t length) {
+    char *copy = arena_alloc(arena, length + 1, 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+/*!
+ * @brief clear_arena releases all the memory of an arena, which can be used again afterwards
+ * Its peak size is kept so that it can be reported once the work is done
+ * @param arena is a pointer to the arena to clear
+ */
+void clear_arena(arena_t *arena) {
+    while (arena->chunks != NULL) {
+        arena_chunk_t *tmp = arena->chunks;
+        arena->chunks = tmp->next;
+        free(tmp);
+    }
+    arena->reserved_size = 0;
+    arena->used_size = 0;
+}
+
+
+/*!
+ * @brief arena_absorb moves all the chunks of an arena into another one, without copying their content
+ * Pointers into the absorbed memory stay valid; the source arena is left empty.
+ * @param arena is a pointer to the arena receiving the chunks
+ * @param other is a pointer to the arena giving its chunks
+ */
+void arena_absorb(arena_t *arena, arena_t *other) {
+    if (other->chunks == NULL) {
+        return;
+    }
+    arena_chunk_t *last = other->chunks;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    // Les blocs absorbés passent après le bloc courant, qui reste celui où les allocations continuent
+    if (arena->chunks == NULL) {
+        arena->chunks = other->chunks;
+    } else {
+        last->next = arena->chunks->next;
+        arena->chunks->next = other->chunks;
+    }
+    arena->reserved_size += other->reserved_size;
+    arena->used_size += other->used_size;
+    if (arena->reserved_size > arena->peak_reserved_size) {
+        arena->peak_reserved_size = arena->reserved_size;
+    }
+    other->chunks = NULL;
+    other->reserved_size = 0;
+    other->used_size = 0;
+}
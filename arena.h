@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Chunks are allocated with this size, or bigger for a single larger request
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+typedef struct _arena_chunk {
+    struct _arena_chunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *chunks; // Current chunk first
+    size_t reserved_size; // Sum of the sizes of all the chunks
+    size_t used_size; // Sum of the sizes handed out
+    size_t peak_reserved_size; // Highest reserved_size since init_arena (kept by clear_arena)
+} arena_t;
+
+void init_arena(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size, size_t alignment);
+char *arena_strndup(arena_t *arena, const char *string, size_t length);
+void clear_arena(arena_t *arena);
+void arena_absorb(arena_t *arena, arena_t *other);
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include <async-io.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file send the file system requests of a thread (statx, openat, read) through an
+// io_uring ring instead of blocking system calls: up to ASYNC_IO_QUEUE_DEPTH requests are in flight
+// at the same time, which hides the latency of network file systems.
+// Each thread (and each forked process) has its own ring, created at its first request. The rings are
+// used through the raw system calls, liburing is not needed. When io_uring is disabled or not supported
+// by the kernel, the functions fail with ENOSYS and the callers use the blocking system calls.
+
+typedef struct {
+    int fd;
+    pid_t owner; // A ring inherited through fork is shared with the parent and must not be used
+    unsigned int entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring; // Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned int to_submit;
+    char *read_buffers; // ASYNC_IO_READS_IN_FLIGHT buffers of ASYNC_IO_READ_SIZE bytes, allocated at the first read
+} async_ring_t;
+
+static bool is_async_io_enabled = false;
+static bool is_io_uring_missing = false; // Atomic: set once the kernel refused to create a ring, or a ring failed with requests in flight
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/*!
+ * @brief destroy_ring unmaps and closes a ring
+ * @param argument is a pointer to the async_ring_t
+ */
+static void destroy_ring(void *argument) {
+    async_ring_t *ring = (async_ring_t *) argument;
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    free(ring->read_buffers);
+    free(ring);
+}
+
+/*!
+ * @brief create_ring_key creates the key of the ring of each thread, the ring is destroyed when its thread ends
+ */
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, destroy_ring);
+}
+
+/*!
+ * @brief supports_operations tells if the kernel of a ring knows the operations used in this file
+ * @param fd is the file descriptor of the ring
+ * @return true if statx, openat and read are supported
+ */
+static bool supports_operations(int fd) {
+    uint8_t operations[] = {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ};
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    if (probe == NULL) {
+        return false;
+    }
+    bool is_supported = (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0);
+    for (size_t i = 0; is_supported && i < sizeof(operations); ++i) {
+        is_supported = operations[i] <= probe->last_op && (probe->ops[operations[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return is_supported;
+}
+
+/*!
+ * @brief create_ring creates an io_uring ring and maps its queues
+ * @return a pointer to the ring, NULL if io_uring cannot be used
+ */
+static async_ring_t *create_ring(void) {
+    async_ring_t *ring = calloc(1, sizeof(async_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, ASYNC_IO_QUEUE_DEPTH, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    if (!supports_operations(ring->fd)) {
+        destroy_ring(ring);
+        return NULL;
+    }
+
+    ring->owner = getpid();
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    bool is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (is_single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (is_single_mmap) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        destroy_ring(ring);
+        return NULL;
+    }
+
+    char *sq = (char *) ring->sq_ring;
+    char *cq = (char *) ring->cq_ring;
+    ring->sq_head = (unsigned int *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return ring;
+}
+
+/*!
+ * @brief thread_ring gives the ring of the current thread, created at its first call
+ * @return a pointer to the ring, NULL if io_uring is disabled or not supported
+ */
+static async_ring_t *thread_ring(void) {
+    if (!is_async_io_enabled || __atomic_load_n(&is_io_uring_missing, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    pthread_once(&ring_key_once, create_ring_key);
+    async_ring_t *ring = (async_ring_t *) pthread_getspecific(ring_key);
+    if (ring != NULL && ring->owner != getpid()) {
+        //Anneau hérité du processus parent : seules les copies de ce processus sont fermées
+        destroy_ring(ring);
+        ring = NULL;
+    }
+    if (ring == NULL) {
+        ring = create_ring();
+        if (ring == NULL) {
+            __atomic_store_n(&is_io_uring_missing, true, __ATOMIC_RELAXED);
+        }
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+/*!
+ * @brief queue_request adds a request to the submission queue of a ring, it is sent by the next submit_and_wait
+ * @param ring is a pointer to the ring
+ * @param op_code is the IORING_OP_ operation
+ * @param fd is the file descriptor argument of the operation
+ * @param address is the address argument (path or buffer)
+ * @param length is the length argument (length, mask or mode)
+ * @param offset is the offset argument (file offset or statx buffer)
+ * @param op_flags is the flags argument (open or statx flags)
+ * @param user_data is the value given back with the completion
+ * @return 0 in case of success, -1 if the submission queue is full
+ */
+static int queue_request(async_ring_t *ring, uint8_t op_code, int fd, const void *address, uint32_t length, uint64_t offset, uint32_t op_flags, uint64_t user_data) {
+    unsigned int tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+        return -1;
+    }
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op_code;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) address;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->rw_flags = op_flags; // Partage sa place avec open_flags et statx_flags
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+    return 0;
+}
+
+/*!
+ * @brief submit_and_wait sends the queued requests and waits for at least one completion
+ * @param ring is a pointer to the ring
+ * @return 0 in case of success, -1 else
+ */
+static int submit_and_wait(async_ring_t *ring) {
+    while (true) {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted >= 0) {
+            ring->to_submit -= (unsigned int) submitted;
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+    }
+}
+
+/*!
+ * @brief pop_completion takes the oldest completion of a ring
+ * @param ring is a pointer to the ring
+ * @param user_data is a pointer receiving the user_data of the request
+ * @param result is a pointer receiving the result of the request (negative errno in case of error)
+ * @return true if a completion was taken, false if there is none
+ */
+static bool pop_completion(async_ring_t *ring, uint64_t *user_data, int32_t *result) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*!
+ * @brief statx_to_stat converts the result of statx to the struct stat used by the rest of the program
+ * @param source is a pointer to the result of statx
+ * @param destination is a pointer to the struct stat to fill
+ */
+static void statx_to_stat(struct statx *source, struct stat *destination) {
+    memset(destination, 0, sizeof(*destination));
+    destination->st_dev = makedev(source->stx_dev_major, source->stx_dev_minor);
+    destination->st_ino = source->stx_ino;
+    destination->st_mode = source->stx_mode;
+    destination->st_nlink = source->stx_nlink;
+    destination->st_uid = source->stx_uid;
+    destination->st_gid = source->stx_gid;
+    destination->st_rdev = makedev(source->stx_rdev_major, source->stx_rdev_minor);
+    destination->st_size = source->stx_size;
+    destination->st_blksize = source->stx_blksize;
+    destination->st_blocks = source->stx_blocks;
+    destination->st_atim.tv_sec = source->stx_atime.tv_sec;
+    destination->st_atim.tv_nsec = source->stx_atime.tv_nsec;
+    destination->st_mtim.tv_sec = source->stx_mtime.tv_sec;
+    destination->st_mtim.tv_nsec = source->stx_mtime.tv_nsec;
+    destination->st_ctim.tv_sec = source->stx_ctime.tv_sec;
+    destination->st_ctim.tv_nsec = source->stx_ctime.tv_nsec;
+}
+
+/*!
+ * @brief set_async_io enables or disables io_uring
+ * It is set once, before the processes are created, so that analyzers inherit it.
+ * @param is_enabled tells if io_uring must be used when the kernel supports it
+ */
+void set_async_io(bool is_enabled) {
+    is_async_io_enabled = is_enabled;
+}
+
+/*!
+ * @brief async_io_available tells if the requests of the current thread can go through io_uring
+ * @return true if io_uring is enabled and a ring could be created
+ */
+bool async_io_available(void) {
+    return thread_ring() != NULL;
+}
+
+/*!
+ * @brief async_stat_at gets the stats of files relative to directories, with up to ASYNC_IO_QUEUE_DEPTH statx requests in flight
+ * Symbolic links are not followed, as with lstat: the listers only keep directories and regular files.
+ * @param directories is an array of directory descriptors, one for each name (AT_FDCWD for paths)
+ * @param names is an array of names relative to their directory
+ * @param count is the number of names
+ * @param stats is an array receiving the stats of each name
+ * @param errors is an array receiving 0 for each name whose stats were got, its errno value else
+ * @return 0 in case of success (some names may have errors), -1 if io_uring cannot be used (errno is set)
+ */
+int async_stat_at(int *directories, char **names, size_t count, struct stat *stats, int *errors) {
+    async_ring_t *ring = thread_ring();
+    if (ring == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    struct statx *buffers = malloc(count * sizeof(struct statx));
+    if (buffers == NULL) {
+        return -1;
+    }
+
+    size_t next = 0;
+    size_t done = 0;
+    while (done < count) {
+        while (next < count && queue_request(ring, IORING_OP_STATX, directories[next], names[next], STATX_BASIC_STATS, (uint64_t) (uintptr_t) &buffers[next], AT_SYMLINK_NOFOLLOW, next) == 0) {
+            ++next;
+        }
+        if (submit_and_wait(ring) == -1) {
+            //Des requêtes peuvent encore écrire dans les tampons : ils ne sont pas libérés, et l'anneau n'est plus utilisé
+            //(leurs réponses seraient prises pour celles des appels suivants)
+            __atomic_store_n(&is_io_uring_missing, true, __ATOMIC_RELAXED);
+            return -1;
+        }
+        uint64_t index;
+        int32_t result;
+        while (pop_completion(ring, &index, &result)) {
+            errors[index] = (result < 0) ? -result : 0;
+            if (result >= 0) {
+                statx_to_stat(&buffers[index], &stats[index]);
+            }
+            ++done;
+        }
+    }
+    free(buffers);
+    return 0;
+}
+
+/*!
+ * @brief async_read_file reads a whole file with ASYNC_IO_READS_IN_FLIGHT reads in flight, and gives its content in order
+ * @param path is the path of the file
+ * @param consume is the function receiving the content, called by the current thread
+ * @param context is passed to consume
+ * @return 0 in case of success, -1 else (errno is set, ENOSYS if io_uring cannot be used)
+ */
+int async_read_file(char *path, async_consumer_t consume, void *context) {
+    async_ring_t *ring = thread_ring();
+    if (ring == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (ring->read_buffers == NULL && (ring->read_buffers = malloc(ASYNC_IO_READS_IN_FLIGHT * ASYNC_IO_READ_SIZE)) == NULL) {
+        return -1;
+    }
+
+    //Ouverture du fichier par l'anneau, comme les lectures
+    uint64_t user_data;
+    int32_t result;
+    if (queue_request(ring, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, O_RDONLY | O_CLOEXEC, 0) == -1) {
+        return -1;
+    }
+    if (submit_and_wait(ring) == -1) {
+        __atomic_store_n(&is_io_uring_missing, true, __ATOMIC_RELAXED);
+        return -1;
+    }
+    while (!pop_completion(ring, &user_data, &result)) {
+        if (submit_and_wait(ring) == -1) {
+            __atomic_store_n(&is_io_uring_missing, true, __ATOMIC_RELAXED);
+            return -1;
+        }
+    }
+    if (result < 0) {
+        errno = -result;
+        return -1;
+    }
+    int fd = result;
+
+    //Le bloc n du fichier est lu dans le tampon n % ASYNC_IO_READS_IN_FLIGHT, qui n'est réutilisé qu'une fois consommé
+    uint32_t filled[ASYNC_IO_READS_IN_FLIGHT] = {0};
+    bool is_ready[ASYNC_IO_READS_IN_FLIGHT] = {false};
+    uint64_t issued = 0;
+    uint64_t consumed = 0;
+    int in_flight = 0;
+    int error = 0;
+    bool is_end = false;
+    while (true) {
+        while (!is_end && error == 0 && issued < consumed + ASYNC_IO_READS_IN_FLIGHT) {
+            int slot = issued % ASYNC_IO_READS_IN_FLIGHT;
+            filled[slot] = 0;
+            is_ready[slot] = false;
+            if (queue_request(ring, IORING_OP_READ, fd, ring->read_buffers + (size_t) slot * ASYNC_IO_READ_SIZE, ASYNC_IO_READ_SIZE,
+                              issued * ASYNC_IO_READ_SIZE, 0, issued) == -1) {
+                break;
+            }
+            ++issued;
+            ++in_flight;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+        if (submit_and_wait(ring) == -1) {
+            //Des lectures peuvent encore écrire dans les tampons de l'anneau : il n'est plus utilisé
+            __atomic_store_n(&is_io_uring_missing, true, __ATOMIC_RELAXED);
+            return -1;
+        }
+
+        while (pop_completion(ring, &user_data, &result)) {
+            int slot = user_data % ASYNC_IO_READS_IN_FLIGHT;
+            --in_flight;
+            if (result > 0) {
+                filled[slot] += result;
+            }
+            if (result > 0 && filled[slot] < ASYNC_IO_READ_SIZE && !is_end && error == 0) {
+                //Lecture incomplète : la suite du bloc est redemandée
+                if (queue_request(ring, IORING_OP_READ, fd, ring->read_buffers + (size_t) slot * ASYNC_IO_READ_SIZE + filled[slot],
+                                  ASYNC_IO_READ_SIZE - filled[slot], user_data * ASYNC_IO_READ_SIZE + filled[slot], 0, user_data) == 0) {
+                    ++in_flight;
+                    continue;
+                }
+            }
+            if (result < 0 && error == 0) {
+                error = -result;
+            }
+            is_ready[slot] = true;
+        }
+
+        //Les blocs sont donnés dans l'ordre du fichier, jusqu'au premier bloc incomplet (la fin du fichier)
+        while (!is_end && error == 0 && consumed < issued && is_ready[consumed % ASYNC_IO_READS_IN_FLIGHT]) {
+            int slot = consumed % ASYNC_IO_READS_IN_FLIGHT;
+            if (filled[slot] > 0) {
+                consume(context, ring->read_buffers + (size_t) slot * ASYNC_IO_READ_SIZE, filled[slot]);
+            }
+            is_end = (filled[slot] < ASYNC_IO_READ_SIZE);
+            ++consumed;
+        }
+    }
+
+    close(fd);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Requests kept in flight in the ring of each thread
+#define ASYNC_IO_QUEUE_DEPTH 64
+// Reads of a file in flight at the same time, and size of each read
+#define ASYNC_IO_READS_IN_FLIGHT 4
+#define ASYNC_IO_READ_SIZE (128 * 1024)
+
+// Receives the content of a file read by async_read_file, in order
+typedef void (*async_consumer_t)(void *context, const void *data, size_t length);
+
+void set_async_io(bool is_enabled);
+bool async_io_available(void);
+int async_stat_at(int *directories, char **names, size_t count, struct stat *stats, int *errors);
+int async_read_file(char *path, async_consumer_t consume, void *context);
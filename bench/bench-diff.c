@@ -0,0 +1,105 @@
+#include <diff.h>
+#include <files-list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <defines.h>
+
+// Au-delà de cette taille, la recherche entrée par entrée (find_entry_by_name) prendrait trop de temps
+#define BASELINE_MAX_ENTRIES 20000
+
+/*!
+ * @brief now_seconds gives a monotonic time
+ * @return the current time in seconds
+ */
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*!
+ * @brief make_synthetic_list builds a list of entries in a random order, as a directory listing would give them
+ * @param list is a pointer to the list to build
+ * @param root is the prefix of all the paths
+ * @param count is the number of entries
+ * @param seed is the seed of the shuffle, so that both sides are in different orders
+ * @param is_destination changes one entry in 10 and replaces one entry in 20 to get all kinds of results
+ */
+static void make_synthetic_list(files_list_t *list, char *root, size_t count, unsigned int seed, bool is_destination) {
+    size_t *order = malloc(sizeof(size_t) * count);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    srand(seed);
+    for (size_t i = count - 1; i > 0; --i) { // Mélange de Fisher-Yates
+        size_t j = (size_t) rand() % (i + 1);
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        char path[PATH_SIZE];
+        size_t id = order[i];
+        bool is_extra = is_destination && id % 20 == 0;
+        int path_length = snprintf(path, sizeof(path), "%s/d%04zu/%s%09zu", root, id % 1000, is_extra ? "old" : "f", id);
+        files_list_entry_t *entry = append_file_entry(list, path, path_length);
+        memset(entry->digest, 0, sizeof(entry->digest));
+        entry->entry_type = FICHIER;
+        entry->mode = 0644;
+        entry->size = id;
+        entry->mtime.tv_sec = 1700000000;
+        entry->mtime.tv_nsec = (is_destination && id % 10 == 1) ? 1 : 0;
+    }
+    free(order);
+}
+
+/*!
+ * @brief main runs the diff engine on growing synthetic lists and prints the results as CSV
+ * @param argc its number of arguments, including its own name
+ * @param argv the sizes of the lists to compare (10k to 10M by default)
+ * @return 0
+ */
+int main(int argc, char *argv[]) {
+    size_t default_sizes[] = {10000, 100000, 1000000, 10000000};
+    size_t sizes_count = (argc > 1) ? (size_t) argc - 1 : sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+    printf("entries,diff_seconds,baseline_seconds,new,changed,identical,extra,list_bytes_per_entry\n");
+    for (size_t s = 0; s < sizes_count; ++s) {
+        size_t count = (argc > 1) ? strtoull(argv[s + 1], NULL, 10) : default_sizes[s];
+        files_list_t source_list, dest_list;
+        init_files_list(&source_list);
+        init_files_list(&dest_list);
+        make_synthetic_list(&source_list, "/src", count, 1, false);
+        make_synthetic_list(&dest_list, "/backup/dst", count, 2, true);
+
+        double baseline = -1;
+        if (count <= BASELINE_MAX_ENTRIES) { // Ancienne méthode : une recherche dans la destination par entrée source
+            double start = now_seconds();
+            for (files_list_entry_t *cursor = source_list.head; cursor != NULL; cursor = cursor->next) {
+                find_entry_by_name(&dest_list, cursor->path_and_name, 12, 5);
+            }
+            baseline = now_seconds() - start;
+        }
+
+        diff_summary_t summary;
+        double start = now_seconds();
+        diff_files_lists(&source_list, &dest_list, 5, 12, false, false, NULL, NULL, &summary);
+        double elapsed = now_seconds() - start;
+
+        printf("%zu,%.6f,", count, elapsed);
+        if (baseline >= 0) {
+            printf("%.6f", baseline);
+        }
+        printf(",%lu,%lu,%lu,%lu,%.1f\n", (unsigned long) summary.new_count, (unsigned long) summary.changed_count,
+               (unsigned long) summary.identical_count, (unsigned long) summary.extra_count,
+               (double) (files_list_memory_peak(&source_list) + files_list_memory_peak(&dest_list)) / (2.0 * count));
+        fflush(stdout);
+
+        clear_files_list(&source_list);
+        clear_files_list(&dest_list);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <messages.h>
+#include <files-list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+
+// Taille d'un message par entrée avant les lots : l'entrée complète avec son chemin de PATH_SIZE octets
+#define LEGACY_MESSAGE_SIZE (sizeof(struct timespec) + 2 * sizeof(uint64_t) + 16 + 2 * sizeof(int) + PATH_SIZE + sizeof(uint64_t))
+
+#define BENCH_MSG_TYPE 1
+#define BENCH_END_CODE 0x7f
+
+/*!
+ * @brief now_seconds gives a monotonic time
+ * @return the current time in seconds
+ */
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*!
+ * @brief consume receives messages until the end message, as the main process does with the listers' entries
+ * @param msg_queue is the id of the MQ
+ */
+static void consume(int msg_queue) {
+    static any_message_t message;
+    while (msgrcv(msg_queue, &message, sizeof(message) - sizeof(long), BENCH_MSG_TYPE, 0) != -1) {
+        if (message.simple_command.message == BENCH_END_CODE) {
+            break;
+        }
+    }
+}
+
+/*!
+ * @brief run_bench sends a number of entries to a consumer process and measures the throughput
+ * @param entries_count is the number of entries to send
+ * @param is_batched selects batches of records (true) or one full-size message per entry (false)
+ */
+static void run_bench(size_t entries_count, bool is_batched) {
+    static entries_batch_t batch;
+    static char legacy_message[sizeof(long) + 1 + LEGACY_MESSAGE_SIZE];
+    int msg_queue = msgget(IPC_PRIVATE, 0600 | IPC_CREAT);
+    if (msg_queue == -1) {
+        perror("msgget");
+        return;
+    }
+    fflush(stdout);
+    pid_t consumer = fork();
+    if (consumer == 0) {
+        consume(msg_queue);
+        exit(EXIT_SUCCESS);
+    }
+
+    char path[PATH_SIZE];
+    files_list_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.path_and_name = path;
+    size_t messages_count = 0;
+    size_t bytes_count = 0;
+
+    double start = now_seconds();
+    init_entries_batch(&batch, BENCH_MSG_TYPE, COMMAND_CODE_FILE_ENTRY_FOR_SOURCE);
+    for (size_t i = 0; i < entries_count; ++i) {
+        entry.path_length = snprintf(path, sizeof(path), "/srv/data/d%04zu/file%08zu.dat", i % 1000, i); // ~30 octets
+        if (is_batched) {
+            if (!add_entry_to_batch(&batch, &entry, i, true)) {
+                bytes_count += sizeof(long) + 8 + batch.data_length;
+                send_entries_batch(msg_queue, &batch, 0);
+                ++messages_count;
+                add_entry_to_batch(&batch, &entry, i, true);
+            }
+        } else {
+            *(long *) legacy_message = BENCH_MSG_TYPE;
+            legacy_message[sizeof(long)] = COMMAND_CODE_FILE_ENTRY_FOR_SOURCE;
+            memcpy(legacy_message + sizeof(long) + 1, path, entry.path_length + 1);
+            msgsnd(msg_queue, legacy_message, 1 + LEGACY_MESSAGE_SIZE, 0);
+            bytes_count += sizeof(long) + 1 + LEGACY_MESSAGE_SIZE;
+            ++messages_count;
+        }
+    }
+    if (is_batched && batch.entries_count > 0) {
+        bytes_count += sizeof(long) + 8 + batch.data_length;
+        send_entries_batch(msg_queue, &batch, 0);
+        ++messages_count;
+    }
+    simple_command_t end = {BENCH_MSG_TYPE, BENCH_END_CODE};
+    msgsnd(msg_queue, &end, sizeof(end) - sizeof(long), 0);
+    waitpid(consumer, NULL, 0);
+    double elapsed = now_seconds() - start;
+
+    printf("%s,%zu,%zu,%.4f,%.0f,%.0f,%.1f\n", is_batched ? "batched" : "one_per_entry", entries_count, messages_count, elapsed,
+           messages_count / elapsed, entries_count / elapsed, (double) bytes_count / entries_count);
+    msgctl(msg_queue, IPC_RMID, NULL);
+}
+
+/*!
+ * @brief main compares one message per entry with batched records, through a SysV MQ
+ * @param argc its number of arguments, including its own name
+ * @param argv the number of entries to send (200000 by default)
+ * @return 0
+ */
+int main(int argc, char *argv[]) {
+    size_t entries_count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 200000;
+    printf("mode,entries,messages,seconds,messages_per_second,entries_per_second,bytes_per_entry\n");
+    run_bench(entries_count, false);
+    run_bench(entries_count, true);
+    return 0;
+}
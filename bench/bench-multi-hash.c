@@ -0,0 +1,172 @@
+#include <file-properties.h>
+#include <multi-hash.h>
+#include <files-list.h>
+#include <hash.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+#define FILE_SIZE 4096
+#define FILES_PER_DIRECTORY 1000
+
+/*!
+ * @brief now_seconds gives a monotonic time
+ * @return the current time in seconds
+ */
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*!
+ * @brief make_tree creates the files of the benchmark, FILES_PER_DIRECTORY per directory, and lists them
+ * @param list is a pointer to the list receiving the files, with their sizes
+ * @param root is the directory of the tree, created if needed
+ * @param count is the number of files
+ * @return 0 in case of success, -1 else
+ */
+static int make_tree(files_list_t *list, char *root, size_t count) {
+    uint8_t content[FILE_SIZE];
+    char path[PATH_SIZE];
+    mkdir(root, 0755);
+    for (size_t i = 0; i < count; ++i) {
+        if (i % FILES_PER_DIRECTORY == 0) {
+            snprintf(path, sizeof(path), "%s/d%04zu", root, i / FILES_PER_DIRECTORY);
+            mkdir(path, 0755);
+        }
+        int path_length = snprintf(path, sizeof(path), "%s/d%04zu/f%07zu", root, i / FILES_PER_DIRECTORY, i);
+        for (size_t j = 0; j < sizeof(content); ++j) {
+            content[j] = (uint8_t) (i * 31 + j * 7);
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || write(fd, content, sizeof(content)) != sizeof(content)) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+        files_list_entry_t *entry = append_file_entry(list, path, path_length);
+        entry->entry_type = FICHIER;
+        entry->size = FILE_SIZE;
+    }
+    return 0;
+}
+
+/*!
+ * @brief remove_tree deletes the files and directories created by make_tree
+ * @param list is a pointer to the list of the files
+ * @param root is the directory of the tree
+ * @param count is the number of files
+ */
+static void remove_tree(files_list_t *list, char *root, size_t count) {
+    char path[PATH_SIZE];
+    for (files_list_entry_t *entry = list->head; entry != NULL; entry = entry->next) {
+        unlink(entry->path_and_name);
+    }
+    for (size_t i = 0; i < count; i += FILES_PER_DIRECTORY) {
+        snprintf(path, sizeof(path), "%s/d%04zu", root, i / FILES_PER_DIRECTORY);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+/*!
+ * @brief bench_files hashes all the files of the list, one by one or by batches
+ * @param list is a pointer to the list of the files
+ * @param count is the number of files
+ * @param is_batched selects compute_files_digests by batches of FILE_STATS_BATCH files (true) or compute_file_digest (false)
+ * @return the duration in seconds
+ */
+static double bench_files(files_list_t *list, size_t count, bool is_batched) {
+    double start = now_seconds();
+    if (is_batched) {
+        files_list_entry_t *batch[FILE_STATS_BATCH];
+        bool is_ok[FILE_STATS_BATCH];
+        files_list_entry_t *entry = list->head;
+        while (entry != NULL) {
+            size_t batch_count = 0;
+            for (; entry != NULL && batch_count < FILE_STATS_BATCH; entry = entry->next) {
+                batch[batch_count++] = entry;
+            }
+            compute_files_digests(batch, batch_count, is_ok);
+        }
+    } else {
+        for (files_list_entry_t *entry = list->head; entry != NULL; entry = entry->next) {
+            compute_file_digest(entry);
+        }
+    }
+    return now_seconds() - start;
+}
+
+/*!
+ * @brief bench_kernels hashes buffers already in memory, to measure the hashing alone
+ * @param count is the number of buffers of FILE_SIZE bytes
+ */
+static void bench_kernels(size_t count) {
+    uint8_t *data = malloc(count * FILE_SIZE);
+    const uint8_t **messages = malloc(count * sizeof(uint8_t *));
+    size_t *lengths = malloc(count * sizeof(size_t));
+    uint8_t (*digests)[16] = malloc(count * 16);
+    if (data == NULL || messages == NULL || lengths == NULL || digests == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < count * FILE_SIZE; ++i) {
+        data[i] = (uint8_t) (i * 7);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        messages[i] = data + i * FILE_SIZE;
+        lengths[i] = FILE_SIZE;
+    }
+
+    double start = now_seconds();
+    for (size_t i = 0; i < count; ++i) {
+        EVP_Digest(messages[i], FILE_SIZE, digests[i], NULL, EVP_md5(), NULL);
+    }
+    double seconds = now_seconds() - start;
+    printf("memory-sequential,%zu,%d,1,%.3f,%.0f\n", count, FILE_SIZE, seconds, count / seconds);
+
+    start = now_seconds();
+    md5_multi_buffer(messages, lengths, count, digests);
+    seconds = now_seconds() - start;
+    printf("memory-batched,%zu,%d,%d,%.3f,%.0f\n", count, FILE_SIZE, multi_hash_lanes(), seconds, count / seconds);
+
+    free(data);
+    free(messages);
+    free(lengths);
+    free(digests);
+}
+
+/*!
+ * @brief main hashes a tree of small files with MD5, one by one then by batches, and prints the results as CSV
+ * Arguments: number of files (1000000 by default), directory of the tree (created then removed).
+ */
+int main(int argc, char *argv[]) {
+    size_t files_count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    char *root = (argc > 2) ? argv[2] : "/tmp/lp25-bench-multi-hash";
+    files_list_t list;
+    init_files_list(&list);
+    set_hash_algorithm(HASH_MD5);
+
+    if (make_tree(&list, root, files_count) == -1) {
+        remove_tree(&list, root, files_count);
+        clear_files_list(&list);
+        return 1;
+    }
+    printf("mode,files,file_size,lanes,seconds,files_per_second\n");
+    bench_kernels(files_count < 100000 ? files_count : 100000);
+    bench_files(&list, files_count, false); // Premier passage non mesuré : les fichiers sont mis en cache par le noyau
+    double seconds = bench_files(&list, files_count, false);
+    printf("files-sequential,%zu,%d,1,%.3f,%.0f\n", files_count, FILE_SIZE, seconds, files_count / seconds);
+    seconds = bench_files(&list, files_count, true);
+    printf("files-batched,%zu,%d,%d,%.3f,%.0f\n", files_count, FILE_SIZE, multi_hash_lanes(), seconds, files_count / seconds);
+
+    remove_tree(&list, root, files_count);
+    clear_files_list(&list);
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include <defines.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Runs lp25-backup on the trees made by gen-tree, with several configurations, and appends one CSV line
+// per run to a results file. Before each run, <root>/work is reset to a copy of <root>/destination.
+// The CPU times and the peak RSS come from wait4 (they include the processes forked by lp25-backup);
+// the read and written bytes and the read/write syscalls come from /proc/self/io, to which the I/O of
+// the children is added when they are waited for. Other syscalls are not counted: tracing them would
+// change the timings.
+
+#define MAX_ARGUMENTS 32
+
+typedef struct {
+    uint64_t read_bytes; // rchar
+    uint64_t written_bytes; // wchar
+    uint64_t read_syscalls; // syscr
+    uint64_t write_syscalls; // syscw
+} io_counters_t;
+
+static char *default_configurations[] = {
+        "--no-parallel",
+        "--no-parallel --date-size-only",
+        "-n 4",
+        "-n 4 --date-size-only",
+        "-n 4 --transport=shm",
+        "-n 4 --workers=threads",
+        "-n 4 --streaming",
+};
+
+/*!
+ * @brief now_seconds gives a monotonic time
+ * @return the current time in seconds
+ */
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*!
+ * @brief read_io_counters reads the I/O counters of this process and of its waited children
+ * @param counters receives the counters
+ * @return 0 in case of success, -1 else
+ */
+static int read_io_counters(io_counters_t *counters) {
+    FILE *io = fopen("/proc/self/io", "r");
+    if (io == NULL) {
+        return -1;
+    }
+    char name[32];
+    unsigned long long value;
+    memset(counters, 0, sizeof(io_counters_t));
+    while (fscanf(io, "%31[^:]: %llu\n", name, &value) == 2) {
+        if (strcmp(name, "rchar") == 0) {
+            counters->read_bytes = value;
+        } else if (strcmp(name, "wchar") == 0) {
+            counters->written_bytes = value;
+        } else if (strcmp(name, "syscr") == 0) {
+            counters->read_syscalls = value;
+        } else if (strcmp(name, "syscw") == 0) {
+            counters->write_syscalls = value;
+        }
+    }
+    fclose(io);
+    return 0;
+}
+
+/*!
+ * @brief reset_destination replaces the destination of the runs by a copy of the generated one (not measured)
+ * @param root is the root of the generated trees
+ * @return 0 in case of success, -1 else
+ */
+static int reset_destination(char *root) {
+    char command[3 * PATH_SIZE];
+    snprintf(command, sizeof(command), "rm -rf '%s/work' && cp -a '%s/destination' '%s/work'", root, root, root);
+    return (system(command) == 0) ? 0 : -1;
+}
+
+/*!
+ * @brief run_configuration runs lp25-backup once with a configuration and writes the measures as CSV
+ * @param binary is the path of lp25-backup
+ * @param root is the root of the generated trees
+ * @param configuration holds the options of the run, separated by spaces
+ * @param run is the number of the run
+ * @param results is the results file
+ * @return 0 in case of success, -1 else
+ */
+static int run_configuration(char *binary, char *root, char *configuration, int run, FILE *results) {
+    char options[PATH_SIZE];
+    char source[PATH_SIZE];
+    char destination[PATH_SIZE];
+    char *arguments[MAX_ARGUMENTS + 4];
+    int count = 0;
+    strncpy(options, configuration, sizeof(options) - 1);
+    options[sizeof(options) - 1] = '\0';
+    arguments[count++] = binary;
+    for (char *option = strtok(options, " "); option != NULL && count < MAX_ARGUMENTS; option = strtok(NULL, " ")) {
+        arguments[count++] = option;
+    }
+    snprintf(source, sizeof(source), "%s/source", root);
+    snprintf(destination, sizeof(destination), "%s/work", root);
+    arguments[count++] = source;
+    arguments[count++] = destination;
+    arguments[count] = NULL;
+    if (reset_destination(root) == -1) {
+        printf("Impossible de preparer %s\n", destination);
+        return -1;
+    }
+
+    io_counters_t before, after;
+    read_io_counters(&before);
+    double start = now_seconds();
+    pid_t child = fork();
+    if (child == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (child == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execv(binary, arguments);
+        perror(binary);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) == -1) {
+        perror("wait4");
+        return -1;
+    }
+    double wall = now_seconds() - start;
+    read_io_counters(&after);
+
+    fprintf(results, "\"%s\",%d,%.4f,%.4f,%.4f,%ld,%lu,%lu,%lu,%lu,%d\n", configuration, run, wall,
+            usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6, usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6, usage.ru_maxrss,
+            (unsigned long) (after.read_syscalls - before.read_syscalls), (unsigned long) (after.write_syscalls - before.write_syscalls),
+            (unsigned long) (after.read_bytes - before.read_bytes), (unsigned long) (after.written_bytes - before.written_bytes),
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    fflush(results);
+    return 0;
+}
+
+/*!
+ * @brief main runs every configuration several times and appends the measures to the results file
+ * @param argc its number of arguments, including its own name
+ * @param argv lp25-backup, the root of the trees, the results file, then optionally the number of runs and the configurations
+ * @return 0 in case of success, 1 else
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("%s lp25-backup root results.csv [runs [\"options\"...]]\n", argv[0]);
+        return 1;
+    }
+    int runs = (argc > 4) ? atoi(argv[4]) : 3;
+    char **configurations = (argc > 5) ? argv + 5 : default_configurations;
+    int configurations_count = (argc > 5) ? argc - 5 : (int) (sizeof(default_configurations) / sizeof(default_configurations[0]));
+
+    FILE *results = fopen(argv[3], "a");
+    if (results == NULL) {
+        perror(argv[3]);
+        return 1;
+    }
+    fseek(results, 0, SEEK_END);
+    if (ftell(results) == 0) {
+        fprintf(results, "configuration,run,wall_seconds,user_seconds,system_seconds,max_rss_kib,read_syscalls,write_syscalls,"
+                         "read_bytes,written_bytes,exit_status\n");
+    }
+    for (int c = 0; c < configurations_count; ++c) {
+        for (int run = 1; run <= runs; ++run) {
+            if (run_configuration(argv[1], argv[2], configurations[c], run, results) == -1) {
+                fclose(results);
+                return 1;
+            }
+        }
+        printf("%s : %d execution(s)\n", configurations[c], runs);
+    }
+    fclose(results);
+    return 0;
+}
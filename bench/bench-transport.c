@@ -0,0 +1,144 @@
+#include <messages.h>
+#include <shm-transport.h>
+#include <files-list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+
+/*!
+ * @brief now_seconds gives a monotonic time
+ * @return the current time in seconds
+ */
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*!
+ * @brief echo_analyzer answers the batches it receives as an analyzer does, without touching the disk
+ * @param msg_queue is the id of the MQ (-1 with the shared memory transport)
+ */
+static void echo_analyzer(int msg_queue) {
+    static any_message_t message;
+    files_list_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.entry_type = FICHIER;
+    entry.mode = 0644;
+    while (receive_message(msg_queue, &message, MSG_TYPE_TO_SOURCE_ANALYZERS, 0) != -1) {
+        if (message.simple_command.message == COMMAND_CODE_TERMINATE) {
+            break;
+        }
+        entries_batch_t *batch = received_batch(&message);
+        for (file_entry_record_t *record = next_batch_record(batch, NULL); record != NULL; record = next_batch_record(batch, record)) {
+            entry.size = record->path_length;
+            entry_to_record(&entry, record, true);
+        }
+        batch->mtype = MSG_TYPE_TO_SOURCE_LISTER;
+        batch->op_code = COMMAND_CODE_FILE_ANALYZED;
+        send_entries_batch(msg_queue, batch, 0);
+    }
+}
+
+/*!
+ * @brief run_bench sends all the entries of a list to analyzers, at most one batch per analyzer in flight, like the lister
+ * @param list is a pointer to the list of entries
+ * @param entries_count is the number of entries of the list
+ * @param analyzers_count is the number of analyzer processes
+ * @param use_shm selects the shared memory transport (true) or the SysV MQ (false)
+ */
+static void run_bench(files_list_t *list, size_t entries_count, int analyzers_count, bool use_shm) {
+    static entries_batch_t local_batch;
+    static any_message_t message;
+    int msg_queue = -1;
+    if (use_shm) {
+        if (create_shm_transport(2 * analyzers_count + SHM_SPARE_BATCHES) == -1) {
+            return;
+        }
+    } else if ((msg_queue = msgget(IPC_PRIVATE, 0600 | IPC_CREAT)) == -1) {
+        perror("msgget");
+        return;
+    }
+    for (int i = 0; i < analyzers_count; ++i) {
+        fflush(stdout);
+        if (fork() == 0) {
+            echo_analyzer(msg_queue);
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    double start = now_seconds();
+    files_list_entry_t *cursor = list->head;
+    size_t budget = in_flight_budget();
+    size_t in_flight_bytes = 0;
+    size_t answered = 0;
+    size_t batches_count = 0;
+    int in_flight = 0;
+    while (cursor != NULL || in_flight > 0) {
+        while (cursor != NULL && in_flight < analyzers_count && (in_flight == 0 || in_flight_bytes < budget)) {
+            entries_batch_t *batch = new_entries_batch(&local_batch, MSG_TYPE_TO_SOURCE_ANALYZERS, COMMAND_CODE_ANALYZE_FILE);
+            while (cursor != NULL && batch->entries_count < MSG_ANALYZE_BATCH_ENTRIES && (batch->entries_count == 0 || in_flight_bytes + batch->data_length < budget)
+                   && add_entry_to_batch(batch, cursor, (uint64_t) (uintptr_t) cursor, true)) {
+                cursor = cursor->next;
+            }
+            in_flight_bytes += batch->data_length;
+            send_entries_batch(msg_queue, batch, 0);
+            ++in_flight;
+            ++batches_count;
+        }
+        if (receive_message(msg_queue, &message, MSG_TYPE_TO_SOURCE_LISTER, 0) == -1) {
+            perror("receive_message");
+            break;
+        }
+        entries_batch_t *batch = received_batch(&message);
+        for (file_entry_record_t *record = next_batch_record(batch, NULL); record != NULL; record = next_batch_record(batch, record)) {
+            record_to_entry(record, (files_list_entry_t *) (uintptr_t) record->request_id);
+            ++answered;
+        }
+        in_flight_bytes -= batch->data_length;
+        release_batch(batch);
+        --in_flight;
+    }
+    double elapsed = now_seconds() - start;
+
+    for (int i = 0; i < analyzers_count; ++i) {
+        send_terminate_command(msg_queue, MSG_TYPE_TO_SOURCE_ANALYZERS);
+    }
+    while (wait(NULL) > 0);
+    printf("%s,%d,%zu,%zu,%.4f,%.0f\n", use_shm ? "shm" : "mq", analyzers_count, answered, batches_count, elapsed, entries_count / elapsed);
+    if (use_shm) {
+        destroy_shm_transport();
+    } else {
+        msgctl(msg_queue, IPC_RMID, NULL);
+    }
+}
+
+/*!
+ * @brief main compares the SysV MQ and the shared memory transport between a lister and its analyzers
+ * @param argc its number of arguments, including its own name
+ * @param argv the number of entries to analyze (200000 by default)
+ * @return 0
+ */
+int main(int argc, char *argv[]) {
+    size_t entries_count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 200000;
+    int analyzers_counts[] = {1, 4, 16, 64};
+    char path[PATH_SIZE];
+    files_list_t list;
+    init_files_list(&list);
+    for (size_t i = 0; i < entries_count; ++i) {
+        size_t path_length = snprintf(path, sizeof(path), "/srv/data/d%04zu/file%08zu.dat", i % 1000, i);
+        append_file_entry(&list, path, path_length);
+    }
+
+    printf("transport,analyzers,entries,batches,seconds,entries_per_second\n");
+    for (size_t i = 0; i < sizeof(analyzers_counts) / sizeof(analyzers_counts[0]); ++i) {
+        run_bench(&list, entries_count, analyzers_counts[i], false);
+        run_bench(&list, entries_count, analyzers_counts[i], true);
+    }
+    clear_files_list(&list);
+    return 0;
+}
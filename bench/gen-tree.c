@@ -0,0 +1,254 @@
+#include <defines.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Builds a source tree and a destination tree to synchronize, for bench-sync:
+// <root>/source and <root>/destination hold the same files, except a share of modified ones, whose
+// destination copy has another content of the same size and an older mtime (so that --date-size-only sees them too).
+// The files are spread over the directories of a tree of the given depth and fan-out.
+
+#define WRITE_BLOCK_SIZE (64 * 1024)
+
+typedef enum {SIZES_FIXED, SIZES_UNIFORM, SIZES_PARETO} sizes_distribution_t;
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+/*!
+ * @brief next_random gives the next value of a xorshift generator, reproducible with the same seed
+ * @return a pseudo random value
+ */
+static uint64_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+/*!
+ * @brief draw_size gives the size of a file
+ * @param distribution is the distribution of the sizes
+ * @param mean_size is the mean size of the files
+ * @return the size, in bytes
+ */
+static uint64_t draw_size(sizes_distribution_t distribution, uint64_t mean_size) {
+    double uniform = (next_random() >> 11) * (1.0 / 9007199254740992.0); // Dans [0, 1[
+    switch (distribution) {
+        case SIZES_UNIFORM:
+            return (uint64_t) (uniform * 2 * mean_size);
+        case SIZES_PARETO:
+            //Pareto d'indice 1.5 : beaucoup de petits fichiers et quelques très gros, de moyenne mean_size
+            return (uint64_t) (mean_size / 3.0 / pow(1.0 - uniform, 1.0 / 1.5));
+        default:
+            return mean_size;
+    }
+}
+
+/*!
+ * @brief write_file writes a file of pseudo random content
+ * @param path is the path of the file
+ * @param size is its size
+ * @param seed is the seed of its content
+ * @return 0 in case of success, -1 else
+ */
+static int write_file(char *path, uint64_t size, uint64_t seed) {
+    static uint64_t block[WRITE_BLOCK_SIZE / sizeof(uint64_t)];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+    uint64_t saved_state = random_state;
+    random_state = seed | 1;
+    for (uint64_t written = 0; written < size; written += WRITE_BLOCK_SIZE) {
+        for (size_t i = 0; i < WRITE_BLOCK_SIZE / sizeof(uint64_t); ++i) {
+            block[i] = next_random();
+        }
+        size_t length = (size - written < WRITE_BLOCK_SIZE) ? size - written : WRITE_BLOCK_SIZE;
+        if (write(fd, block, length) != (ssize_t) length) {
+            perror(path);
+            close(fd);
+            random_state = saved_state;
+            return -1;
+        }
+    }
+    random_state = saved_state;
+    return close(fd);
+}
+
+/*!
+ * @brief directory_of gives the relative path of a directory of the tree
+ * Directory d is the d-th of a breadth first walk of the tree, whose root is numbered 0.
+ * @param path receives the relative path of the directory, it must hold PATH_SIZE bytes
+ * @param index is the number of the directory
+ * @param fanout is the number of subdirectories of each directory
+ */
+static void directory_of(char *path, uint64_t index, uint64_t fanout) {
+    char suffix[PATH_SIZE];
+    path[0] = '\0';
+    while (index > 0) {
+        snprintf(suffix, sizeof(suffix), "/d%02lu%s", (unsigned long) ((index - 1) % fanout), path);
+        strcpy(path, suffix);
+        index = (index - 1) / fanout;
+    }
+}
+
+/*!
+ * @brief make_directories creates a directory of the tree on both sides
+ * @param root is the root of both trees
+ * @param relative_path is the path of the directory in the trees
+ * @return 0 in case of success, -1 else
+ */
+static int make_directories(char *root, char *relative_path) {
+    char *sides[] = {"source", "destination"};
+    for (int side = 0; side < 2; ++side) {
+        char path[PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s%s", root, sides[side], relative_path);
+        if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+            perror(path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief display_usage prints the options of the generator
+ * @param my_name is the name of the binary file
+ */
+static void display_usage(char *my_name) {
+    printf("%s [options] root\n", my_name);
+    printf("Options: \t--files <count>\tnumber of files (10000 by default)\n");
+    printf("         \t--mean-size <size>\tmean size of the files, suffixes K, M, G (16K by default)\n");
+    printf("         \t--sizes=fixed|uniform|pareto\tdistribution of the sizes (pareto by default)\n");
+    printf("         \t--depth <depth> --fanout <count>\tshape of the tree of directories (3 and 8 by default)\n");
+    printf("         \t--modified <percent>\tshare of files that differ in the destination (10 by default)\n");
+    printf("         \t--seed <value>\tseed of the sizes and contents\n");
+}
+
+/*!
+ * @brief main generates the source and destination trees under a root
+ * @param argc its number of arguments, including its own name
+ * @param argv the options and the root
+ * @return 0 in case of success, 1 else
+ */
+int main(int argc, char *argv[]) {
+    uint64_t files_count = 10000;
+    uint64_t mean_size = 16 * 1024;
+    sizes_distribution_t distribution = SIZES_PARETO;
+    uint64_t depth = 3;
+    uint64_t fanout = 8;
+    uint64_t modified_percent = 10;
+    struct option long_options[] = {
+            {"files", required_argument, NULL, 'f'},
+            {"mean-size", required_argument, NULL, 's'},
+            {"sizes", required_argument, NULL, 'z'},
+            {"depth", required_argument, NULL, 'd'},
+            {"fanout", required_argument, NULL, 'o'},
+            {"modified", required_argument, NULL, 'm'},
+            {"seed", required_argument, NULL, 'r'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+                files_count = strtoull(optarg, NULL, 10);
+                break;
+            case 's': {
+                char *suffix;
+                mean_size = strtoull(optarg, &suffix, 10);
+                mean_size <<= (*suffix == 'K') ? 10 : (*suffix == 'M') ? 20 : (*suffix == 'G') ? 30 : 0;
+                break;
+            }
+            case 'z':
+                if (strcmp(optarg, "fixed") == 0) {
+                    distribution = SIZES_FIXED;
+                } else if (strcmp(optarg, "uniform") == 0) {
+                    distribution = SIZES_UNIFORM;
+                } else if (strcmp(optarg, "pareto") == 0) {
+                    distribution = SIZES_PARETO;
+                } else {
+                    printf("Distribution inconnue : %s (fixed, uniform ou pareto)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                depth = strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                fanout = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                modified_percent = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                random_state = strtoull(optarg, NULL, 10) | 1;
+                break;
+            default:
+                display_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || fanout == 0 || modified_percent > 100) {
+        display_usage(argv[0]);
+        return 1;
+    }
+    char *root = argv[optind];
+
+    //Nombre de répertoires d'un arbre complet : 1 + f + f^2 + ... + f^depth
+    uint64_t directories_count = 1;
+    for (uint64_t level = 0, width = 1; level < depth; ++level) {
+        width *= fanout;
+        directories_count += width;
+    }
+    char path[2 * PATH_SIZE];
+    char relative_path[PATH_SIZE];
+    if ((mkdir(root, 0755) == -1 && errno != EEXIST) || make_directories(root, "") == -1) {
+        perror(root);
+        return 1;
+    }
+    for (uint64_t d = 1; d < directories_count; ++d) {
+        directory_of(relative_path, d, fanout);
+        if (make_directories(root, relative_path) == -1) {
+            return 1;
+        }
+    }
+
+    uint64_t total_bytes = 0;
+    uint64_t modified_count = 0;
+    for (uint64_t i = 0; i < files_count; ++i) {
+        uint64_t size = draw_size(distribution, mean_size);
+        uint64_t seed = next_random();
+        bool is_modified = next_random() % 100 < modified_percent;
+        directory_of(relative_path, i % directories_count, fanout);
+
+        snprintf(path, sizeof(path), "%s/source%s/f%07lu", root, relative_path, (unsigned long) i);
+        if (write_file(path, size, seed) == -1) {
+            return 1;
+        }
+        snprintf(path, sizeof(path), "%s/destination%s/f%07lu", root, relative_path, (unsigned long) i);
+        if (write_file(path, size, is_modified ? seed + 1 : seed) == -1) {
+            return 1;
+        }
+        //Même mtime pour les fichiers identiques, une heure plus tôt pour les modifiés
+        struct timespec times[2] = {{1700000000, 0}, {is_modified ? 1699996400 : 1700000000, 0}};
+        utimensat(AT_FDCWD, path, times, 0);
+        times[1].tv_sec = 1700000000;
+        snprintf(path, sizeof(path), "%s/source%s/f%07lu", root, relative_path, (unsigned long) i);
+        utimensat(AT_FDCWD, path, times, 0);
+        total_bytes += size;
+        modified_count += is_modified;
+    }
+    printf("files,directories,bytes,modified\n%lu,%lu,%lu,%lu\n", (unsigned long) files_count, (unsigned long) directories_count,
+           (unsigned long) total_bytes, (unsigned long) modified_count);
+    return 0;
+}
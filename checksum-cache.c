@@ -0,0 +1,331 @@
+#include <checksum-cache.h>
+#include <defines.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Functions in this file keep the digests of the files between runs, with the algorithm used for each.
+// The cache file is an append-only log of fixed-size records after a header: appending a record
+// is a single write() on a file opened with O_APPEND, so the analyzer processes can add records
+// concurrently. A record cut by a crash fails its checksum and is dropped at the next load.
+// In memory, only the latest record of each (device, inode) is kept in an open addressing table,
+// protected by a mutex for the threaded mode.
+
+static int cache_fd = -1;
+static char cache_file_path[PATH_SIZE];
+static checksum_cache_record_t *cache_table = NULL;
+static size_t cache_capacity = 0;
+static size_t cache_count = 0;
+static size_t cache_records_in_file = 0;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECKSUM_CACHE_INITIAL_CAPACITY 4096
+#define CHECKSUM_CACHE_READ_RECORDS 4096
+
+/*!
+ * @brief fnv1a_64 computes a FNV-1a hash
+ * @param data is a pointer to the bytes to hash
+ * @param length is the number of bytes
+ * @return the hash value
+ */
+static uint64_t fnv1a_64(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*!
+ * @brief record_checksum computes the checksum of a record (all fields but the checksum itself)
+ * @param record is a pointer to the record
+ * @return the checksum
+ */
+static uint64_t record_checksum(checksum_cache_record_t *record) {
+    return fnv1a_64(record, offsetof(checksum_cache_record_t, checksum));
+}
+
+/*!
+ * @brief make_checksum_cache_key builds the cache key of a file from its stats
+ * @param file_stat is a pointer to the result of stat on the file
+ * @param key is a pointer to the key to fill
+ */
+void make_checksum_cache_key(struct stat *file_stat, checksum_cache_key_t *key) {
+    key->device = file_stat->st_dev;
+    key->inode = file_stat->st_ino;
+    key->size = file_stat->st_size;
+    key->mtime_ns = (int64_t) file_stat->st_mtim.tv_sec * 1000000000 + file_stat->st_mtim.tv_nsec;
+    key->ctime_ns = (int64_t) file_stat->st_ctim.tv_sec * 1000000000 + file_stat->st_ctim.tv_nsec;
+}
+
+/*!
+ * @brief find_slot looks for the slot of a file in the table
+ * @param key is a pointer to the key of the file (only device and inode are used)
+ * @return a pointer to the slot of the file, or to the empty slot where it would be inserted
+ */
+static checksum_cache_record_t *find_slot(checksum_cache_key_t *key) {
+    uint64_t identity[2] = {key->device, key->inode};
+    size_t position = fnv1a_64(identity, sizeof(identity)) & (cache_capacity - 1);
+    while (cache_table[position].key.inode != 0) { // Un inode 0 n'existe pas : il marque les cases vides
+        if (cache_table[position].key.inode == key->inode && cache_table[position].key.device == key->device) {
+            break;
+        }
+        position = (position + 1) & (cache_capacity - 1);
+    }
+    return &cache_table[position];
+}
+
+/*!
+ * @brief insert_record puts a record in the table, replacing any older state of the same file
+ * @param record is a pointer to the record to insert
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+static int insert_record(checksum_cache_record_t *record) {
+    if ((cache_count + 1) * 4 > cache_capacity * 3) { // Agrandissement au-delà de 75% de remplissage
+        size_t new_capacity = (cache_capacity == 0) ? CHECKSUM_CACHE_INITIAL_CAPACITY : cache_capacity * 2;
+        checksum_cache_record_t *new_table = calloc(new_capacity, sizeof(checksum_cache_record_t));
+        if (new_table == NULL) {
+            return -1;
+        }
+        checksum_cache_record_t *old_table = cache_table;
+        size_t old_capacity = cache_capacity;
+        cache_table = new_table;
+        cache_capacity = new_capacity;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_table[i].key.inode != 0) {
+                *find_slot(&old_table[i].key) = old_table[i];
+            }
+        }
+        free(old_table);
+    }
+
+    checksum_cache_record_t *slot = find_slot(&record->key);
+    if (slot->key.inode == 0) {
+        ++cache_count;
+    }
+    *slot = *record;
+    return 0;
+}
+
+/*!
+ * @brief load_records reads all the valid records of the cache file into the table
+ * A cut or corrupted record ends the log: the file is truncated there so that next appends stay aligned.
+ * @return 0 in case of success, -1 else
+ */
+static int load_records(void) {
+    static checksum_cache_record_t records[CHECKSUM_CACHE_READ_RECORDS];
+    off_t valid_end = sizeof(CHECKSUM_CACHE_MAGIC);
+    ssize_t bytes_read;
+
+    cache_records_in_file = 0;
+    if (lseek(cache_fd, valid_end, SEEK_SET) == -1) {
+        return -1;
+    }
+    while ((bytes_read = read(cache_fd, records, sizeof(records))) > 0) {
+        size_t records_count = bytes_read / sizeof(checksum_cache_record_t);
+        for (size_t i = 0; i < records_count; ++i) {
+            if (records[i].key.inode == 0 || records[i].checksum != record_checksum(&records[i])) {
+                fprintf(stderr, "Cache %s : enregistrement invalide, le cache est tronque a %ld octets\n", cache_file_path, (long) valid_end);
+                return ftruncate(cache_fd, valid_end);
+            }
+            if (insert_record(&records[i]) == -1) {
+                return -1;
+            }
+            valid_end += sizeof(checksum_cache_record_t);
+            ++cache_records_in_file;
+        }
+        if (bytes_read % sizeof(checksum_cache_record_t) != 0) { // Dernier enregistrement incomplet
+            return ftruncate(cache_fd, valid_end);
+        }
+    }
+    return (bytes_read == -1) ? -1 : 0;
+}
+
+/*!
+ * @brief open_checksum_cache opens (or creates) the cache file and loads it
+ * It must be called before creating the analyzer processes, so that they inherit the loaded table.
+ * @param cache_path is the path to the cache file
+ * @return 0 in case of success, -1 else (the program then runs without cache)
+ */
+int open_checksum_cache(char *cache_path) {
+    if (strlen(cache_path) >= PATH_SIZE) {
+        return -1;
+    }
+    strcpy(cache_file_path, cache_path);
+
+    cache_fd = open(cache_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (cache_fd == -1) {
+        perror("Erreur a l'ouverture du cache des empreintes");
+        return -1;
+    }
+
+    char magic[sizeof(CHECKSUM_CACHE_MAGIC)];
+    ssize_t magic_length = pread(cache_fd, magic, sizeof(magic), 0);
+    if (magic_length == 0) { // Nouveau cache
+        if (write(cache_fd, CHECKSUM_CACHE_MAGIC, sizeof(CHECKSUM_CACHE_MAGIC)) != sizeof(CHECKSUM_CACHE_MAGIC)) {
+            close(cache_fd);
+            cache_fd = -1;
+            return -1;
+        }
+        return 0;
+    }
+    if (magic_length == sizeof(magic) && memcmp(magic, CHECKSUM_CACHE_MAGIC, sizeof(magic)) != 0
+        && memcmp(magic, CHECKSUM_CACHE_MAGIC_PREFIX, strlen(CHECKSUM_CACHE_MAGIC_PREFIX)) == 0) {
+        // Cache d'une version précédente : ses enregistrements n'ont pas le même format, il est vidé
+        fprintf(stderr, "Cache %s d'une version precedente, il est recree\n", cache_path);
+        if (ftruncate(cache_fd, 0) == -1 || write(cache_fd, CHECKSUM_CACHE_MAGIC, sizeof(CHECKSUM_CACHE_MAGIC)) != sizeof(CHECKSUM_CACHE_MAGIC)) {
+            close(cache_fd);
+            cache_fd = -1;
+            return -1;
+        }
+        return 0;
+    }
+    if (magic_length != sizeof(magic) || memcmp(magic, CHECKSUM_CACHE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s n'est pas un cache d'empreintes, il n'est pas utilise\n", cache_path);
+        close(cache_fd);
+        cache_fd = -1;
+        return -1;
+    }
+
+    if (load_records() == -1) {
+        perror("Erreur a la lecture du cache des empreintes");
+        close_checksum_cache(false);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief checksum_cache_lookup looks for the digest of a file in the cache, computed with the current algorithm and tree hash mode
+ * @param key is a pointer to the key of the file in its current state
+ * @param digest is where the HASH_MAX_DIGEST_SIZE bytes of the digest are copied when found
+ * @return true if the digest was found for this exact state of the file, false else
+ */
+bool checksum_cache_lookup(checksum_cache_key_t *key, uint8_t *digest) {
+    if (cache_fd == -1 || cache_count == 0) {
+        return false;
+    }
+    pthread_mutex_lock(&cache_mutex);
+    checksum_cache_record_t *slot = find_slot(key);
+    bool is_found = slot->key.inode != 0 && memcmp(&slot->key, key, sizeof(checksum_cache_key_t)) == 0 // Sinon fichier inconnu ou modifié depuis le calcul de son empreinte
+                    && slot->algorithm == get_hash_algorithm() && slot->tree_chunk_shift == tree_hash_chunk_shift();
+    if (is_found) {
+        memcpy(digest, slot->digest, sizeof(slot->digest));
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return is_found;
+}
+
+/*!
+ * @brief append_record writes a record to the cache file and puts it in the table
+ * @param key is a pointer to the key of the file
+ * @param digest is a pointer to the HASH_MAX_DIGEST_SIZE bytes of the digest
+ * @return 0 in case of success, -1 else
+ */
+static int append_record(checksum_cache_key_t *key, uint8_t *digest) {
+    checksum_cache_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.key = *key;
+    memcpy(record.digest, digest, sizeof(record.digest));
+    record.algorithm = get_hash_algorithm();
+    record.tree_chunk_shift = tree_hash_chunk_shift();
+    record.checksum = record_checksum(&record);
+
+    if (write(cache_fd, &record, sizeof(record)) != sizeof(record)) {
+        return -1;
+    }
+    pthread_mutex_lock(&cache_mutex);
+    ++cache_records_in_file;
+    int result = insert_record(&record);
+    pthread_mutex_unlock(&cache_mutex);
+    return result;
+}
+
+/*!
+ * @brief checksum_cache_store adds the digest of a file to the cache, with the current algorithm and tree hash mode
+ * Files modified or changed too recently are not stored ( @see CHECKSUM_CACHE_RACY_DELAY )
+ * @param key is a pointer to the key of the file, as it was before its digest was computed
+ * @param digest is a pointer to the HASH_MAX_DIGEST_SIZE bytes of the digest
+ * @return 0 in case of success or when the file is not stored, -1 else
+ */
+int checksum_cache_store(checksum_cache_key_t *key, uint8_t *digest) {
+    if (cache_fd == -1) {
+        return 0;
+    }
+    int64_t racy_limit_ns = ((int64_t) time(NULL) - CHECKSUM_CACHE_RACY_DELAY) * 1000000000;
+    if (key->mtime_ns > racy_limit_ns || key->ctime_ns > racy_limit_ns) {
+        return 0;
+    }
+    return append_record(key, digest);
+}
+
+/*!
+ * @brief checksum_cache_store_copy adds the digest of a file that the program has just written, such as a copy in the destination
+ * The racy delay is not applied: the ctime of a copy is always recent. The key is taken after the last change made
+ * by the program, so only a write by another program within the same timestamp tick would go unnoticed.
+ * @param key is a pointer to the key of the file, taken once its content, mode and times are set
+ * @param digest is a pointer to the HASH_MAX_DIGEST_SIZE bytes of the digest of the written data
+ * @return 0 in case of success, -1 else
+ */
+int checksum_cache_store_copy(checksum_cache_key_t *key, uint8_t *digest) {
+    if (cache_fd == -1) {
+        return 0;
+    }
+    return append_record(key, digest);
+}
+
+/*!
+ * @brief compact_cache rewrites the cache file with only the latest record of each file
+ * The new file is written aside, synced, then renamed over the old one, so a crash keeps either version.
+ * @return 0 in case of success, -1 else
+ */
+static int compact_cache(void) {
+    char temporary_path[PATH_SIZE + 16];
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%d", cache_file_path, (int) getpid());
+    FILE *compacted = fopen(temporary_path, "wb");
+    if (compacted == NULL) {
+        return -1;
+    }
+    bool is_ok = fwrite(CHECKSUM_CACHE_MAGIC, sizeof(CHECKSUM_CACHE_MAGIC), 1, compacted) == 1;
+    for (size_t i = 0; i < cache_capacity && is_ok; ++i) {
+        if (cache_table[i].key.inode != 0) {
+            is_ok = fwrite(&cache_table[i], sizeof(checksum_cache_record_t), 1, compacted) == 1;
+        }
+    }
+    is_ok = is_ok && fflush(compacted) == 0 && fsync(fileno(compacted)) == 0;
+    if (fclose(compacted) != 0 || !is_ok || rename(temporary_path, cache_file_path) == -1) {
+        unlink(temporary_path);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief close_checksum_cache closes the cache, compacting its file when it holds too many outdated records
+ * @param can_compact must only be true in the main process, once all the analyzers are done
+ */
+void close_checksum_cache(bool can_compact) {
+    if (cache_fd == -1) {
+        return;
+    }
+    // Relecture du fichier pour y retrouver les enregistrements ajoutés par les analyseurs
+    if (can_compact && load_records() == 0 && cache_records_in_file > 2 * cache_count + CHECKSUM_CACHE_INITIAL_CAPACITY) {
+        if (compact_cache() == -1) {
+            perror("Erreur lors du compactage du cache des empreintes");
+        }
+    }
+    close(cache_fd);
+    cache_fd = -1;
+    free(cache_table);
+    cache_table = NULL;
+    cache_capacity = 0;
+    cache_count = 0;
+}
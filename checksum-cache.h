@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <hash.h>
+#include <tree-hash.h>
+
+#define CHECKSUM_CACHE_MAGIC "LP25CKS2"
+// Start of the magic of all the versions of the cache file
+#define CHECKSUM_CACHE_MAGIC_PREFIX "LP25CKS"
+
+// A file is only cached when it has not been modified during the last seconds:
+// a change within the same timestamp tick would otherwise go unnoticed
+#define CHECKSUM_CACHE_RACY_DELAY 2
+
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+} checksum_cache_key_t;
+
+// On-disk record, appended in a single write() so that concurrent writers never interleave
+typedef struct {
+    checksum_cache_key_t key;
+    uint8_t digest[HASH_MAX_DIGEST_SIZE];
+    uint8_t algorithm; // hash_algorithm_t of the digest, a record of another algorithm is ignored
+    uint8_t tree_chunk_shift; // Chunks of the tree hash mode ( @see tree_hash_chunk_shift ), 0 for whole files
+    uint8_t padding[6];
+    uint64_t checksum; // FNV-1a of the fields above, detects torn or corrupted records
+} checksum_cache_record_t;
+
+void make_checksum_cache_key(struct stat *file_stat, checksum_cache_key_t *key);
+int open_checksum_cache(char *cache_path);
+bool checksum_cache_lookup(checksum_cache_key_t *key, uint8_t *digest);
+int checksum_cache_store(checksum_cache_key_t *key, uint8_t *digest);
+int checksum_cache_store_copy(checksum_cache_key_t *key, uint8_t *digest);
+void close_checksum_cache(bool can_compact);
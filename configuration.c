@@ -1,5 +1,6 @@
 
 #include <configuration.h>
+#include <tree-hash.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <getopt.h>
@@ -9,7 +10,7 @@
 
 
 
-typedef enum {DATE_SIZE_ONLY, NO_PARALLEL, DRY_RUN} long_opt_values;
+typedef enum {DATE_SIZE_ONLY = 256, NO_PARALLEL, DRY_RUN, CACHE_FILE, TRANSPORT, WORKERS, WALKERS, STREAMING, SMALL_COPIES, LARGE_COPIES, IO_URING, DELTA_THRESHOLD, HASH, VERIFY_COPY, TREE_HASH, WATCH, DEDUP, DETECT_MOVES, STATS, FULL_COMPARE} long_opt_values;
 
 
 typedef struct valgrind valgrind;
@@ -24,8 +25,25 @@ void display_help(char *my_name) {
     printf("Options: \t-n <processes count>\tnumber of processes for file calculations\n");
     printf("         \t-h display help (this text)\n");
     printf("         \t--date_size_only disables MD5 calculation for files\n");
+    printf("         \t--full-compare compares the contents of files whose size, mode and mtime are equal too (they are taken as identical by default)\n");
+    printf("         \t--hash=md5|crc32c|xxh64|blake2b selects the digest comparing the content of files (md5 by default)\n");
     printf("         \t--no-parallel disables parallel computing (cancels values of option -n)\n");
     printf("         \t--dry-run lists the changes that would need to be synchronized but doesn't perform them\n");
+    printf("         \t--cache-file <file> keeps the digests of unchanged files in <file> between runs\n");
+    printf("         \t--transport=mq|shm selects the SysV message queue (default) or shared memory rings between processes\n");
+    printf("         \t--workers=processes|threads runs listers and analyzers as processes (default) or as threads of a work-stealing pool\n");
+    printf("         \t--walkers <count> lists each tree with <count> threads (1 by default)\n");
+    printf("         \t--streaming compares and copies each directory as soon as it is listed on both sides (parallel processes only)\n");
+    printf("         \t--small-copies <count> copies small files with <count> threads (-n by default in parallel mode)\n");
+    printf("         \t--large-copies <count> copies files of 1 MiB or more with <count> threads (-n / 4 by default in parallel mode)\n");
+    printf("         \t--io-uring gets the stats and reads the files for digests with io_uring, when the kernel supports it\n");
+    printf("         \t--delta-threshold <size> updates modified files of <size> bytes or more (suffixes K, M, G) by rewriting only their changed blocks (disabled by default: whole copies are faster between local disks)\n");
+    printf("         \t--tree-hash <size> hashes files larger than <size> bytes (power of two, 1M or more) as trees of <size> chunks, shared by the -n threads, and rewrites only their changed chunks\n");
+    printf("         \t--verify-copy hashes each copied file while it is written and checks it against the digest of the source (unless --date-size-only)\n");
+    printf("         \t--dedup=reflink|hardlink gives files whose content is already in the destination a reflink or a hard link (same mode and mtime only) to it instead of a copy\n");
+    printf("         \t--detect-moves renames the files of the destination moved or renamed in the source (same inode, or same size and digest, or same size, mode and mtime with --date-size-only) instead of copying them again\n");
+    printf("         \t--watch synchronizes both trees, then only the directories changed in the source, until SIGINT or SIGTERM (inotify)\n");
+    printf("         \t--stats <file> writes the time of each phase and the counters of all the processes (entries, bytes hashed and copied, messages) to <file> as JSON\n");
     printf("         \t-v enables verbose mode\n");
 }
 
@@ -37,12 +55,60 @@ void display_help(char *my_name) {
 void init_configuration(configuration_t *the_config) { // Initialise les paramètres par défaut
     the_config->is_parallel = true;
     the_config->is_dry_run = false;
+    the_config->is_streaming = false;
     the_config->is_verbose = false;
     the_config->uses_md5 = true;
+    the_config->is_content_always_compared = false;
     the_config->processes_count = 1;
+    the_config->cache_path[0] = '\0';
+    the_config->stats_path[0] = '\0';
+    the_config->transport = TRANSPORT_MQ;
+    the_config->workers = WORKERS_PROCESSES;
+    the_config->walkers_count = 1;
+    the_config->small_copies_count = -1; // Valeurs déduites de -n une fois les options lues
+    the_config->large_copies_count = -1;
+    the_config->uses_io_uring = false;
+    the_config->delta_threshold = 0;
+    the_config->hash_algorithm = HASH_MD5;
+    the_config->is_copy_verified = false;
+    the_config->tree_chunk_size = 0;
+    the_config->is_watching = false;
+    the_config->is_detecting_moves = false;
+    the_config->dedup_mode = DEDUP_NONE;
 }
 
 
+/*!
+ * @brief parse_size reads a size in bytes, with an optional K, M or G suffix (powers of 1024)
+ * @param text is the size to read
+ * @param size is a pointer receiving the size
+ * @return 0 in case of success, -1 if the text is not a size
+ */
+static int parse_size(char *text, uint64_t *size) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || text[0] == '-') {
+        return -1;
+    }
+    switch (*end) {
+        case 'G': case 'g':
+            value *= 1024;
+            // fall through
+        case 'M': case 'm':
+            value *= 1024;
+            // fall through
+        case 'K': case 'k':
+            value *= 1024;
+            ++end;
+            break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *size = value;
+    return 0;
+}
+
 /*!
  * @brief set_configuration updates a configuration based on options and parameters passed to the program CLI
  * @param the_config is a pointer to the configuration to update
@@ -51,7 +117,7 @@ void init_configuration(configuration_t *the_config) { // Initialise les paramè
  * @return -1 if configuration cannot succeed, 0 when ok
  */
 int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
-    if (argc > 8 || argc < 3) { // Teste si le bon nombre d'arguments sont passés en paramètres
+    if (argc < 3) { // Teste si le bon nombre d'arguments sont passés en paramètres
         display_help("lp25-backup"); // Affichage de l'aide
         return -1; // Nombre d'argument incorrecte
     } else {
@@ -63,6 +129,23 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
                     {"date-size-only", no_argument, NULL, DATE_SIZE_ONLY}, // Option longue pour ne pas utiliser la sommme MD5
                     {"no-parallel", no_argument, NULL, NO_PARALLEL}, // Option longue pour ne pas utiliser de processus en parallèls
                     {"dry-run", no_argument, NULL, DRY_RUN}, // Option longue pour executer un test (pas de copie des fichiers)
+                    {"cache-file", required_argument, NULL, CACHE_FILE}, // Option longue pour conserver les sommes MD5 entre deux exécutions
+                    {"transport", required_argument, NULL, TRANSPORT}, // Option longue pour choisir la communication entre processus
+                    {"workers", required_argument, NULL, WORKERS}, // Option longue pour choisir entre processus et threads
+                    {"walkers", required_argument, NULL, WALKERS}, // Option longue pour lister les arborescences avec plusieurs threads
+                    {"streaming", no_argument, NULL, STREAMING}, // Option longue pour copier pendant que les listes se construisent
+                    {"small-copies", required_argument, NULL, SMALL_COPIES}, // Option longue pour le nombre de copies simultanées de petits fichiers
+                    {"large-copies", required_argument, NULL, LARGE_COPIES}, // Option longue pour le nombre de copies simultanées de gros fichiers
+                    {"io-uring", no_argument, NULL, IO_URING}, // Option longue pour garder plusieurs requêtes d'entrées/sorties en cours
+                    {"delta-threshold", required_argument, NULL, DELTA_THRESHOLD}, // Option longue pour la taille des fichiers mis à jour par différence
+                    {"full-compare", no_argument, NULL, FULL_COMPARE}, // Option longue pour comparer aussi le contenu des fichiers aux métadonnées égales
+                    {"hash", required_argument, NULL, HASH}, // Option longue pour choisir l'algorithme des empreintes
+                    {"verify-copy", no_argument, NULL, VERIFY_COPY}, // Option longue pour vérifier les copies avec l'empreinte de la source
+                    {"tree-hash", required_argument, NULL, TREE_HASH}, // Option longue pour hacher les gros fichiers par morceaux en parallèle
+                    {"dedup", required_argument, NULL, DEDUP}, // Option longue pour ne pas copier deux fois le même contenu
+                    {"detect-moves", no_argument, NULL, DETECT_MOVES}, // Option longue pour renommer les fichiers déplacés dans la source
+                    {"stats", required_argument, NULL, STATS}, // Option longue pour écrire les compteurs de l'exécution en JSON
+                    {"watch", no_argument, NULL, WATCH}, // Option longue pour synchroniser en continu les modifications de la source
                     {0, 0, 0, 0} // ligne obligatoire pour getopt_long
             };
 
@@ -83,9 +166,100 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
                     case DATE_SIZE_ONLY:
                         the_config->uses_md5 = false;
                         break;
+                    case FULL_COMPARE:
+                        the_config->is_content_always_compared = true;
+                        break;
                     case NO_PARALLEL:
                         the_config->is_parallel = false;
                         break;
+                    case CACHE_FILE:
+                        if (strlen(optarg) >= sizeof(the_config->cache_path)) {
+                            printf("Chemin du cache trop long\n");
+                            return -1;
+                        }
+                        strcpy(the_config->cache_path, optarg);
+                        break;
+                    case STATS:
+                        if (strlen(optarg) >= sizeof(the_config->stats_path)) {
+                            printf("Chemin du rapport trop long\n");
+                            return -1;
+                        }
+                        strcpy(the_config->stats_path, optarg);
+                        break;
+                    case TRANSPORT:
+                        if (strcmp(optarg, "mq") == 0) {
+                            the_config->transport = TRANSPORT_MQ;
+                        } else if (strcmp(optarg, "shm") == 0) {
+                            the_config->transport = TRANSPORT_SHM;
+                        } else {
+                            printf("Transport inconnu : %s (mq ou shm)\n", optarg);
+                            return -1;
+                        }
+                        break;
+                    case WORKERS:
+                        if (strcmp(optarg, "processes") == 0) {
+                            the_config->workers = WORKERS_PROCESSES;
+                        } else if (strcmp(optarg, "threads") == 0) {
+                            the_config->workers = WORKERS_THREADS;
+                        } else {
+                            printf("Mode inconnu : %s (processes ou threads)\n", optarg);
+                            return -1;
+                        }
+                        break;
+                    case WALKERS:
+                        the_config->walkers_count = atoi(optarg);
+                        break;
+                    case STREAMING:
+                        the_config->is_streaming = true;
+                        break;
+                    case SMALL_COPIES:
+                        the_config->small_copies_count = atoi(optarg);
+                        break;
+                    case LARGE_COPIES:
+                        the_config->large_copies_count = atoi(optarg);
+                        break;
+                    case IO_URING:
+                        the_config->uses_io_uring = true;
+                        break;
+                    case HASH:
+                        if (hash_algorithm_from_name(optarg, &the_config->hash_algorithm) == -1) {
+                            printf("Algorithme inconnu : %s (md5, crc32c, xxh64 ou blake2b)\n", optarg);
+                            return -1;
+                        }
+                        break;
+                    case VERIFY_COPY:
+                        the_config->is_copy_verified = true;
+                        break;
+                    case DEDUP:
+                        if (strcmp(optarg, "reflink") == 0) {
+                            the_config->dedup_mode = DEDUP_REFLINK;
+                        } else if (strcmp(optarg, "hardlink") == 0) {
+                            the_config->dedup_mode = DEDUP_HARDLINK;
+                        } else {
+                            printf("Deduplication inconnue : %s (reflink ou hardlink)\n", optarg);
+                            return -1;
+                        }
+                        break;
+                    case DETECT_MOVES:
+                        the_config->is_detecting_moves = true;
+                        break;
+                    case WATCH:
+                        the_config->is_watching = true;
+                        break;
+                    case TREE_HASH:
+                        //Puissance de deux : la taille des morceaux est gardée dans le cache sous forme d'exposant
+                        if (parse_size(optarg, &the_config->tree_chunk_size) == -1 || the_config->tree_chunk_size < TREE_HASH_MIN_CHUNK_SIZE
+                            || (the_config->tree_chunk_size & (the_config->tree_chunk_size - 1)) != 0) {
+                            printf("Taille de morceaux invalide : %s (puissance de deux, 1M au moins)\n", optarg);
+                            return -1;
+                        }
+                        break;
+                    case DELTA_THRESHOLD:
+                        if (parse_size(optarg, &the_config->delta_threshold) == -1) {
+                            printf("Taille invalide : %s\n", optarg);
+                            return -1;
+                        }
+                        break;
                     default: // Cas ou une des options ne correspond pas aux options possibles (getopt_long retourne quelque chose qui ne rentre dans aucun cas)
                         if (the_config->is_verbose == true) {
                             printf("Initialisation process failed\n");
@@ -95,6 +269,13 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
                 }
             }
         }
+        // Copies dans le thread principal sans parallélisme, sinon autant de petites copies que de processus
+        if (the_config->small_copies_count < 0) {
+            the_config->small_copies_count = the_config->is_parallel ? the_config->processes_count : 0;
+        }
+        if (the_config->large_copies_count < 0) {
+            the_config->large_copies_count = the_config->is_parallel ? (the_config->processes_count + 3) / 4 : 0;
+        }
         if (the_config->is_verbose == true) {
             printf("Initialisation process is a success\n");
 
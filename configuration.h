@@ -5,7 +5,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <hash.h>
 
+typedef enum {TRANSPORT_MQ, TRANSPORT_SHM} transport_t;
+typedef enum {WORKERS_PROCESSES, WORKERS_THREADS} workers_t;
+typedef enum {DEDUP_NONE, DEDUP_REFLINK, DEDUP_HARDLINK} dedup_mode_t;
 
 typedef struct {
     char source[1024];
@@ -13,8 +17,25 @@ typedef struct {
     uint8_t processes_count;
     bool is_parallel;
     bool uses_md5;
+    bool is_content_always_compared; // Files of equal size, mode and mtime are compared by content too, instead of being taken as identical
     bool is_verbose;
     bool is_dry_run;
+    bool is_streaming; // Compare and copy each directory as soon as both sides are listed
+    char cache_path[1024]; // Empty when the digests cache is disabled
+    char stats_path[1024]; // JSON report of the counters of all the processes ( @see stats.h ), empty when disabled
+    transport_t transport; // Between the processes, when parallel is enabled
+    workers_t workers; // Lister and analyzer roles run in forked processes or in threads
+    uint8_t walkers_count; // Threads listing each tree
+    int small_copies_count; // Threads copying small files, 0 to copy them in the main thread
+    int large_copies_count; // Threads copying large files ( @see COPY_LARGE_FILE_SIZE ), 0 to copy them in the main thread
+    uint64_t delta_threshold; // Modified files from this size on are updated by delta ( @see delta_copy ), 0 to disable
+    hash_algorithm_t hash_algorithm; // Digest of the files compared by content
+    bool uses_io_uring; // Stats and digest reads go through io_uring when the kernel supports it
+    bool is_copy_verified; // Copies are hashed while written and checked against the digest of the source
+    bool is_detecting_moves; // New files of the source found only elsewhere in the destination are renamed there instead of copied
+    dedup_mode_t dedup_mode; // Files whose content is already in the destination are reflinked or hard linked to it
+    bool is_watching; // After the first synchronization, the changes of the source are synchronized until SIGINT or SIGTERM
+    uint64_t tree_chunk_size; // Larger files are hashed by chunks of this size ( @see tree-hash.h ), 0 to hash them whole
 } configuration_t;
 
 
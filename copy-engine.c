@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+#include <copy-engine.h>
+#include <tree-hash.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+// Functions in this file copy the content of a file with the cheapest mechanism available:
+// - a reflink (FICLONE), which only shares the blocks on filesystems that support it (btrfs, XFS...);
+// - copy_file_range, which stays in the kernel and may be offloaded by the filesystem (NFS, SMB...);
+// - sendfile, which stays in the kernel too;
+// - a read/write loop, which always works.
+// Each mechanism continues from where the previous one stopped, and all of them loop until the end
+// of the source: a single call may copy less than asked (sendfile stops at about 2 GB).
+// A copy which must also give the digest of the data goes through the read/write loop only, the
+// bytes being hashed in the buffer between the read and the write.
+
+static uint64_t method_counts[COPY_METHODS_COUNT];
+static bool is_copy_file_range_missing = false; // Kernel without the system call
+
+/*!
+ * @brief is_unsupported tells if an error means that a mechanism cannot be used for these files
+ * @param error is the errno value of the failed call
+ * @return true if the next mechanism must be tried, false for a real error
+ */
+static bool is_unsupported(int error) {
+    return error == EXDEV || error == EOPNOTSUPP || error == ENOTSUP || error == EINVAL || error == ENOSYS
+           || error == ENOTTY || error == EBADF || error == ETXTBSY || error == EPERM;
+}
+
+/*!
+ * @brief copy_with_copy_file_range copies the rest of a file with copy_file_range
+ * Some filesystems (procfs, sysfs, some FUSE ones...) make copy_file_range return 0 before the end of the
+ * source: the mechanism is then reported as unsupported, and the next one continues the copy.
+ * @param source_fd is the descriptor of the source
+ * @param destination_fd is the descriptor of the destination
+ * @param offset is a pointer to the position of the copy in both files, updated as bytes are copied
+ * @return 0 at the end of the source, -1 else (errno is set)
+ */
+static int copy_with_copy_file_range(int source_fd, int destination_fd, off_t *offset) {
+    struct stat source_stat;
+    if (fstat(source_fd, &source_stat) == -1) {
+        return -1;
+    }
+    while (true) {
+        loff_t source_offset = *offset;
+        loff_t destination_offset = *offset;
+        ssize_t copied = copy_file_range(source_fd, &source_offset, destination_fd, &destination_offset, COPY_CHUNK_SIZE, 0);
+        if (copied == 0) {
+            if (*offset < source_stat.st_size) { // Rien copié avant la fin : le mécanisme suivant reprend ici
+                errno = EOPNOTSUPP;
+                return -1;
+            }
+            return 0;
+        }
+        if (copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        *offset += copied;
+    }
+}
+
+/*!
+ * @brief copy_with_sendfile copies the rest of a file with sendfile
+ * @param source_fd is the descriptor of the source
+ * @param destination_fd is the descriptor of the destination, positioned at offset
+ * @param offset is a pointer to the position of the copy in both files, updated as bytes are copied
+ * @return 0 at the end of the source, -1 else (errno is set)
+ */
+static int copy_with_sendfile(int source_fd, int destination_fd, off_t *offset) {
+    if (lseek(destination_fd, *offset, SEEK_SET) == -1) {
+        return -1;
+    }
+    while (true) {
+        ssize_t copied = sendfile(destination_fd, source_fd, offset, COPY_CHUNK_SIZE); // Avance offset
+        if (copied == 0) {
+            return 0;
+        }
+        if (copied == -1 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+/*!
+ * @brief copy_with_read_write copies the rest of a file through a buffer
+ * @param source_fd is the descriptor of the source
+ * @param destination_fd is the descriptor of the destination
+ * @param offset is a pointer to the position of the copy in both files, updated as bytes are copied
+ * @param context is a pointer to the digest receiving the copied bytes, NULL to copy without hashing
+ * @return 0 at the end of the source, -1 else (errno is set)
+ */
+static int copy_with_read_write(int source_fd, int destination_fd, off_t *offset, tree_hash_context_t *context) {
+    static __thread char buffer[COPY_BUFFER_SIZE]; // Un tampon par thread de copie
+    while (true) {
+        ssize_t read_size = pread(source_fd, buffer, sizeof(buffer), *offset);
+        if (read_size == 0) {
+            return 0;
+        }
+        if (read_size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (context != NULL && tree_hash_update(context, buffer, read_size) == -1) {
+            errno = ENOMEM;
+            return -1;
+        }
+        for (ssize_t written = 0; written < read_size;) {
+            ssize_t write_size = pwrite(destination_fd, buffer + written, read_size - written, *offset + written);
+            if (write_size == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            written += write_size;
+        }
+        *offset += read_size;
+    }
+}
+
+/*!
+ * @brief copy_file_contents copies all the content of a file into an empty destination file
+ * The mechanisms are tried from the cheapest one ( @see copy_method_t ); the one which finished the copy is counted.
+ * @param source_fd is the descriptor of the source, opened for reading
+ * @param destination_fd is the descriptor of the destination, opened for writing and empty
+ * @param method is a pointer receiving the mechanism which finished the copy, may be NULL
+ * @return 0 in case of success, -1 else (errno is set)
+ */
+int copy_file_contents(int source_fd, int destination_fd, copy_method_t *method) {
+    off_t offset = 0;
+    copy_method_t used_method = COPY_METHOD_REFLINK;
+    int result = ioctl(destination_fd, FICLONE, source_fd);
+
+    if (result == -1 && is_unsupported(errno)) {
+        used_method = COPY_METHOD_COPY_FILE_RANGE;
+        result = -1;
+        errno = ENOSYS;
+        if (!is_copy_file_range_missing) {
+            result = copy_with_copy_file_range(source_fd, destination_fd, &offset);
+            if (result == -1 && errno == ENOSYS) {
+                is_copy_file_range_missing = true;
+            }
+        }
+    }
+    if (result == -1 && is_unsupported(errno)) {
+        used_method = COPY_METHOD_SENDFILE;
+        result = copy_with_sendfile(source_fd, destination_fd, &offset);
+    }
+    if (result == -1 && is_unsupported(errno)) {
+        used_method = COPY_METHOD_READ_WRITE;
+        result = copy_with_read_write(source_fd, destination_fd, &offset, NULL);
+    }
+    if (result == -1) {
+        return -1;
+    }
+
+    __atomic_add_fetch(&method_counts[used_method], 1, __ATOMIC_RELAXED);
+    if (method != NULL) {
+        *method = used_method;
+    }
+    return 0;
+}
+
+/*!
+ * @brief copy_file_contents_hashed copies all the content of a file into an empty destination file and hashes it in the same pass
+ * The source is read only once, so the digest is the one of the bytes written, with the current algorithm and tree hash mode.
+ * @param source_fd is the descriptor of the source, opened for reading
+ * @param destination_fd is the descriptor of the destination, opened for writing and empty
+ * @param digest receives the HASH_MAX_DIGEST_SIZE bytes of the digest of the copied data
+ * @return 0 in case of success, -1 else (errno is set)
+ */
+int copy_file_contents_hashed(int source_fd, int destination_fd, uint8_t digest[HASH_MAX_DIGEST_SIZE]) {
+    tree_hash_context_t context;
+    off_t offset = 0;
+    if (tree_hash_init(&context) == -1) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int result = copy_with_read_write(source_fd, destination_fd, &offset, &context);
+    free_chunk_digests(tree_hash_final(&context, digest)); // Libère aussi le contexte en cas d'erreur
+    if (result == -1) {
+        return -1;
+    }
+    __atomic_add_fetch(&method_counts[COPY_METHOD_READ_WRITE], 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*!
+ * @brief copy_file_part copies a range of a file to a position of another file
+ * copy_file_range is tried first (it may share the blocks on filesystems with reflinks), then a read/write loop.
+ * @param source_fd is the descriptor of the source, opened for reading
+ * @param source_offset is the position of the range in the source
+ * @param destination_fd is the descriptor of the destination, opened for writing
+ * @param destination_offset is the position of the copy in the destination
+ * @param length is the size of the range
+ * @return 0 in case of success, -1 else (errno is set, EIO if the source ends before the range)
+ */
+int copy_file_part(int source_fd, off_t source_offset, int destination_fd, off_t destination_offset, uint64_t length) {
+    static __thread char buffer[COPY_BUFFER_SIZE];
+    bool uses_copy_file_range = !is_copy_file_range_missing;
+    while (length > 0) {
+        ssize_t copied = -1;
+        if (uses_copy_file_range) {
+            loff_t from = source_offset;
+            loff_t to = destination_offset;
+            copied = copy_file_range(source_fd, &from, destination_fd, &to, (length < COPY_CHUNK_SIZE) ? length : COPY_CHUNK_SIZE, 0);
+            if (copied == -1 && is_unsupported(errno)) {
+                uses_copy_file_range = false;
+                continue;
+            }
+        } else {
+            copied = pread(source_fd, buffer, (length < sizeof(buffer)) ? length : sizeof(buffer), source_offset);
+            for (ssize_t written = 0; written < copied;) {
+                ssize_t write_size = pwrite(destination_fd, buffer + written, copied - written, destination_offset + written);
+                if (write_size == -1 && errno != EINTR) {
+                    return -1;
+                }
+                written += (write_size > 0) ? write_size : 0;
+            }
+        }
+        if (copied == 0) {
+            errno = EIO; // La source est plus courte que prévu
+            return -1;
+        }
+        if (copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        source_offset += copied;
+        destination_offset += copied;
+        length -= copied;
+    }
+    return 0;
+}
+
+/*!
+ * @brief copy_method_name gives the name of a copy mechanism, for the reports
+ * @param method is the mechanism
+ * @return its name
+ */
+const char *copy_method_name(copy_method_t method) {
+    switch (method) {
+        case COPY_METHOD_REFLINK:
+            return "reflink";
+        case COPY_METHOD_COPY_FILE_RANGE:
+            return "copy_file_range";
+        case COPY_METHOD_SENDFILE:
+            return "sendfile";
+        case COPY_METHOD_READ_WRITE:
+            return "read/write";
+        default:
+            return "?";
+    }
+}
+
+/*!
+ * @brief get_copy_method_counts gives the number of files copied with each mechanism since the start
+ * @param counts is an array receiving the counts, indexed by copy_method_t
+ */
+void get_copy_method_counts(uint64_t counts[COPY_METHODS_COUNT]) {
+    for (int i = 0; i < COPY_METHODS_COUNT; ++i) {
+        counts[i] = __atomic_load_n(&method_counts[i], __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <hash.h>
+
+typedef enum {
+    COPY_METHOD_REFLINK, // FICLONE: the destination shares the blocks of the source
+    COPY_METHOD_COPY_FILE_RANGE,
+    COPY_METHOD_SENDFILE,
+    COPY_METHOD_READ_WRITE,
+    COPY_METHODS_COUNT
+} copy_method_t;
+
+// Bytes asked to copy_file_range and sendfile at each call
+#define COPY_CHUNK_SIZE (64 * 1024 * 1024)
+// Buffer of the read/write loop
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+int copy_file_contents(int source_fd, int destination_fd, copy_method_t *method);
+int copy_file_contents_hashed(int source_fd, int destination_fd, uint8_t digest[HASH_MAX_DIGEST_SIZE]);
+int copy_file_part(int source_fd, off_t source_offset, int destination_fd, off_t destination_offset, uint64_t length);
+const char *copy_method_name(copy_method_t method);
+void get_copy_method_counts(uint64_t counts[COPY_METHODS_COUNT]);
@@ -0,0 +1,126 @@
+#include <copy-pool.h>
+#include <thread-pool.h>
+#include <sync.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Functions in this file spread the copies of files over worker threads.
+// Small and large files go to two separate pools, whose numbers of threads are the limits of
+// concurrent copies of each kind: many small copies keep the disks busy with metadata operations,
+// while a few large ones are enough to saturate their bandwidth.
+// Directories are not copied here: they are created by the caller, in the order of the list, before
+// the files they contain are submitted.
+
+typedef struct {
+    configuration_t *the_config;
+    files_list_entry_t entry; // A copy: the list may be cleared before the copy is done
+    char path[]; // Path of the entry, entry.path_and_name points to it
+} copy_task_t;
+
+static thread_pool_t small_copies_pool;
+static thread_pool_t large_copies_pool;
+static bool is_small_pool_started = false;
+static bool is_large_pool_started = false;
+static copy_pool_summary_t counters;
+
+/*!
+ * @brief count_copy adds a copied file to the counters (from any thread)
+ * @param source_entry is a pointer to the copied entry
+ */
+static void count_copy(files_list_entry_t *source_entry) {
+    __atomic_add_fetch((source_entry->size >= COPY_LARGE_FILE_SIZE) ? &counters.large_copies : &counters.small_copies, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters.copied_bytes, source_entry->size, __ATOMIC_RELAXED);
+}
+
+/*!
+ * @brief copy_task copies a file to the destination, then frees its task
+ * @param argument is a pointer to the copy_task_t
+ */
+static void copy_task(void *argument) {
+    copy_task_t *task = (copy_task_t *) argument;
+    copy_entry_to_destination(&task->entry, task->the_config);
+    count_copy(&task->entry);
+    free_chunk_digests(task->entry.chunks);
+    free(task);
+}
+
+/*!
+ * @brief init_copy_pool starts the copy threads, when copies are not done in the main thread
+ * @param the_config is a pointer to the configuration (small_copies_count and large_copies_count)
+ * @return 0 in case of success, -1 else (copies are then done in the main thread)
+ */
+int init_copy_pool(configuration_t *the_config) {
+    memset(&counters, 0, sizeof(counters));
+    if (the_config->is_dry_run) {
+        return 0;
+    }
+    if (the_config->small_copies_count > 0) {
+        is_small_pool_started = (init_thread_pool(&small_copies_pool, the_config->small_copies_count) == 0);
+    }
+    if (the_config->large_copies_count > 0) {
+        is_large_pool_started = (init_thread_pool(&large_copies_pool, the_config->large_copies_count) == 0);
+    }
+    if ((the_config->small_copies_count > 0 && !is_small_pool_started) || (the_config->large_copies_count > 0 && !is_large_pool_started)) {
+        printf("Impossible de creer les threads de copie, les fichiers seront copies un par un\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief submit_copy copies an entry to the destination, with a copy thread for files when they are enabled
+ * Directories are always created right away, so that their files can be copied in them afterwards.
+ * @param source_entry is a pointer to the entry to copy
+ * @param the_config is a pointer to the configuration
+ */
+void submit_copy(files_list_entry_t *source_entry, configuration_t *the_config) {
+    bool is_large = source_entry->size >= COPY_LARGE_FILE_SIZE;
+    thread_pool_t *pool = NULL;
+    if (source_entry->entry_type == FICHIER) {
+        if (is_large && is_large_pool_started) {
+            pool = &large_copies_pool;
+        } else if (!is_large && is_small_pool_started) {
+            pool = &small_copies_pool;
+        }
+    }
+
+    copy_task_t *task = (pool != NULL) ? malloc(sizeof(copy_task_t) + source_entry->path_length + 1) : NULL;
+    if (task == NULL) {
+        copy_entry_to_destination(source_entry, the_config);
+        if (source_entry->entry_type == FICHIER) {
+            count_copy(source_entry);
+        }
+        return;
+    }
+    task->the_config = the_config;
+    task->entry = *source_entry;
+    memcpy(task->path, source_entry->path_and_name, source_entry->path_length + 1);
+    task->entry.path_and_name = task->path;
+    task->entry.next = NULL;
+    task->entry.prev = NULL;
+    task->entry.chunks = copy_chunk_digests(source_entry->chunks); // Sans eux, la copie est simplement complète
+    if (submit_task(pool, copy_task, task) == -1) {
+        copy_task(task);
+    }
+}
+
+/*!
+ * @brief finish_copy_pool waits for all the submitted copies, then stops the copy threads
+ * @param summary is a pointer to the counters of the copies, may be NULL
+ */
+void finish_copy_pool(copy_pool_summary_t *summary) {
+    if (is_small_pool_started) {
+        wait_thread_pool(&small_copies_pool);
+        destroy_thread_pool(&small_copies_pool);
+        is_small_pool_started = false;
+    }
+    if (is_large_pool_started) {
+        wait_thread_pool(&large_copies_pool);
+        destroy_thread_pool(&large_copies_pool);
+        is_large_pool_started = false;
+    }
+    if (summary != NULL) {
+        *summary = counters;
+    }
+}
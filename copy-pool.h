@@ -0,0 +1,18 @@
+#pragma once
+
+#include <configuration.h>
+#include <files-list.h>
+#include <stdint.h>
+
+// Files from this size on are copied by the large copies pool
+#define COPY_LARGE_FILE_SIZE (1024 * 1024)
+
+typedef struct {
+    uint64_t small_copies;
+    uint64_t large_copies;
+    uint64_t copied_bytes;
+} copy_pool_summary_t;
+
+int init_copy_pool(configuration_t *the_config);
+void submit_copy(files_list_entry_t *source_entry, configuration_t *the_config);
+void finish_copy_pool(copy_pool_summary_t *summary);
@@ -0,0 +1,351 @@
+#include <dedup.h>
+#include <sync.h>
+#include <diff.h>
+#include <copy-pool.h>
+#include <copy-engine.h>
+#include <defines.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file do not copy a file whose content is already in the destination.
+// With --dedup, the files to copy are set aside by the comparison, as well as the destination files that
+// are already up to date (or only in the destination): their content is there. Once the comparison is
+// over, the candidates are grouped by size, and only the groups of several files with a file to copy
+// are hashed ( @see compute_digests_on_demand ). In a group of the same digest, the first file already
+// in the destination (else the first file to copy, which is copied) is the target of the others.
+// After the copies, the bytes of each file and of its target are compared, so that a collision of the
+// digests never gives a wrong content; the file is then a hard link to the target (when its mode and
+// mtime are the same: they are shared by the names of an inode), or a reflink of it. Without reflink
+// support, the file is copied from the target, in the destination file system.
+// The functions are called by the main thread only ( @see apply_difference ).
+
+typedef struct {
+    files_list_entry_t entry; // Source entry to copy, or entry with the content and metadata of a destination file
+    char *destination_path;
+    bool is_in_destination; // The content is already in the destination file, else the file must be copied
+    bool is_copied; // Target of other files, or file without duplicate: copied as usual
+    long target; // Index of the candidate of the same content, -1 if none
+} dedup_candidate_t;
+
+static dedup_candidate_t *candidates = NULL;
+static size_t candidates_count = 0;
+static size_t candidates_capacity = 0;
+
+/*!
+ * @brief add_candidate sets a file aside for the deduplication
+ * @param content_entry is a pointer to the entry of the file
+ * @param destination_path is its path in the destination
+ * @param is_in_destination tells if the destination file already has this content
+ * @return true if the file was set aside, false else (out of memory)
+ */
+static bool add_candidate(files_list_entry_t *content_entry, char *destination_path, bool is_in_destination) {
+    if (candidates_count == candidates_capacity) {
+        size_t new_capacity = (candidates_capacity == 0) ? 256 : candidates_capacity * 2;
+        dedup_candidate_t *new_candidates = realloc(candidates, new_capacity * sizeof(dedup_candidate_t));
+        if (new_candidates == NULL) {
+            return false;
+        }
+        candidates = new_candidates;
+        candidates_capacity = new_capacity;
+    }
+    dedup_candidate_t *candidate = &candidates[candidates_count];
+    candidate->entry = *content_entry;
+    candidate->entry.path_and_name = strdup(content_entry->path_and_name);
+    candidate->entry.chunks = is_in_destination ? NULL : copy_chunk_digests(content_entry->chunks);
+    candidate->entry.next = NULL;
+    candidate->entry.prev = NULL;
+    candidate->destination_path = strdup(destination_path);
+    candidate->is_in_destination = is_in_destination;
+    candidate->is_copied = false;
+    candidate->target = -1;
+    if (candidate->entry.path_and_name == NULL || candidate->destination_path == NULL) {
+        free(candidate->entry.path_and_name);
+        free(candidate->destination_path);
+        free_chunk_digests(candidate->entry.chunks);
+        return false;
+    }
+    ++candidates_count;
+    return true;
+}
+
+/*!
+ * @brief defer_dedup_copy sets a file to copy aside, until the end of the comparison tells if its content is already in the destination
+ * @param source_entry is a pointer to the source entry
+ * @param destination_path is its path in the destination
+ * @param the_config is a pointer to the configuration
+ * @return true if the file is set aside ( @see submit_dedup_copies ), false if it must be copied now
+ */
+bool defer_dedup_copy(files_list_entry_t *source_entry, char *destination_path, configuration_t *the_config) {
+    if (the_config->dedup_mode == DEDUP_NONE || source_entry->entry_type != FICHIER || source_entry->size == 0) {
+        return false;
+    }
+    return add_candidate(source_entry, destination_path, false);
+}
+
+/*!
+ * @brief note_dedup_content records a destination file whose content is known, so that files of the same content are linked to it
+ * @param content_entry is a pointer to an entry with its content and the metadata it will have (its source when they are the same)
+ * @param destination_path is the path of the destination file
+ * @param the_config is a pointer to the configuration
+ */
+void note_dedup_content(files_list_entry_t *content_entry, char *destination_path, configuration_t *the_config) {
+    if (the_config->dedup_mode != DEDUP_NONE && content_entry->entry_type == FICHIER && content_entry->size > 0) {
+        add_candidate(content_entry, destination_path, true);
+    }
+}
+
+/*!
+ * @brief compare_candidates orders the candidates by size, then by digest (the ones without digest last), files already in the destination first
+ * @param left is a pointer to a pointer to a candidate
+ * @param right is a pointer to a pointer to a candidate
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_candidates(const void *left, const void *right) {
+    const dedup_candidate_t *left_candidate = *(dedup_candidate_t * const *) left;
+    const dedup_candidate_t *right_candidate = *(dedup_candidate_t * const *) right;
+    if (left_candidate->entry.size != right_candidate->entry.size) {
+        return (left_candidate->entry.size < right_candidate->entry.size) ? -1 : 1;
+    }
+    bool left_has_digest = (left_candidate->entry.digest_flags & ENTRY_HAS_DIGEST) != 0;
+    bool right_has_digest = (right_candidate->entry.digest_flags & ENTRY_HAS_DIGEST) != 0;
+    if (left_has_digest != right_has_digest) {
+        return left_has_digest ? -1 : 1;
+    }
+    int digests_order = left_has_digest ? memcmp(left_candidate->entry.digest, right_candidate->entry.digest, HASH_MAX_DIGEST_SIZE) : 0;
+    if (digests_order != 0) {
+        return digests_order;
+    }
+    return (int) right_candidate->is_in_destination - (int) left_candidate->is_in_destination;
+}
+
+/*!
+ * @brief hash_size_groups computes the digests of the candidates of the groups of the same size that hold a file to copy and another file
+ * @param sorted is the array of pointers to the candidates, sorted by size
+ */
+static void hash_size_groups(dedup_candidate_t **sorted) {
+    files_list_entry_t **entries = malloc(candidates_count * sizeof(files_list_entry_t *));
+    size_t entries_count = 0;
+    if (entries == NULL) {
+        return;
+    }
+    for (size_t start = 0, end = 0; start < candidates_count; start = end) {
+        bool has_copy = false;
+        for (end = start; end < candidates_count && sorted[end]->entry.size == sorted[start]->entry.size; ++end) {
+            has_copy = has_copy || !sorted[end]->is_in_destination;
+        }
+        for (size_t i = start; has_copy && end - start > 1 && i < end; ++i) {
+            if (!(sorted[i]->entry.digest_flags & ENTRY_HAS_DIGEST)) {
+                entries[entries_count++] = &sorted[i]->entry;
+            }
+        }
+    }
+    //Les fichiers de la destination sont lus à leur chemin dans la destination
+    for (size_t i = 0; i < candidates_count; ++i) {
+        if (sorted[i]->is_in_destination) {
+            char *destination_path = sorted[i]->destination_path;
+            sorted[i]->destination_path = sorted[i]->entry.path_and_name;
+            sorted[i]->entry.path_and_name = destination_path;
+        }
+    }
+    compute_digests_on_demand(entries, entries_count);
+    for (size_t i = 0; i < candidates_count; ++i) {
+        if (sorted[i]->is_in_destination) {
+            char *destination_path = sorted[i]->entry.path_and_name;
+            sorted[i]->entry.path_and_name = sorted[i]->destination_path;
+            sorted[i]->destination_path = destination_path;
+        }
+    }
+    free(entries);
+}
+
+/*!
+ * @brief submit_dedup_copies finds the files set aside whose content is in another one, and copies the others
+ * It must be called once the comparison is over, before the copies are finished ( @see finish_copy_pool ).
+ * @param the_config is a pointer to the configuration
+ */
+void submit_dedup_copies(configuration_t *the_config) {
+    dedup_candidate_t **sorted = (candidates_count > 0) ? malloc(candidates_count * sizeof(dedup_candidate_t *)) : NULL;
+    for (size_t i = 0; sorted != NULL && i < candidates_count; ++i) {
+        sorted[i] = &candidates[i];
+    }
+    if (sorted != NULL) {
+        qsort(sorted, candidates_count, sizeof(dedup_candidate_t *), compare_candidates);
+        hash_size_groups(sorted);
+        qsort(sorted, candidates_count, sizeof(dedup_candidate_t *), compare_candidates);
+
+        //Premier fichier de chaque contenu (celui de la destination s'il y en a un) : cible des suivants
+        for (size_t i = 0; i < candidates_count; ++i) {
+            dedup_candidate_t *first = (i > 0) ? sorted[i - 1] : NULL;
+            if (first != NULL && first->target != -1) {
+                first = &candidates[first->target];
+            }
+            if (first != NULL && (sorted[i]->entry.digest_flags & ENTRY_HAS_DIGEST) && (first->entry.digest_flags & ENTRY_HAS_DIGEST)
+                && first->entry.size == sorted[i]->entry.size && memcmp(first->entry.digest, sorted[i]->entry.digest, HASH_MAX_DIGEST_SIZE) == 0) {
+                sorted[i]->target = first - candidates;
+            }
+        }
+        free(sorted);
+    }
+
+    for (size_t i = 0; i < candidates_count; ++i) {
+        if (!candidates[i].is_in_destination && candidates[i].target == -1) {
+            candidates[i].is_copied = true;
+            submit_copy(&candidates[i].entry, the_config);
+        }
+    }
+}
+
+/*!
+ * @brief read_whole reads up to a number of bytes, unless the end of the file is reached
+ * @param fd is the descriptor of the file
+ * @param buffer receives the data
+ * @param length is the number of bytes to read
+ * @return the number of bytes read, -1 in case of error
+ */
+static ssize_t read_whole(int fd, uint8_t *buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t read_bytes = read(fd, buffer + done, length - done);
+        if (read_bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read_bytes == -1) {
+            return -1;
+        }
+        if (read_bytes == 0) {
+            break;
+        }
+        done += read_bytes;
+    }
+    return done;
+}
+
+/*!
+ * @brief have_same_content compares two files byte by byte
+ * @param first_path is the path of a file
+ * @param second_path is the path of the other file
+ * @return true if both files could be read and have the same content, false else
+ */
+static bool have_same_content(char *first_path, char *second_path) {
+    static uint8_t first_buffer[COPY_BUFFER_SIZE];
+    static uint8_t second_buffer[COPY_BUFFER_SIZE];
+    int first_fd = open(first_path, O_RDONLY);
+    int second_fd = open(second_path, O_RDONLY);
+    bool is_same = (first_fd != -1 && second_fd != -1);
+    while (is_same) {
+        ssize_t first_length = read_whole(first_fd, first_buffer, sizeof(first_buffer));
+        ssize_t second_length = read_whole(second_fd, second_buffer, sizeof(second_buffer));
+        is_same = first_length != -1 && first_length == second_length && memcmp(first_buffer, second_buffer, first_length) == 0;
+        if (first_length <= 0) {
+            break;
+        }
+    }
+    if (first_fd != -1) {
+        close(first_fd);
+    }
+    if (second_fd != -1) {
+        close(second_fd);
+    }
+    return is_same;
+}
+
+/*!
+ * @brief copy_from_target writes a file from a destination file of the same content, with a reflink when the file system supports it
+ * The file is written as a new inode, so that the other names of the old one keep their content.
+ * @param candidate is a pointer to the file to write
+ * @param target is a pointer to the destination file of the same content
+ * @param method receives the copy method used
+ * @return 0 in case of success, -1 else
+ */
+static int copy_from_target(dedup_candidate_t *candidate, dedup_candidate_t *target, copy_method_t *method) {
+    int target_fd = open(target->destination_path, O_RDONLY);
+    if (target_fd == -1) {
+        return -1;
+    }
+    //L'ancien fichier est retiré plutôt que vidé : il peut avoir d'autres noms dans la destination, la cible comprise
+    int destination_fd = -1;
+    if (unlink(candidate->destination_path) == 0 || errno == ENOENT) {
+        destination_fd = open(candidate->destination_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    }
+    int result = (destination_fd == -1) ? -1 : copy_file_contents(target_fd, destination_fd, method);
+    if (destination_fd != -1 && close(destination_fd) == -1) {
+        result = -1;
+    }
+    close(target_fd);
+    return result;
+}
+
+/*!
+ * @brief link_dedup_copies gives each file set aside whose content is in the destination a link to it, then forgets the candidates
+ * It must be called once all the copies are done ( @see finish_copy_pool ). A file whose content differs
+ * from its target despite the same digest, or whose link fails, is copied as usual.
+ * @param the_config is a pointer to the configuration
+ * @param summary is a pointer to the counters of the deduplication, may be NULL
+ */
+void link_dedup_copies(configuration_t *the_config, dedup_summary_t *summary) {
+    dedup_summary_t counters = {0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < candidates_count; ++i) {
+        dedup_candidate_t *candidate = &candidates[i];
+        if (candidate->is_in_destination) {
+            continue;
+        }
+        counters.candidate_bytes += candidate->entry.size;
+        if (candidate->is_copied) {
+            continue;
+        }
+        dedup_candidate_t *target = &candidates[candidate->target];
+        if (!have_same_content(candidate->entry.path_and_name, target->destination_path)) {
+            ++counters.collisions;
+            copy_entry_to_destination(&candidate->entry, the_config);
+            continue;
+        }
+
+        //Lien physique seulement si les métadonnées, communes aux noms d'un inode, sont les mêmes
+        bool is_linked = false;
+        if (the_config->dedup_mode == DEDUP_HARDLINK && candidate->entry.mode == target->entry.mode
+            && candidate->entry.mtime.tv_sec == target->entry.mtime.tv_sec && candidate->entry.mtime.tv_nsec == target->entry.mtime.tv_nsec
+            && (unlink(candidate->destination_path) == 0 || errno == ENOENT) && link(target->destination_path, candidate->destination_path) == 0) {
+            is_linked = true;
+            ++counters.linked_files;
+            counters.shared_bytes += candidate->entry.size;
+        }
+        copy_method_t method;
+        if (!is_linked && copy_from_target(candidate, target, &method) == -1) {
+            copy_entry_to_destination(&candidate->entry, the_config);
+            continue;
+        }
+        if (!is_linked) {
+            set_destination_metadata(candidate->destination_path, &candidate->entry);
+            if (method == COPY_METHOD_REFLINK) {
+                ++counters.reflinked_files;
+                counters.shared_bytes += candidate->entry.size;
+            } else {
+                ++counters.local_copies;
+            }
+        }
+        if (candidate->entry.digest_flags & ENTRY_HAS_DIGEST) {
+            store_destination_digest(candidate->destination_path, candidate->entry.digest);
+        }
+        if (the_config->is_verbose) {
+            printf("Deduplication de %s : %s de %s\n", candidate->entry.path_and_name,
+                   is_linked ? "lien" : (method == COPY_METHOD_REFLINK) ? "reflink" : "copie locale", target->destination_path);
+        }
+    }
+
+    for (size_t i = 0; i < candidates_count; ++i) {
+        free(candidates[i].entry.path_and_name);
+        free(candidates[i].destination_path);
+        free_chunk_digests(candidates[i].entry.chunks);
+    }
+    free(candidates);
+    candidates = NULL;
+    candidates_count = 0;
+    candidates_capacity = 0;
+    if (summary != NULL) {
+        *summary = counters;
+    }
+}
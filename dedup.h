@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <files-list.h>
+#include <configuration.h>
+
+typedef struct {
+    uint64_t candidate_bytes; // Bytes of the files to copy that went through the deduplication
+    uint64_t linked_files; // Files hard linked to a file of the same content
+    uint64_t reflinked_files; // Files sharing the blocks of a file of the same content
+    uint64_t local_copies; // Files copied from a file of the same content in the destination (no reflink)
+    uint64_t shared_bytes; // Bytes not written thanks to the links and reflinks
+    uint64_t collisions; // Files of the same digest but of different contents, copied
+} dedup_summary_t;
+
+bool defer_dedup_copy(files_list_entry_t *source_entry, char *destination_path, configuration_t *the_config);
+void note_dedup_content(files_list_entry_t *content_entry, char *destination_path, configuration_t *the_config);
+void submit_dedup_copies(configuration_t *the_config);
+void link_dedup_copies(configuration_t *the_config, dedup_summary_t *summary);
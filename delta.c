@@ -0,0 +1,465 @@
+#define _GNU_SOURCE
+#include <delta.h>
+#include <copy-engine.h>
+#include <defines.h>
+#include <openssl/evp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Functions in this file update a large modified file in the style of rsync: the previous destination
+// file is cut in blocks, whose weak (rolling) and strong (MD5) checksums are indexed. The source is then
+// scanned with a window of one block, moved byte by byte until its weak checksum, then its strong one,
+// match a destination block. Matching blocks are kept from the destination, only the other ranges
+// are copied from the source.
+// When each kept block is at the same position in both files (a file modified in place), the changed
+// ranges are rewritten directly in the destination. Otherwise, the new file is assembled in a temporary
+// file which then replaces the destination.
+
+typedef struct {
+    uint32_t weak;
+    uint8_t strong[16];
+} block_signature_t;
+
+typedef struct {
+    uint64_t block_size;
+    size_t count; // Full blocks of the destination, its last partial block is never reused
+    block_signature_t *blocks;
+    int64_t *heads; // First block of each bucket of weak checksums, -1 if empty
+    int64_t *next; // Next block of the same bucket
+    int bucket_bits;
+} signatures_t;
+
+typedef struct {
+    uint64_t source_offset;
+    uint64_t length;
+    int64_t destination_offset; // -1 for a range taken from the source
+} delta_op_t;
+
+typedef struct {
+    delta_op_t *ops;
+    size_t count;
+    size_t capacity;
+    uint64_t literal_bytes;
+    uint64_t matched_bytes;
+    bool is_in_place; // Each kept block is at the same position in the source and in the destination
+} delta_plan_t;
+
+static delta_summary_t totals;
+
+/*!
+ * @brief choose_block_size gives the size of the blocks for a file: the power of two near its square root
+ * @param file_size is the size of the file
+ * @return the size of the blocks, between DELTA_MIN_BLOCK_SIZE and DELTA_MAX_BLOCK_SIZE
+ */
+static uint64_t choose_block_size(uint64_t file_size) {
+    uint64_t block_size = DELTA_MIN_BLOCK_SIZE;
+    while (block_size < DELTA_MAX_BLOCK_SIZE && block_size * block_size < file_size) {
+        block_size <<= 1;
+    }
+    return block_size;
+}
+
+/*!
+ * @brief weak_sums computes the two sums of the rolling checksum of a block
+ * @param data is a pointer to the block
+ * @param length is the size of the block
+ * @param a is a pointer receiving the sum of the bytes
+ * @param b is a pointer receiving the sum of the bytes weighted by their distance to the end of the block
+ */
+static void weak_sums(const uint8_t *data, uint64_t length, uint32_t *a, uint32_t *b) {
+    uint32_t sum = 0;
+    uint32_t weighted_sum = 0;
+    for (uint64_t i = 0; i < length; ++i) {
+        sum += data[i];
+        weighted_sum += (uint32_t) (length - i) * data[i];
+    }
+    *a = sum;
+    *b = weighted_sum;
+}
+
+/*!
+ * @brief weak_checksum combines the two sums of the rolling checksum
+ * @param a is the sum of the bytes
+ * @param b is the weighted sum of the bytes
+ * @return the weak checksum
+ */
+static inline uint32_t weak_checksum(uint32_t a, uint32_t b) {
+    return (a & 0xffff) | (b << 16);
+}
+
+/*!
+ * @brief bucket_of gives the bucket of a weak checksum in the index of the blocks
+ * @param signatures is a pointer to the signatures
+ * @param weak is the weak checksum
+ * @return the bucket
+ */
+static inline uint64_t bucket_of(signatures_t *signatures, uint32_t weak) {
+    return ((uint64_t) weak * 0x9E3779B97F4A7C15ull) >> (64 - signatures->bucket_bits);
+}
+
+/*!
+ * @brief read_full reads a range of a file, until its end if it is shorter
+ * @param fd is the descriptor of the file
+ * @param buffer is the buffer receiving the bytes
+ * @param length is the size of the range
+ * @param offset is the position of the range
+ * @return the number of bytes read, -1 in case of error
+ */
+static ssize_t read_full(int fd, uint8_t *buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t read_size = pread(fd, buffer + done, length - done, offset + done);
+        if (read_size == 0) {
+            break;
+        }
+        if (read_size == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += read_size;
+    }
+    return done;
+}
+
+/*!
+ * @brief free_signatures frees the signatures of a file
+ * @param signatures is a pointer to the signatures
+ */
+static void free_signatures(signatures_t *signatures) {
+    free(signatures->blocks);
+    free(signatures->heads);
+    free(signatures->next);
+}
+
+/*!
+ * @brief build_signatures computes and indexes the checksums of the full blocks of the destination file
+ * @param fd is the descriptor of the destination file
+ * @param file_size is its size
+ * @param signatures is a pointer to the signatures to fill
+ * @return 0 in case of success, -1 else
+ */
+static int build_signatures(int fd, uint64_t file_size, signatures_t *signatures) {
+    memset(signatures, 0, sizeof(*signatures));
+    signatures->block_size = choose_block_size(file_size);
+    signatures->count = file_size / signatures->block_size;
+    signatures->bucket_bits = 1;
+    while (((size_t) 1 << signatures->bucket_bits) < signatures->count) {
+        ++signatures->bucket_bits;
+    }
+    size_t buckets_count = (size_t) 1 << signatures->bucket_bits;
+    signatures->blocks = malloc(signatures->count * sizeof(block_signature_t) + 1);
+    signatures->next = malloc(signatures->count * sizeof(int64_t) + 1);
+    signatures->heads = malloc(buckets_count * sizeof(int64_t));
+    uint8_t *buffer = malloc(DELTA_READ_SIZE); // Un multiple de la taille des blocs
+    if (signatures->blocks == NULL || signatures->next == NULL || signatures->heads == NULL || buffer == NULL) {
+        free_signatures(signatures);
+        free(buffer);
+        return -1;
+    }
+    memset(signatures->heads, 0xff, buckets_count * sizeof(int64_t));
+
+    size_t index = 0;
+    for (uint64_t offset = 0; index < signatures->count; offset += DELTA_READ_SIZE) {
+        ssize_t read_size = read_full(fd, buffer, DELTA_READ_SIZE, offset);
+        if (read_size == -1) {
+            free_signatures(signatures);
+            free(buffer);
+            return -1;
+        }
+        for (uint64_t position = 0; position + signatures->block_size <= (uint64_t) read_size && index < signatures->count; position += signatures->block_size, ++index) {
+            uint32_t a, b;
+            weak_sums(buffer + position, signatures->block_size, &a, &b);
+            signatures->blocks[index].weak = weak_checksum(a, b);
+            EVP_Digest(buffer + position, signatures->block_size, signatures->blocks[index].strong, NULL, EVP_md5(), NULL);
+            uint64_t bucket = bucket_of(signatures, signatures->blocks[index].weak);
+            signatures->next[index] = signatures->heads[bucket];
+            signatures->heads[bucket] = index;
+        }
+        if ((uint64_t) read_size < DELTA_READ_SIZE) {
+            signatures->count = index; // Fichier raccourci depuis son stat
+            break;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+/*!
+ * @brief find_block looks for a destination block equal to a window of the source
+ * A block at the same position as the window is preferred, so that files modified in place are rewritten in place.
+ * @param signatures is a pointer to the signatures of the destination
+ * @param weak is the weak checksum of the window
+ * @param window is a pointer to the window, of one block
+ * @param position is the position of the window in the source
+ * @return the index of the block, -1 if no block matches
+ */
+static int64_t find_block(signatures_t *signatures, uint32_t weak, const uint8_t *window, uint64_t position) {
+    uint8_t strong[16];
+    bool has_strong = false;
+    int64_t found = -1;
+    for (int64_t index = signatures->heads[bucket_of(signatures, weak)]; index != -1; index = signatures->next[index]) {
+        if (signatures->blocks[index].weak != weak) {
+            continue;
+        }
+        if (!has_strong) {
+            EVP_Digest(window, signatures->block_size, strong, NULL, EVP_md5(), NULL);
+            has_strong = true;
+        }
+        if (memcmp(strong, signatures->blocks[index].strong, sizeof(strong)) == 0) {
+            if ((uint64_t) index * signatures->block_size == position) {
+                return index;
+            }
+            found = index;
+        }
+    }
+    return found;
+}
+
+/*!
+ * @brief add_op adds a range to the plan of the new file, merged with the previous range when they follow each other
+ * @param plan is a pointer to the plan
+ * @param source_offset is the position of the range in the new file
+ * @param length is the size of the range
+ * @param destination_offset is the position of the range in the destination, -1 for a range taken from the source
+ * @return 0 in case of success, -1 else
+ */
+static int add_op(delta_plan_t *plan, uint64_t source_offset, uint64_t length, int64_t destination_offset) {
+    if (length == 0) {
+        return 0;
+    }
+    if (destination_offset == -1) {
+        plan->literal_bytes += length;
+    } else {
+        plan->matched_bytes += length;
+        if ((uint64_t) destination_offset != source_offset) {
+            plan->is_in_place = false;
+        }
+    }
+
+    if (plan->count > 0) {
+        delta_op_t *last = &plan->ops[plan->count - 1];
+        bool follows = (last->source_offset + last->length == source_offset);
+        if (follows && last->destination_offset == -1 && destination_offset == -1) {
+            last->length += length;
+            return 0;
+        }
+        if (follows && last->destination_offset != -1 && destination_offset != -1 && last->destination_offset + (int64_t) last->length == destination_offset) {
+            last->length += length;
+            return 0;
+        }
+    }
+    if (plan->count == plan->capacity) {
+        size_t new_capacity = (plan->capacity == 0) ? 64 : 2 * plan->capacity;
+        delta_op_t *new_ops = realloc(plan->ops, new_capacity * sizeof(delta_op_t));
+        if (new_ops == NULL) {
+            return -1;
+        }
+        plan->ops = new_ops;
+        plan->capacity = new_capacity;
+    }
+    plan->ops[plan->count].source_offset = source_offset;
+    plan->ops[plan->count].length = length;
+    plan->ops[plan->count].destination_offset = destination_offset;
+    ++plan->count;
+    return 0;
+}
+
+/*!
+ * @brief scan_source finds the blocks of the destination in the source, and builds the plan of the new file
+ * @param fd is the descriptor of the source
+ * @param file_size is the size of the source
+ * @param signatures is a pointer to the signatures of the destination
+ * @param plan is a pointer to the plan to build
+ * @return 0 in case of success, -1 else
+ */
+static int scan_source(int fd, uint64_t file_size, signatures_t *signatures, delta_plan_t *plan) {
+    uint64_t block_size = signatures->block_size;
+    size_t capacity = block_size + DELTA_READ_SIZE;
+    uint8_t *buffer = malloc(capacity);
+    if (buffer == NULL) {
+        return -1;
+    }
+    uint64_t buffer_start = 0;
+    size_t buffer_length = 0;
+    uint64_t position = 0; // Début de la fenêtre
+    uint64_t literal_start = 0; // Début de la plage à prendre dans la source
+    bool has_sums = false;
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    while (signatures->count > 0 && position + block_size <= file_size) {
+        //La fenêtre et l'octet qui la suit (pour la faire glisser) doivent être dans le tampon
+        uint64_t needed_end = (position + block_size + 1 > file_size) ? file_size : position + block_size + 1;
+        if (needed_end > buffer_start + buffer_length) {
+            size_t kept = buffer_start + buffer_length - position;
+            memmove(buffer, buffer + (position - buffer_start), kept);
+            buffer_start = position;
+            ssize_t read_size = read_full(fd, buffer + kept, capacity - kept, buffer_start + kept);
+            if (read_size == -1) {
+                free(buffer);
+                return -1;
+            }
+            buffer_length = kept + read_size;
+            if (buffer_start + buffer_length < needed_end) {
+                free(buffer);
+                errno = EIO; // Source raccourcie depuis son stat
+                return -1;
+            }
+        }
+        uint8_t *window = buffer + (position - buffer_start);
+        if (!has_sums) {
+            weak_sums(window, block_size, &a, &b);
+            has_sums = true;
+        }
+
+        int64_t index = find_block(signatures, weak_checksum(a, b), window, position);
+        if (index != -1) {
+            if (add_op(plan, literal_start, position - literal_start, -1) == -1
+                || add_op(plan, position, block_size, index * (int64_t) block_size) == -1) {
+                free(buffer);
+                return -1;
+            }
+            position += block_size;
+            literal_start = position;
+            has_sums = false;
+        } else {
+            if (position + block_size >= file_size) {
+                break;
+            }
+            //Glissement de la fenêtre d'un octet
+            uint8_t out = window[0];
+            uint8_t in = window[block_size];
+            a = a - out + in;
+            b = b - (uint32_t) block_size * out + a;
+            ++position;
+        }
+    }
+    free(buffer);
+    return add_op(plan, literal_start, file_size - literal_start, -1);
+}
+
+/*!
+ * @brief apply_in_place rewrites the changed ranges directly in the destination
+ * @param source_fd is the descriptor of the source
+ * @param destination_fd is the descriptor of the destination, opened for reading and writing
+ * @param file_size is the size of the source
+ * @param plan is a pointer to the plan
+ * @return 0 in case of success, -1 else
+ */
+static int apply_in_place(int source_fd, int destination_fd, uint64_t file_size, delta_plan_t *plan) {
+    for (size_t i = 0; i < plan->count; ++i) {
+        delta_op_t *op = &plan->ops[i];
+        if (op->destination_offset == -1 && copy_file_part(source_fd, op->source_offset, destination_fd, op->source_offset, op->length) == -1) {
+            return -1;
+        }
+    }
+    return ftruncate(destination_fd, file_size);
+}
+
+/*!
+ * @brief apply_through_temporary assembles the new file in a temporary file, which then replaces the destination
+ * @param source_fd is the descriptor of the source
+ * @param destination_fd is the descriptor of the destination
+ * @param destination_path is the path of the destination
+ * @param plan is a pointer to the plan
+ * @return 0 in case of success, -1 else
+ */
+static int apply_through_temporary(int source_fd, int destination_fd, char *destination_path, delta_plan_t *plan) {
+    char temporary_path[PATH_SIZE];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.lp25-delta-XXXXXX", destination_path) >= (int) sizeof(temporary_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int temporary_fd = mkstemp(temporary_path);
+    if (temporary_fd == -1) {
+        return -1;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < plan->count && result == 0; ++i) {
+        delta_op_t *op = &plan->ops[i];
+        if (op->destination_offset == -1) {
+            result = copy_file_part(source_fd, op->source_offset, temporary_fd, op->source_offset, op->length);
+        } else {
+            result = copy_file_part(destination_fd, op->destination_offset, temporary_fd, op->source_offset, op->length);
+        }
+    }
+    if (close(temporary_fd) == -1) {
+        result = -1;
+    }
+    if (result == 0) {
+        result = rename(temporary_path, destination_path);
+    }
+    if (result == -1) {
+        unlink(temporary_path);
+    }
+    return result;
+}
+
+/*!
+ * @brief delta_copy updates an existing destination file from the source, reusing the blocks they have in common
+ * A destination with other names (hard links) is never rewritten in place: it is replaced through a temporary file, and they keep their content.
+ * @param source_fd is the descriptor of the source, opened for reading
+ * @param destination_path is the path of the destination file to update
+ * @return 0 in case of success, -1 if the file must be copied in full (no block in common or error; errno is set)
+ */
+int delta_copy(int source_fd, char *destination_path) {
+    struct stat source_stat;
+    struct stat destination_stat;
+    int destination_fd = open(destination_path, O_RDWR);
+    if (destination_fd == -1) {
+        return -1;
+    }
+    if (fstat(source_fd, &source_stat) == -1 || fstat(destination_fd, &destination_stat) == -1 || destination_stat.st_size == 0) {
+        close(destination_fd);
+        return -1;
+    }
+
+    signatures_t signatures;
+    delta_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.is_in_place = (destination_stat.st_nlink <= 1);
+    int result = build_signatures(destination_fd, destination_stat.st_size, &signatures);
+    if (result == 0) {
+        result = scan_source(source_fd, source_stat.st_size, &signatures, &plan);
+        free_signatures(&signatures);
+    }
+    if (result == 0 && plan.matched_bytes == 0) {
+        errno = 0; // Rien à garder : la copie complète est moins coûteuse
+        result = -1;
+    }
+    if (result == 0) {
+        if (plan.is_in_place) {
+            result = apply_in_place(source_fd, destination_fd, source_stat.st_size, &plan);
+        } else {
+            result = apply_through_temporary(source_fd, destination_fd, destination_path, &plan);
+        }
+    }
+    close(destination_fd);
+
+    if (result == 0) {
+        __atomic_add_fetch(&totals.files, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&totals.written_bytes, plan.literal_bytes, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&totals.saved_bytes, plan.matched_bytes, __ATOMIC_RELAXED);
+    }
+    free(plan.ops);
+    return result;
+}
+
+/*!
+ * @brief get_delta_summary gives the counters of the files updated by delta since the start
+ * @param summary is a pointer to the counters to fill
+ */
+void get_delta_summary(delta_summary_t *summary) {
+    summary->files = __atomic_load_n(&totals.files, __ATOMIC_RELAXED);
+    summary->written_bytes = __atomic_load_n(&totals.written_bytes, __ATOMIC_RELAXED);
+    summary->saved_bytes = __atomic_load_n(&totals.saved_bytes, __ATOMIC_RELAXED);
+}
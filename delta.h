@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// Bounds of the size of the blocks compared, which grows with the square root of the file size
+#define DELTA_MIN_BLOCK_SIZE 4096
+#define DELTA_MAX_BLOCK_SIZE (1024 * 1024)
+// Bytes read at once from the source and the destination
+#define DELTA_READ_SIZE (1024 * 1024)
+
+typedef struct {
+    uint64_t files; // Files updated by delta
+    uint64_t written_bytes; // Bytes taken from the source
+    uint64_t saved_bytes; // Bytes kept from the previous destination file, not copied again
+} delta_summary_t;
+
+int delta_copy(int source_fd, char *destination_path);
+void get_delta_summary(delta_summary_t *summary);
@@ -0,0 +1,528 @@
+#include <diff.h>
+#include <sync.h>
+#include <file-properties.h>
+#include <thread-pool.h>
+#include <digest-requests.h>
+#include <tree-hash.h>
+#include <stats.h>
+#include <string.h>
+#include <stdlib.h>
+
+// The comparison of a pair of files goes through tiers, from the cheapest one:
+// - type and size: files of different sizes differ, nothing is read;
+// - without digests ( --date-size-only ), mode and mtime decide;
+// - with digests too, equal mode and mtime mean identical files, which are not read (unless --full-compare or
+//   both digests are known);
+// - the digests of both files when they are known (from the cache);
+// - the sample digests ( @see compute_entries_samples ): a few blocks of each file, different samples mean different files;
+// - when the samples are equal, the digests of both files (small files are hashed whole at once, without samples).
+// Equal contents whose mode or mtime differ only need their metadata to be updated (DIFF_METADATA) instead of a copy.
+// The pairs needing a digest are put aside during the merge-join, then their files are hashed together,
+// by the analyzer processes in the processes mode ( @see request_digests ), else by the content checks threads
+// when they are started, and the pairs get their result at the end.
+
+// A pair of files of the same size, whose result depends on their contents
+typedef struct {
+    files_list_entry_t *source;
+    files_list_entry_t *destination;
+    bool is_metadata_equal;
+} content_pair_t;
+
+// A chunk of a large file hashed as a tree, by one task of the content checks threads ( @see tree-hash.h )
+typedef struct {
+    files_list_entry_t *entry;
+    size_t index;
+} chunk_task_t;
+
+// Files hashed by one task of the content checks threads
+typedef struct {
+    files_list_entry_t **entries;
+    size_t count;
+    bool is_sample;
+} digest_task_t;
+
+static thread_pool_t content_pool;
+static bool is_content_pool_started = false;
+static uint64_t computed_samples = 0;
+static uint64_t computed_digests = 0;
+
+/*!
+ * @brief start_content_checks starts the threads computing the digests of the compared files
+ * @param threads_count is the number of threads, 0 to compute the digests in the thread of the comparison
+ * @return 0 in case of success, -1 else (the digests are then computed in the thread of the comparison)
+ */
+int start_content_checks(int threads_count) {
+    computed_samples = 0;
+    computed_digests = 0;
+    if (threads_count <= 0 || is_content_pool_started) {
+        return 0;
+    }
+    if (init_thread_pool(&content_pool, threads_count) == -1) {
+        return -1;
+    }
+    is_content_pool_started = true;
+    return 0;
+}
+
+/*!
+ * @brief stop_content_checks stops the threads started by start_content_checks
+ * @param samples_count is a pointer receiving the number of sample digests computed since the start, may be NULL
+ * @param digests_count is a pointer receiving the number of digests computed since the start, may be NULL
+ */
+void stop_content_checks(uint64_t *samples_count, uint64_t *digests_count) {
+    if (is_content_pool_started) {
+        destroy_thread_pool(&content_pool);
+        is_content_pool_started = false;
+    }
+    if (samples_count != NULL) {
+        *samples_count = computed_samples;
+    }
+    if (digests_count != NULL) {
+        *digests_count = computed_digests;
+    }
+}
+
+/*!
+ * @brief digest_task computes the sample digests or the digests of a group of files
+ * @param argument is a pointer to the digest_task_t
+ */
+static void digest_task(void *argument) {
+    digest_task_t *task = (digest_task_t *) argument;
+    if (task->is_sample) {
+        size_t failures = compute_entries_samples(task->entries, task->count);
+        __atomic_add_fetch(&computed_samples, task->count - failures, __ATOMIC_RELAXED);
+    } else {
+        size_t failures = compute_entries_digests(task->entries, task->count);
+        __atomic_add_fetch(&computed_digests, task->count - failures, __ATOMIC_RELAXED);
+    }
+}
+
+/*!
+ * @brief chunk_task computes the digest of a chunk of a large file
+ * @param argument is a pointer to the chunk_task_t
+ */
+static void chunk_task(void *argument) {
+    chunk_task_t *task = (chunk_task_t *) argument;
+    compute_chunk_digest(task->entry, task->index);
+}
+
+/*!
+ * @brief hash_chunked_entries computes the digests of the files hashed as trees, their chunks being shared by all the threads
+ * In the processes mode, the chunks are shared by all the analyzers instead ( @see request_chunks_digests ).
+ * The other files are moved to the start of the array, for hash_entries.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @return the number of entries left to hash
+ */
+static size_t hash_chunked_entries(files_list_entry_t **entries, size_t count) {
+    size_t chunked_count = 0;
+    size_t tasks_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t chunks_count = tree_hash_chunks_count(entries[i]->size);
+        chunked_count += (chunks_count > 0);
+        tasks_count += chunks_count;
+    }
+    bool is_requested = digest_requests_started();
+    files_list_entry_t **chunked = (chunked_count > 0) ? malloc(chunked_count * sizeof(files_list_entry_t *)) : NULL;
+    struct stat *stats = (chunked_count > 0) ? malloc(chunked_count * sizeof(struct stat)) : NULL;
+    chunk_task_t *tasks = (chunked_count > 0 && !is_requested) ? malloc(tasks_count * sizeof(chunk_task_t)) : NULL;
+    if (chunked == NULL || stats == NULL || (tasks == NULL && !is_requested)) {
+        free(chunked);
+        free(stats);
+        free(tasks);
+        return count;
+    }
+
+    //Un morceau par tâche : un gros fichier occupe tous les threads
+    size_t left_count = 0;
+    chunked_count = 0;
+    tasks_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (begin_chunked_digest(entries[i], &stats[chunked_count]) == -1) {
+            entries[left_count++] = entries[i];
+            continue;
+        }
+        for (size_t j = 0; !is_requested && j < entries[i]->chunks->count; ++j) {
+            chunk_task_t task = {entries[i], j};
+            tasks[tasks_count] = task;
+            if (submit_task(&content_pool, chunk_task, &tasks[tasks_count]) == -1) {
+                chunk_task(&tasks[tasks_count]);
+            }
+            ++tasks_count;
+        }
+        chunked[chunked_count++] = entries[i];
+    }
+    if (is_requested) {
+        request_chunks_digests(chunked, chunked_count);
+    } else {
+        wait_thread_pool(&content_pool);
+    }
+
+    for (size_t i = 0; i < chunked_count; ++i) {
+        if (end_chunked_digest(chunked[i], &stats[i]) == 0) {
+            __atomic_add_fetch(&computed_digests, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(chunked);
+    free(stats);
+    free(tasks);
+    return left_count;
+}
+
+/*!
+ * @brief compare_inodes orders entries by inode, so that the hard links of a file follow each other
+ * @param left is a pointer to a pointer to an entry
+ * @param right is a pointer to a pointer to an entry
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_inodes(const void *left, const void *right) {
+    const files_list_entry_t *left_entry = *(files_list_entry_t * const *) left;
+    const files_list_entry_t *right_entry = *(files_list_entry_t * const *) right;
+    if (left_entry->device != right_entry->device) {
+        return (left_entry->device < right_entry->device) ? -1 : 1;
+    }
+    if (left_entry->inode != right_entry->inode) {
+        return (left_entry->inode < right_entry->inode) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief set_aside_links keeps a single entry of each inode: the other hard links get its digests once computed
+ * @param entries is an array of pointers to the entries, reordered by inode
+ * @param count is the number of entries
+ * @param links is an array receiving, for each entry set aside, the kept entry of its inode followed by the entry itself
+ * @param links_count is a pointer to the number of entries set aside
+ * @return the number of entries kept at the start of the array
+ */
+static size_t set_aside_links(files_list_entry_t **entries, size_t count, files_list_entry_t **links, size_t *links_count) {
+    size_t kept = 0;
+    qsort(entries, count, sizeof(files_list_entry_t *), compare_inodes); // L'ordre des inodes suit souvent celui des données sur le disque
+    for (size_t i = 0; i < count; ++i) {
+        files_list_entry_t *kept_entry = (kept > 0) ? entries[kept - 1] : NULL;
+        if (kept_entry != NULL && entries[i]->links_count > 1 && entries[i]->inode != 0
+            && kept_entry->device == entries[i]->device && kept_entry->inode == entries[i]->inode) {
+            links[2 * *links_count] = kept_entry;
+            links[2 * *links_count + 1] = entries[i];
+            ++*links_count;
+            continue;
+        }
+        entries[kept++] = entries[i];
+    }
+    return kept;
+}
+
+/*!
+ * @brief share_digests gives an entry the digests computed for another hard link of its inode
+ * @param hashed_entry is a pointer to the entry whose digests were computed
+ * @param link_entry is a pointer to the other entry
+ */
+static void share_digests(files_list_entry_t *hashed_entry, files_list_entry_t *link_entry) {
+    memcpy(link_entry->digest, hashed_entry->digest, sizeof(link_entry->digest));
+    link_entry->sample_digest = hashed_entry->sample_digest;
+    link_entry->digest_flags |= hashed_entry->digest_flags & (ENTRY_HAS_DIGEST | ENTRY_HAS_SAMPLE);
+    if (hashed_entry->chunks != NULL && link_entry->chunks == NULL) {
+        link_entry->chunks = copy_chunk_digests(hashed_entry->chunks);
+    }
+}
+
+/*!
+ * @brief hash_inodes computes the sample digests or the digests of files which are all different inodes
+ * @see hash_entries
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param is_sample selects the sample digests (true) or the digests (false)
+ */
+static void hash_inodes(files_list_entry_t **entries, size_t count, bool is_sample) {
+    if (!is_sample && (is_content_pool_started || digest_requests_started()) && get_tree_hash_chunk_size() != 0) {
+        count = hash_chunked_entries(entries, count);
+    }
+    if (digest_requests_started()) {
+        //Mode processus : les fichiers sont lus par les analyseurs
+        size_t failures = request_digests(entries, count, is_sample);
+        __atomic_add_fetch(is_sample ? &computed_samples : &computed_digests, count - failures, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t tasks_count = (count + FILE_STATS_BATCH - 1) / FILE_STATS_BATCH;
+    digest_task_t *tasks = (is_content_pool_started && tasks_count > 1) ? malloc(tasks_count * sizeof(digest_task_t)) : NULL;
+    for (size_t i = 0; i < tasks_count; ++i) {
+        digest_task_t task = {entries + i * FILE_STATS_BATCH, (count - i * FILE_STATS_BATCH < FILE_STATS_BATCH) ? count - i * FILE_STATS_BATCH : FILE_STATS_BATCH, is_sample};
+        if (tasks == NULL) {
+            digest_task(&task);
+            continue;
+        }
+        tasks[i] = task;
+        if (submit_task(&content_pool, digest_task, &tasks[i]) == -1) {
+            digest_task(&tasks[i]);
+        }
+    }
+    if (tasks != NULL) {
+        wait_thread_pool(&content_pool);
+        free(tasks);
+    }
+}
+
+/*!
+ * @brief hash_entries computes the sample digests or the digests of files, by groups of FILE_STATS_BATCH files
+ * The groups, and the chunks of the files hashed as trees, are shared by the content checks threads when they are started;
+ * in the processes mode, the groups are sent to the analyzers instead ( @see request_digests ).
+ * Each inode is read once: its other hard links in the array get the same digests.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param is_sample selects the sample digests (true) or the digests (false)
+ */
+static void hash_entries(files_list_entry_t **entries, size_t count, bool is_sample) {
+    files_list_entry_t **links = (count > 1) ? malloc(2 * count * sizeof(files_list_entry_t *)) : NULL;
+    size_t links_count = 0;
+    if (links != NULL) {
+        count = set_aside_links(entries, count, links, &links_count);
+    }
+    hash_inodes(entries, count, is_sample);
+    for (size_t i = 0; i < links_count; ++i) {
+        share_digests(links[2 * i], links[2 * i + 1]);
+    }
+    free(links);
+}
+
+/*!
+ * @brief compute_digests_on_demand computes the digests of files outside of a comparison, as diff_files_lists does for its pairs
+ * The analyzers or the content checks threads are used when they are started ( @see start_digest_requests and start_content_checks ).
+ * @param entries is an array of pointers to the entries, whose sizes are known (it is reordered)
+ * @param count is the number of entries
+ */
+void compute_digests_on_demand(files_list_entry_t **entries, size_t count) {
+    hash_entries(entries, count, false);
+}
+
+/*!
+ * @brief add_missing adds the entries of a pair that do not have some digest yet to an array
+ * @param entries is the array of entries to complete
+ * @param count is a pointer to the number of entries in the array
+ * @param pair is a pointer to the pair
+ * @param flag is ENTRY_HAS_SAMPLE or ENTRY_HAS_DIGEST
+ */
+static void add_missing(files_list_entry_t **entries, size_t *count, content_pair_t *pair, uint8_t flag) {
+    if (!(pair->source->digest_flags & flag)) {
+        entries[(*count)++] = pair->source;
+    }
+    if (!(pair->destination->digest_flags & flag)) {
+        entries[(*count)++] = pair->destination;
+    }
+}
+
+/*!
+ * @brief has_both tells if both entries of a pair have some digest
+ * @param pair is a pointer to the pair
+ * @param flag is ENTRY_HAS_SAMPLE or ENTRY_HAS_DIGEST
+ * @return true if both entries have it, false else
+ */
+static bool has_both(content_pair_t *pair, uint8_t flag) {
+    return (pair->source->digest_flags & flag) && (pair->destination->digest_flags & flag);
+}
+
+/*!
+ * @brief mark_changed_chunks records in the source entry which chunks differ from the destination
+ * Both files have the same size, so the same chunks: the copy then only rewrites the changed ones.
+ * @param pair is a pointer to a pair of different files
+ */
+static void mark_changed_chunks(content_pair_t *pair) {
+    chunk_digests_t *source_chunks = pair->source->chunks;
+    chunk_digests_t *destination_chunks = pair->destination->chunks;
+    if (source_chunks == NULL || destination_chunks == NULL || source_chunks->count != destination_chunks->count) {
+        return;
+    }
+    free(source_chunks->changed);
+    source_chunks->changed = malloc(source_chunks->count);
+    for (size_t i = 0; source_chunks->changed != NULL && i < source_chunks->count; ++i) {
+        source_chunks->changed[i] = (memcmp(source_chunks->digests[i], destination_chunks->digests[i], HASH_MAX_DIGEST_SIZE) != 0);
+    }
+}
+
+/*!
+ * @brief content_result gives the result of a pair from the digests computed for it
+ * @param pair is a pointer to the pair
+ * @return the result, DIFF_CHANGED when the files could not be read
+ */
+static diff_result_t content_result(content_pair_t *pair) {
+    if (has_both(pair, ENTRY_HAS_DIGEST)) {
+        if (memcmp(pair->source->digest, pair->destination->digest, sizeof(pair->source->digest)) != 0) {
+            mark_changed_chunks(pair);
+            return DIFF_CHANGED;
+        }
+        return pair->is_metadata_equal ? DIFF_IDENTICAL : DIFF_METADATA;
+    }
+    return DIFF_CHANGED; // Échantillons différents, ou fichiers illisibles : copiés
+}
+
+/*!
+ * @brief resolve_content_pairs computes the digests needed by the pairs put aside, tier after tier
+ * @param pairs is the array of pairs
+ * @param count is the number of pairs
+ * @return 0 in case of success, -1 else (out of memory: the pairs without digests will be found changed)
+ */
+static int resolve_content_pairs(content_pair_t *pairs, size_t count) {
+    files_list_entry_t **samples = malloc(2 * count * sizeof(files_list_entry_t *));
+    files_list_entry_t **digests = malloc(2 * count * sizeof(files_list_entry_t *));
+    if (samples == NULL || digests == NULL) {
+        free(samples);
+        free(digests);
+        return -1;
+    }
+
+    //1 - Échantillons des fichiers, sauf les petits qui sont lus en entier de toute façon
+    size_t samples_count = 0;
+    size_t digests_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (has_both(&pairs[i], ENTRY_HAS_DIGEST)) {
+            continue;
+        }
+        if (pairs[i].source->size <= 3 * DIGEST_SAMPLE_BLOCK_SIZE) {
+            add_missing(digests, &digests_count, &pairs[i], ENTRY_HAS_DIGEST);
+        } else {
+            add_missing(samples, &samples_count, &pairs[i], ENTRY_HAS_SAMPLE);
+        }
+    }
+    hash_entries(samples, samples_count, true);
+    hash_entries(digests, digests_count, false);
+
+    //2 - Empreintes complètes des seules paires aux échantillons égaux
+    digests_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!has_both(&pairs[i], ENTRY_HAS_DIGEST) && has_both(&pairs[i], ENTRY_HAS_SAMPLE)
+            && pairs[i].source->sample_digest == pairs[i].destination->sample_digest) {
+            add_missing(digests, &digests_count, &pairs[i], ENTRY_HAS_DIGEST);
+        }
+    }
+    hash_entries(digests, digests_count, false);
+
+    free(samples);
+    free(digests);
+    return 0;
+}
+
+/*!
+ * @brief report_result counts a result and gives it to the handler
+ * @param counters is a pointer to the counters of each result
+ * @param result is the result
+ * @param source_entry is the source entry, NULL for DIFF_EXTRA
+ * @param destination_entry is the destination entry, NULL for DIFF_NEW
+ * @param handler is the function called with the result, may be NULL
+ * @param parameters is passed as is to the handler
+ */
+static void report_result(diff_summary_t *counters, diff_result_t result, files_list_entry_t *source_entry, files_list_entry_t *destination_entry,
+                          diff_handler_t handler, void *parameters) {
+    switch (result) {
+        case DIFF_NEW:
+            ++counters->new_count;
+            break;
+        case DIFF_CHANGED:
+            ++counters->changed_count;
+            break;
+        case DIFF_METADATA:
+            ++counters->metadata_count;
+            break;
+        case DIFF_IDENTICAL:
+            ++counters->identical_count;
+            break;
+        case DIFF_EXTRA:
+            ++counters->extra_count;
+            break;
+    }
+    if (handler != NULL) {
+        handler(result, source_entry, destination_entry, parameters);
+    }
+}
+
+/*!
+ * @brief diff_files_lists compares a source and a destination list in a single merge-join pass
+ * Both lists are sorted on their paths relative to their roots (a no-op when they already are),
+ * then walked together once, so the whole comparison costs O(N log N) instead of one lookup per entry.
+ * The pairs of files whose contents must be compared get their result after the pass, once the
+ * digests they need are computed: the handler is called for them last.
+ * @param src_list is a pointer to the source list
+ * @param dst_list is a pointer to the destination list
+ * @param start_of_src the position of the relative path in the source entries (@see path_root_length)
+ * @param start_of_dest the position of the relative path in the destination entries
+ * @param has_md5 a value to enable or disable the comparison of the contents of the files
+ * @param is_content_always_compared tells if the files of equal size, mode and mtime are compared by content too
+ * @param handler is the function called for each path with its result, may be NULL
+ * @param parameters is passed as is to the handler
+ * @param summary is a pointer to the counters of each result, may be NULL
+ * @return 0 in case of success, -1 else
+ */
+int diff_files_lists(files_list_t *src_list, files_list_t *dst_list, size_t start_of_src, size_t start_of_dest, bool has_md5, bool is_content_always_compared, diff_handler_t handler, void *parameters, diff_summary_t *summary) {
+    if (src_list == NULL || dst_list == NULL) {
+        return -1;
+    }
+
+    uint64_t start_ns = stats_now();
+    diff_summary_t counters = {0, 0, 0, 0, 0};
+    if (sort_files_list(src_list, start_of_src) == -1 || sort_files_list(dst_list, start_of_dest) == -1) {
+        return -1;
+    }
+
+    content_pair_t *pairs = NULL;
+    size_t pairs_count = 0;
+    size_t pairs_capacity = 0;
+    files_list_entry_t *source_entry = src_list->head;
+    files_list_entry_t *destination_entry = dst_list->head;
+
+    while (source_entry != NULL || destination_entry != NULL) {
+        int order;
+        if (source_entry == NULL) { // Il ne reste que des entrées en trop dans la destination
+            order = 1;
+        } else if (destination_entry == NULL) { // Il ne reste que des nouvelles entrées
+            order = -1;
+        } else {
+            order = strcmp(source_entry->path_and_name + start_of_src, destination_entry->path_and_name + start_of_dest);
+        }
+
+        if (order < 0) { // Absent de la destination
+            report_result(&counters, DIFF_NEW, source_entry, NULL, handler, parameters);
+            source_entry = source_entry->next;
+        } else if (order > 0) { // Absent de la source
+            report_result(&counters, DIFF_EXTRA, NULL, destination_entry, handler, parameters);
+            destination_entry = destination_entry->next;
+        } else { // Même chemin des deux côtés
+            bool is_metadata_equal = !mismatch(source_entry, destination_entry, false);
+            //Métadonnées égales : fichiers identiques sans rien lire, sauf demande explicite ou empreintes déjà connues (cache)
+            bool is_content_compared = has_md5 && source_entry->entry_type == FICHIER && destination_entry->entry_type == FICHIER
+                                       && source_entry->size == destination_entry->size
+                                       && (!is_metadata_equal || is_content_always_compared
+                                           || ((source_entry->digest_flags & ENTRY_HAS_DIGEST) && (destination_entry->digest_flags & ENTRY_HAS_DIGEST)));
+            if (is_content_compared && pairs_count == pairs_capacity) {
+                size_t new_capacity = (pairs_capacity == 0) ? 64 : 2 * pairs_capacity;
+                content_pair_t *new_pairs = realloc(pairs, new_capacity * sizeof(content_pair_t));
+                if (new_pairs != NULL) {
+                    pairs = new_pairs;
+                    pairs_capacity = new_capacity;
+                }
+            }
+            if (is_content_compared && pairs_count < pairs_capacity) {
+                //Contenus à comparer : résultat donné une fois les empreintes nécessaires calculées
+                content_pair_t pair = {source_entry, destination_entry, is_metadata_equal};
+                pairs[pairs_count++] = pair;
+            } else {
+                //Résultat donné par les métadonnées, ou paire copiée faute de mémoire pour la mettre de côté
+                report_result(&counters, (is_metadata_equal && !is_content_compared) ? DIFF_IDENTICAL : DIFF_CHANGED,
+                              source_entry, destination_entry, handler, parameters);
+            }
+            source_entry = source_entry->next;
+            destination_entry = destination_entry->next;
+        }
+    }
+
+    if (pairs_count > 0) {
+        resolve_content_pairs(pairs, pairs_count);
+        for (size_t i = 0; i < pairs_count; ++i) {
+            report_result(&counters, content_result(&pairs[i]), pairs[i].source, pairs[i].destination, handler, parameters);
+        }
+    }
+    free(pairs);
+    add_stat_since(STATS_DIFF_NS, start_ns);
+
+    if (summary != NULL) {
+        *summary = counters;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <files-list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// DIFF_METADATA: same content, only the mode or the mtime of the destination must be updated
+typedef enum { DIFF_NEW, DIFF_CHANGED, DIFF_METADATA, DIFF_IDENTICAL, DIFF_EXTRA } diff_result_t;
+
+typedef struct {
+    uint64_t new_count;
+    uint64_t changed_count;
+    uint64_t metadata_count;
+    uint64_t identical_count;
+    uint64_t extra_count;
+} diff_summary_t;
+
+// Called once per path: source_entry is NULL for DIFF_EXTRA, destination_entry is NULL for DIFF_NEW
+typedef void (*diff_handler_t)(diff_result_t result, files_list_entry_t *source_entry, files_list_entry_t *destination_entry, void *parameters);
+
+int start_content_checks(int threads_count);
+void stop_content_checks(uint64_t *samples_count, uint64_t *digests_count);
+void compute_digests_on_demand(files_list_entry_t **entries, size_t count);
+int diff_files_lists(files_list_t *src_list, files_list_t *dst_list, size_t start_of_src, size_t start_of_dest, bool has_md5, bool is_content_always_compared, diff_handler_t handler, void *parameters, diff_summary_t *summary);
@@ -0,0 +1,317 @@
+#include <digest-requests.h>
+#include <file-properties.h>
+#include <tree-hash.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/msg.h>
+
+// Functions in this file let the main process of the processes mode hand the digests its comparisons need
+// ( @see diff_files_lists ) to the analyzer processes, which are idle once the lists are made, instead of
+// computing them itself. The files are sent in batches to the analyzers of both sides, each request holding
+// the paths and sizes of its files (and the ranges of the chunks of the files hashed as trees, so that a large
+// file is shared by all the analyzers), and the analyzers answer in the records of the request. While the main
+// process waits for the answers, the other messages it receives (the lists of the streaming mode) are
+// postponed: receive_main_message gives them back first, in their order.
+
+// A message received by the main process while it waited for answers
+typedef struct _postponed_message {
+    struct _postponed_message *next;
+    ssize_t size; // Without its mtype, as returned by receive_message
+    char message[]; // mtype followed by size bytes
+} postponed_message_t;
+
+static int requests_queue = -1;
+static int requests_analyzers_count = 0;
+static bool are_requests_started = false;
+// Files or chunks of files of a request, sent in turn
+typedef struct {
+    files_list_entry_t **entries;
+    size_t entries_count;
+    char op_code; // COMMAND_CODE_SAMPLE_FILES, COMMAND_CODE_DIGEST_FILES or COMMAND_CODE_DIGEST_CHUNKS
+    size_t next_entry;
+    size_t next_chunk; // Chunk of the next entry, for COMMAND_CODE_DIGEST_CHUNKS
+    size_t left_count; // Files or chunks not sent yet
+} request_cursor_t;
+
+static postponed_message_t *postponed_head = NULL;
+static postponed_message_t *postponed_tail = NULL;
+
+/*!
+ * @brief start_digest_requests sends the digests computed by diff_files_lists to the analyzer processes from now on
+ * @param msg_queue is the id of the MQ (unused with the shared memory transport)
+ * @param analyzers_count is the number of analyzers of each side
+ */
+void start_digest_requests(int msg_queue, int analyzers_count) {
+    requests_queue = msg_queue;
+    requests_analyzers_count = (analyzers_count > 0) ? analyzers_count : 1;
+    are_requests_started = true;
+}
+
+/*!
+ * @brief stop_digest_requests computes the digests in the main process again
+ */
+void stop_digest_requests(void) {
+    are_requests_started = false;
+}
+
+/*!
+ * @brief digest_requests_started tells if the digests are computed by the analyzer processes
+ * @return true between start_digest_requests and stop_digest_requests
+ */
+bool digest_requests_started(void) {
+    return are_requests_started;
+}
+
+/*!
+ * @brief postpone_message keeps a message for the main process received while it waited for answers
+ * @param message is a pointer to the received message
+ * @param size is its size, as returned by receive_message
+ */
+static void postpone_message(any_message_t *message, ssize_t size) {
+    postponed_message_t *postponed = malloc(offsetof(postponed_message_t, message) + sizeof(long) + size);
+    if (postponed == NULL) {
+        printf("Memoire insuffisante : un message du processus principal est perdu\n");
+        return;
+    }
+    postponed->next = NULL;
+    postponed->size = size;
+    memcpy(postponed->message, message, sizeof(long) + size);
+    if (postponed_tail == NULL) {
+        postponed_head = postponed;
+    } else {
+        postponed_tail->next = postponed;
+    }
+    postponed_tail = postponed;
+}
+
+/*!
+ * @brief receive_main_message receives a message for the main process, the postponed ones first
+ * @param msg_queue is the id of the MQ (unused with the shared memory transport)
+ * @param message is a pointer to the buffer for the message
+ * @param msg_flags are the flags of msgrcv
+ * @return the size of the message, -1 in case of error
+ */
+ssize_t receive_main_message(int msg_queue, any_message_t *message, int msg_flags) {
+    if (postponed_head == NULL) {
+        return receive_message(msg_queue, message, MSG_TYPE_TO_MAIN, msg_flags);
+    }
+    postponed_message_t *postponed = postponed_head;
+    postponed_head = postponed->next;
+    if (postponed_head == NULL) {
+        postponed_tail = NULL;
+    }
+    ssize_t size = postponed->size;
+    memcpy(message, postponed->message, sizeof(long) + size);
+    free(postponed);
+    return size;
+}
+
+/*!
+ * @brief add_next_request adds the next file or chunk of a request to a batch
+ * A chunk record holds the path and size of its file, its request id the indexes of the file and of the chunk.
+ * @param batch is a pointer to the batch
+ * @param cursor is a pointer to the cursor, moved to the next file or chunk when it was added
+ * @return true if the file or chunk was added, false if the batch is full
+ */
+static bool add_next_request(entries_batch_t *batch, request_cursor_t *cursor) {
+    files_list_entry_t *entry = cursor->entries[cursor->next_entry];
+    if (cursor->op_code != COMMAND_CODE_DIGEST_CHUNKS) {
+        if (!add_entry_to_batch(batch, entry, cursor->next_entry, true)) {
+            return false;
+        }
+        ++cursor->next_entry;
+    } else {
+        file_entry_record_t *record = (file_entry_record_t *) (batch->data + batch->data_length);
+        if (!add_entry_to_batch(batch, entry, ((uint64_t) cursor->next_entry << 32) | cursor->next_chunk, true)) {
+            return false;
+        }
+        uint64_t chunk_size = get_tree_hash_chunk_size();
+        record->chunk.offset = cursor->next_chunk * chunk_size;
+        record->chunk.length = (entry->size - record->chunk.offset < chunk_size) ? entry->size - record->chunk.offset : chunk_size;
+        if (++cursor->next_chunk == entry->chunks->count) {
+            cursor->next_chunk = 0;
+            ++cursor->next_entry;
+        }
+    }
+    --cursor->left_count;
+    return true;
+}
+
+/*!
+ * @brief skip_next_request gives up the next file or chunk of a request, whose path is too long for a message
+ * @param cursor is a pointer to the cursor, moved to the next file or chunk
+ */
+static void skip_next_request(request_cursor_t *cursor) {
+    files_list_entry_t *entry = cursor->entries[cursor->next_entry];
+    if (cursor->op_code != COMMAND_CODE_DIGEST_CHUNKS) {
+        ++cursor->next_entry;
+    } else {
+        ++entry->chunks->failures;
+        if (++cursor->next_chunk == entry->chunks->count) {
+            cursor->next_chunk = 0;
+            ++cursor->next_entry;
+        }
+    }
+    --cursor->left_count;
+}
+
+/*!
+ * @brief apply_answer copies the digests of an answer of an analyzer into the entries
+ * A chunk that could not be hashed is counted in the failures of its file ( @see end_chunked_digest ).
+ * @param answer is a pointer to the answer, whose request ids were set by add_next_request
+ * @param cursor is a pointer to the cursor of the request
+ * @return the number of files or chunks that could not be hashed
+ */
+static size_t apply_answer(entries_batch_t *answer, request_cursor_t *cursor) {
+    size_t failures = 0;
+    for (file_entry_record_t *record = next_batch_record(answer, NULL); record != NULL; record = next_batch_record(answer, record)) {
+        if (cursor->op_code == COMMAND_CODE_DIGEST_CHUNKS) {
+            files_list_entry_t *entry = cursor->entries[record->request_id >> 32];
+            if (!record->is_ok) {
+                ++failures;
+                ++entry->chunks->failures;
+            } else {
+                memcpy(entry->chunks->digests[record->request_id & UINT32_MAX], record->digest, HASH_MAX_DIGEST_SIZE);
+            }
+            continue;
+        }
+        files_list_entry_t *entry = cursor->entries[record->request_id];
+        if (!record->is_ok) {
+            ++failures;
+        } else if (cursor->op_code == COMMAND_CODE_SAMPLE_FILES) {
+            memcpy(&entry->sample_digest, record->digest, sizeof(entry->sample_digest));
+            entry->digest_flags |= ENTRY_HAS_SAMPLE;
+        } else {
+            memcpy(entry->digest, record->digest, sizeof(entry->digest));
+            entry->digest_flags |= ENTRY_HAS_DIGEST;
+        }
+    }
+    return failures;
+}
+
+/*!
+ * @brief send_requests has the files or chunks of a request hashed by the analyzer processes
+ * Batches are sent alternately to the analyzers of the source and of the destination, at most two per
+ * analyzer at once and within in_flight_budget, so that the answers always fit in the queue. The requests
+ * are never sent blocking: when the queue is full, the messages for the main process are read first.
+ * @param cursor is a pointer to the cursor of the request, at its start
+ * @return the number of files or chunks that could not be hashed
+ */
+static size_t send_requests(request_cursor_t *cursor) {
+    static entries_batch_t batch;
+    static any_message_t message;
+    size_t budget = in_flight_budget();
+    size_t max_in_flight = 2 * 2 * (size_t) requests_analyzers_count; //Des deux côtés, un lot calculé et un en attente par analyseur
+    size_t count = cursor->left_count;
+    size_t in_flight = 0;
+    size_t in_flight_bytes = 0;
+    size_t answered = 0;
+    size_t failures = 0;
+    bool has_batch = false;
+    long recipient = MSG_TYPE_TO_SOURCE_ANALYZERS;
+    while (answered < count) {
+        //Envoi de lots tant que des analyseurs sont disponibles
+        while (in_flight < max_in_flight && (has_batch || cursor->left_count > 0) && (in_flight == 0 || in_flight_bytes < budget)) {
+            if (!has_batch) {
+                //Lots plus petits en fin de requête pour que tous les analyseurs aient du travail
+                size_t batch_size = (cursor->left_count + max_in_flight - 1) / max_in_flight;
+                if (batch_size > FILE_STATS_BATCH) {
+                    batch_size = FILE_STATS_BATCH;
+                }
+                init_entries_batch(&batch, recipient, cursor->op_code);
+                while (cursor->left_count > 0 && batch.entries_count < batch_size && (batch.entries_count == 0 || in_flight_bytes + batch.data_length < budget)) {
+                    if (!add_next_request(&batch, cursor)) {
+                        break;
+                    }
+                }
+                if (batch.entries_count == 0) { //Chemin trop long pour un message : le fichier n'est pas lu
+                    skip_next_request(cursor);
+                    ++answered;
+                    ++failures;
+                    continue;
+                }
+                has_batch = true;
+            }
+            size_t batch_bytes = batch.data_length;
+            size_t batch_entries = batch.entries_count;
+            if (send_entries_batch(requests_queue, &batch, IPC_NOWAIT) == -1) {
+                if (errno == EAGAIN) {
+                    break; // File pleine : les messages reçus sont lus avant de réessayer
+                }
+                //Lot perdu : ses fichiers ou morceaux sont comptés comme non calculés
+                for (file_entry_record_t *record = next_batch_record(&batch, NULL); record != NULL; record = next_batch_record(&batch, record)) {
+                    record->is_ok = false;
+                }
+                failures += apply_answer(&batch, cursor);
+                answered += batch_entries;
+                has_batch = false;
+                continue;
+            }
+            has_batch = false;
+            ++in_flight;
+            in_flight_bytes += batch_bytes;
+            recipient = (recipient == MSG_TYPE_TO_SOURCE_ANALYZERS) ? MSG_TYPE_TO_DESTINATION_ANALYZERS : MSG_TYPE_TO_SOURCE_ANALYZERS;
+        }
+        if (answered == count) {
+            break;
+        }
+
+        //Sans requête en cours (file pleine), les messages reçus sont lus sans attendre, puis l'envoi est réessayé
+        ssize_t size = receive_message(requests_queue, &message, MSG_TYPE_TO_MAIN, (in_flight == 0) ? IPC_NOWAIT : 0);
+        if (size == -1) {
+            if (errno == ENOMSG || errno == EAGAIN) {
+                struct timespec pause = {0, DIGEST_REQUEST_RETRY_NS};
+                nanosleep(&pause, NULL);
+            } else if (errno != EINTR) {
+                perror("Erreur lors de la reception des empreintes");
+                //Les morceaux sans réponse ne sont pas connus : aucun fichier haché en arbre n'a d'empreinte
+                for (size_t i = 0; cursor->op_code == COMMAND_CODE_DIGEST_CHUNKS && i < cursor->entries_count; ++i) {
+                    ++cursor->entries[i]->chunks->failures;
+                }
+                return failures + count - answered;
+            }
+            continue;
+        }
+        if (message.entries_batch.op_code != COMMAND_CODE_FILES_HASHED) {
+            postpone_message(&message, size);
+            continue;
+        }
+        entries_batch_t *answer = received_batch(&message);
+        failures += apply_answer(answer, cursor);
+        answered += answer->entries_count;
+        --in_flight;
+        in_flight_bytes -= answer->data_length;
+        release_batch(answer);
+    }
+    return failures;
+}
+
+/*!
+ * @brief request_digests has the sample digests or the digests of files computed by the analyzer processes
+ * @param entries is an array of pointers to the entries, whose sizes are known
+ * @param count is the number of entries
+ * @param is_sample selects the sample digests (true) or the digests (false)
+ * @return the number of files that could not be hashed
+ */
+size_t request_digests(files_list_entry_t **entries, size_t count, bool is_sample) {
+    request_cursor_t cursor = {entries, count, is_sample ? COMMAND_CODE_SAMPLE_FILES : COMMAND_CODE_DIGEST_FILES, 0, 0, count};
+    return send_requests(&cursor);
+}
+
+/*!
+ * @brief request_chunks_digests has the chunks of files hashed as trees computed by the analyzer processes
+ * The chunks of a large file are spread over all the analyzers, their digests are written in its chunks.
+ * @param entries is an array of pointers to the entries, prepared by begin_chunked_digest
+ * @param count is the number of entries
+ */
+void request_chunks_digests(files_list_entry_t **entries, size_t count) {
+    request_cursor_t cursor = {entries, count, COMMAND_CODE_DIGEST_CHUNKS, 0, 0, 0};
+    for (size_t i = 0; i < count; ++i) {
+        cursor.left_count += entries[i]->chunks->count;
+    }
+    send_requests(&cursor);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <files-list.h>
+#include <messages.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Pause before sending a request again to a full queue, in nanoseconds
+#define DIGEST_REQUEST_RETRY_NS 1000000
+
+void start_digest_requests(int msg_queue, int analyzers_count);
+void stop_digest_requests(void);
+bool digest_requests_started(void);
+size_t request_digests(files_list_entry_t **entries, size_t count, bool is_sample);
+void request_chunks_digests(files_list_entry_t **entries, size_t count);
+ssize_t receive_main_message(int msg_queue, any_message_t *message, int msg_flags);
@@ -1,8 +1,10 @@
+#define _GNU_SOURCE
 #include <file-properties.h>
 
 #include <sys/stat.h>
 #include <dirent.h>
-#include <openssl/evp.h>
+#include <hash.h>
+#include <errno.h>
 #include <unistd.h>
 #include <assert.h>
 #include <string.h>
@@ -10,6 +12,90 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <utility.h>
+#include <checksum-cache.h>
+#include <async-io.h>
+#include <multi-hash.h>
+#include <tree-hash.h>
+#include <stats.h>
+#include <stdlib.h>
+
+/*!
+ * @brief apply_file_stats fills an entry from the stats of its file (inc. directories)
+ * The digest of a file is only taken from the cache: otherwise it is computed later, if the comparison needs it.
+ * @param entry is a pointer to the files list entry
+ * @param file_stat is a pointer to the result of stat on the file
+ * @return -1 in case of error, 0 else
+ */
+static int apply_file_stats(files_list_entry_t *entry, struct stat *file_stat) {
+    entry->digest_flags = 0;
+    entry->device = 0;
+    entry->inode = 0;
+    entry->links_count = 1;
+    if (S_ISREG(file_stat->st_mode)) {             //Si le fichier est un fichier ordinaire
+        // Type du fichier
+        entry->entry_type = FICHIER;
+
+        //Métadonnées fichier
+        entry->mtime = file_stat->st_mtim;
+
+        entry->size = file_stat->st_size;
+
+        //Identité de l'inode : les liens physiques d'un même fichier ne sont lus et copiés qu'une fois
+        entry->device = file_stat->st_dev;
+        entry->inode = file_stat->st_ino;
+        entry->links_count = file_stat->st_nlink;
+
+        //Permissions fichier
+        entry->mode = file_stat->st_mode & 0777;
+
+        // Empreinte du fichier : reprise du cache si le fichier n'a pas changé depuis son dernier calcul
+        checksum_cache_key_t cache_key;
+        make_checksum_cache_key(file_stat, &cache_key);
+        if (checksum_cache_lookup(&cache_key, entry->digest)) {
+            entry->digest_flags = ENTRY_HAS_DIGEST;
+        }
+
+    } else if (S_ISDIR(file_stat->st_mode)) {              //Si le fichier est un répertoire
+        // Mode pour les dossiers
+        entry->entry_type = DOSSIER;
+
+        //Permissions répertoire
+        entry->mode = file_stat->st_mode & 0777;
+
+        //Ni date ni taille comparées pour les répertoires
+        entry->mtime.tv_sec = 0;
+        entry->mtime.tv_nsec = 0;
+        entry->size = 0;
+        memset(entry->digest, 0, sizeof(entry->digest));
+
+    } else {
+        //Fichier qui n'est ni un fichier régulier ni un répertoire
+        printf("Unsupported file type\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief store_digest adds a computed digest to the cache, if the file was not modified while it was read
+ * @param entry is a pointer to the files list entry
+ * @param file_stat is a pointer to the result of stat on the file, before its digest was computed
+ */
+static void store_digest(files_list_entry_t *entry, struct stat *file_stat) {
+    struct stat after_digest;
+    checksum_cache_key_t cache_key;
+    checksum_cache_key_t after_digest_key;
+    make_checksum_cache_key(file_stat, &cache_key);
+    if (stat(entry->path_and_name, &after_digest) == 0) {
+        make_checksum_cache_key(&after_digest, &after_digest_key);
+        if (memcmp(&cache_key, &after_digest_key, sizeof(cache_key)) == 0) {
+            checksum_cache_store(&cache_key, entry->digest);
+        }
+    }
+}
+
 
 /*!
  * @brief get_file_stats gets all of the required information for a file (inc. directories)
@@ -20,7 +106,8 @@
  *   - mtime (in nanoseconds)
  *   - size
  *   - entry type (FICHIER)
- *   - MD5 sum
+ *   - device, inode and number of links, to copy the hard links of a file once
+ *   - digest when it is in the cache (the others are computed on demand, @see compute_entries_digests )
  * - for directories:
  *   - mode
  *   - entry type (DOSSIER)
@@ -29,103 +116,510 @@
 int get_file_stats(files_list_entry_t *entry) {
     struct stat buffer_type;
 
-    files_list_entry_t *pointeur = entry;                  //Définition d'un pointeur vers l'élément de la liste chaînée actuellement traité par la boucle while
+    if (stat(entry->path_and_name, &buffer_type) == -1) {   //Si erreur avec le fichier
+        printf("Error getting file stats.\n");
+        return -1;
+    }
+
+    return apply_file_stats(entry, &buffer_type);
+}
 
-    while (pointeur != NULL) {
-        stat(pointeur->path_and_name, &buffer_type);
 
-        if (&buffer_type != NULL) {                         //Si erreur avec le fichier dans le buffer
-            printf("Error getting file stats.\n");
-            return -1;
+/*!
+ * @brief open_parent_directories opens the directory of each entry, once for consecutive entries of the same directory
+ * Listed entries come by directory, so that each file is then found by a single lookup of its name in its directory.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param directories is an array receiving the descriptor of the directory of each entry (AT_FDCWD when it could not be opened)
+ * @param names is an array receiving the name of each entry, relative to its directory (its full path with AT_FDCWD)
+ */
+static void open_parent_directories(files_list_entry_t **entries, size_t count, int *directories, char **names) {
+    for (size_t i = 0; i < count; ++i) {
+        char *path = entries[i]->path_and_name;
+        char *last_slash = strrchr(path, '/');
+        size_t parent_length = (last_slash != NULL) ? (size_t) (last_slash - path) : 0;
+        directories[i] = AT_FDCWD;
+        names[i] = path;
+        if (last_slash == NULL || last_slash[1] == '\0') {
+            continue;
+        }
+        //Même répertoire que l'entrée précédente : son descripteur est repris
+        if (i > 0 && directories[i - 1] != AT_FDCWD && names[i - 1] - entries[i - 1]->path_and_name == (ptrdiff_t) parent_length + 1
+            && memcmp(entries[i - 1]->path_and_name, path, parent_length + 1) == 0) {
+            directories[i] = directories[i - 1];
+            names[i] = last_slash + 1;
+            continue;
+        }
+        char parent[PATH_SIZE];
+        if (parent_length == 0) {
+            strcpy(parent, "/");
+        } else if (parent_length < PATH_SIZE) {
+            memcpy(parent, path, parent_length);
+            parent[parent_length] = '\0';
+        } else {
+            continue;
+        }
+        directories[i] = open(parent, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (directories[i] == -1) {
+            directories[i] = AT_FDCWD; // Chemin complet, l'erreur éventuelle est donnée par stat
         } else {
-            if (S_ISREG(buffer_type.st_mode)) {             //Si le fichier est un fichier ordinaire
-                // Type du fichier
-                pointeur->entry_type = FICHIER;
+            names[i] = last_slash + 1;
+        }
+    }
+}
+
+
+/*!
+ * @brief stat_entries gets the stats of several entries, all at once with io_uring
+ * Each file is found relative to its directory, opened once for all its entries ( @see open_parent_directories ).
+ * Symbolic links are not followed: the listers only keep directories and regular files.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param stats is an array receiving the stats of each entry
+ * @param errors is an array receiving 0 for each entry whose stats were got, its errno value else
+ */
+static void stat_entries(files_list_entry_t **entries, size_t count, struct stat *stats, int *errors) {
+    int directories[count];
+    char *names[count];
+    open_parent_directories(entries, count, directories, names);
+
+    if (async_stat_at(directories, names, count, stats, errors) == -1) {
+        //Sans io_uring : un appel bloquant par entrée
+        for (size_t i = 0; i < count; ++i) {
+            errors[i] = (fstatat(directories[i], names[i], &stats[i], AT_SYMLINK_NOFOLLOW) == -1) ? errno : 0;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (directories[i] != AT_FDCWD && (i + 1 == count || directories[i + 1] != directories[i])) {
+            close(directories[i]);
+        }
+    }
+}
+
+
+/*!
+ * @brief get_entries_stats gets the information of several entries, as get_file_stats does for each of them
+ * With io_uring, the stats of all the entries are asked at once.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param is_ok is an array receiving true for each entry whose information was got
+ * @return the number of entries in error
+ */
+size_t get_entries_stats(files_list_entry_t **entries, size_t count, bool *is_ok) {
+    size_t failures = 0;
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t start_ns = stats_now();
+    struct stat stats[count];
+    int errors[count];
+    stat_entries(entries, count, stats, errors);
+
+    uint64_t types_counts[3] = {0, 0, 0}; // Fichiers, répertoires, autres
+    for (size_t i = 0; i < count; ++i) {
+        if (errors[i] != 0) {
+            printf("Error getting file stats.\n");
+        }
+        is_ok[i] = (errors[i] == 0 && apply_file_stats(entries[i], &stats[i]) == 0);
+        failures += !is_ok[i];
+        if (is_ok[i]) {
+            ++types_counts[(entries[i]->entry_type == FICHIER) ? 0 : (entries[i]->entry_type == DOSSIER) ? 1 : 2];
+        }
+    }
+    if (stats_enabled()) {
+        add_stat(STATS_FILES, types_counts[0]);
+        add_stat(STATS_DIRECTORIES, types_counts[1]);
+        add_stat(STATS_OTHER_ENTRIES, types_counts[2]);
+        add_stat_since(STATS_ANALYSIS_NS, start_ns);
+    }
+    return failures;
+}
 
 
-                //Métadonnées fichier
-                pointeur->mtime.tv_nsec = buffer_type.st_mtimensec;
+/*!
+ * @brief compute_entries_digests computes the digests of files on demand, and adds them to the cache
+ * The digests are computed together when possible ( @see compute_files_digests ).
+ * @param entries is an array of pointers to the entries, whose sizes are known
+ * @param count is the number of entries
+ * @return the number of entries whose digest could not be computed (ENTRY_HAS_DIGEST is not set for them)
+ */
+size_t compute_entries_digests(files_list_entry_t **entries, size_t count) {
+    size_t failures = 0;
+    if (count == 0) {
+        return 0;
+    }
+    struct stat stats[count];
+    int errors[count];
+    bool is_ok[count];
+    stat_entries(entries, count, stats, errors);
+
+    compute_files_digests(entries, count, is_ok);
+    for (size_t i = 0; i < count; ++i) {
+        if (!is_ok[i]) {
+            ++failures;
+            continue;
+        }
+        entries[i]->digest_flags |= ENTRY_HAS_DIGEST;
+        if (errors[i] == 0) {
+            store_digest(entries[i], &stats[i]);
+        }
+    }
+    return failures;
+}
 
-                pointeur->size = buffer_type.st_size;
 
-                //Permissions fichier
-                pointeur->mode = buffer_type.st_mode & 0777;
+/*!
+ * @brief read_block reads a whole block of a file at a position
+ * @param fd is the descriptor of the file
+ * @param buffer receives the block
+ * @param length is the size of the block
+ * @param offset is the position of the block
+ * @return 0 in case of success, -1 else (error, or end of file before the end of the block)
+ */
+static int read_block(int fd, uint8_t *buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t bytes = pread(fd, buffer + done, length - done, offset + done);
+        if (bytes == 0) {
+            return -1;
+        }
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += bytes;
+    }
+    return 0;
+}
 
-                // Somme MD5 fichier
-                compute_file_md5(pointeur);
 
+/*!
+ * @brief compute_file_sample computes the sample digest of a file: XXH64 of its size and of its first, middle and last blocks
+ * Two files of the same size with different samples differ: their digests do not have to be computed.
+ * @param entry is a pointer to the entry, whose size is known
+ * @return 0 in case of success, -1 else
+ */
+static int compute_file_sample(files_list_entry_t *entry) {
+    static __thread uint8_t buffer[DIGEST_SAMPLE_BLOCK_SIZE];
+    hash_context_t context;
+    uint8_t digest[HASH_MAX_DIGEST_SIZE];
+    int fd = open(entry->path_and_name, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (hash_init(&context, HASH_XXH64) == -1) {
+        close(fd);
+        return -1;
+    }
+    hash_update(&context, &entry->size, sizeof(entry->size));
+
+    //Blocs de début, de milieu et de fin (ou tout le fichier s'il est plus petit que trois blocs)
+    uint64_t block_size = (entry->size < sizeof(buffer)) ? entry->size : sizeof(buffer);
+    uint64_t offsets[3] = {0, (entry->size / 2) / sizeof(buffer) * sizeof(buffer), entry->size - block_size};
+    int blocks_count = (entry->size <= 3 * sizeof(buffer)) ? 0 : 3;
+    int result = 0;
+    for (int i = 0; i < blocks_count && result == 0; ++i) {
+        result = read_block(fd, buffer, block_size, offsets[i]);
+        hash_update(&context, buffer, block_size);
+    }
+    for (uint64_t offset = 0; blocks_count == 0 && result == 0 && offset < entry->size; offset += sizeof(buffer)) {
+        size_t length = (entry->size - offset < sizeof(buffer)) ? entry->size - offset : sizeof(buffer);
+        result = read_block(fd, buffer, length, offset);
+        hash_update(&context, buffer, length);
+    }
+    close(fd);
+    hash_final(&context, digest);
+    add_stat(STATS_SAMPLED_BYTES, (blocks_count == 0) ? entry->size : 3 * block_size);
+    if (result == 0) {
+        memcpy(&entry->sample_digest, digest, sizeof(entry->sample_digest));
+        entry->digest_flags |= ENTRY_HAS_SAMPLE;
+    }
+    return result;
+}
 
-            } else if (S_ISDIR(buffer_type.st_mode)) {              //Si le fichier est un répertoire
-                // Mode pour les dossiers
-                pointeur->entry_type = DOSSIER;
 
-                //Permissions répertoire
-                pointeur->mode = buffer_type.st_mode & 0777;
+/*!
+ * @brief compute_entries_samples computes the sample digests of several files ( @see compute_file_sample )
+ * @param entries is an array of pointers to the entries, whose sizes are known
+ * @param count is the number of entries
+ * @return the number of entries whose sample could not be computed (ENTRY_HAS_SAMPLE is not set for them)
+ */
+size_t compute_entries_samples(files_list_entry_t **entries, size_t count) {
+    size_t failures = 0;
+    for (size_t i = 0; i < count; ++i) {
+        failures += (compute_file_sample(entries[i]) == -1);
+    }
+    return failures;
+}
 
 
-            } else {
-                //Fichier qui n'est ni un fichier régulier ni un répertoire
-                printf("Unsupported file type\n");
-                return -1;
+/*!
+ * @brief read_small_file reads a whole file whose size is known
+ * @param path is the path of the file
+ * @param buffer receives the content, it must hold expected_size + 1 bytes
+ * @param expected_size is the size of the file when it was listed
+ * @return 0 if the file was read and still has this size, -1 else
+ */
+static int read_small_file(char *path, uint8_t *buffer, size_t expected_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done <= expected_size) { // Un octet de plus : un fichier qui a grandi est détecté
+        ssize_t bytes = read(fd, buffer + done, expected_size + 1 - done);
+        if (bytes == 0) {
+            break;
+        }
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            break;
+        }
+        done += bytes;
+    }
+    close(fd);
+    return (done == expected_size) ? 0 : -1;
+}
+
+
+/*!
+ * @brief compute_files_digests computes the digests of several files, whose sizes are already in their entries
+ * With MD5, the small files are read in memory, then hashed together by the multi-buffer kernel ( @see md5_multi_buffer ).
+ * The other files are hashed one by one by compute_file_digest.
+ * @param entries is an array of pointers to the entries
+ * @param count is the number of entries
+ * @param is_ok is an array receiving true for each entry whose digest was computed
+ */
+void compute_files_digests(files_list_entry_t **entries, size_t count, bool *is_ok) {
+    if (count == 0) {
+        return;
+    }
+    size_t small_indexes[count];
+    size_t small_count = 0;
+    size_t small_bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (get_hash_algorithm() == HASH_MD5 && entries[i]->size <= MULTI_HASH_MAX_FILE_SIZE) {
+            small_indexes[small_count++] = i;
+            small_bytes += entries[i]->size + 1;
+        } else {
+            is_ok[i] = (compute_file_digest(entries[i]) == 0);
+        }
+    }
+
+    uint8_t *buffer = (small_count > 1) ? malloc(small_bytes) : NULL;
+    if (buffer == NULL) {
+        for (size_t i = 0; i < small_count; ++i) {
+            is_ok[small_indexes[i]] = (compute_file_digest(entries[small_indexes[i]]) == 0);
         }
+        return;
+    }
 
-        //Passage à l'élément suivant
-        pointeur = pointeur->next;
+    //Lecture des petits fichiers ; ceux qui ont changé de taille depuis leur analyse sont traités à part
+    const uint8_t *messages[small_count];
+    size_t lengths[small_count];
+    size_t hashed_indexes[small_count];
+    size_t hashed_count = 0;
+    uint8_t *position = buffer;
+    for (size_t i = 0; i < small_count; ++i) {
+        files_list_entry_t *entry = entries[small_indexes[i]];
+        if (read_small_file(entry->path_and_name, position, entry->size) == -1) {
+            is_ok[small_indexes[i]] = (compute_file_digest(entry) == 0);
+            continue;
+        }
+        messages[hashed_count] = position;
+        lengths[hashed_count] = entry->size;
+        hashed_indexes[hashed_count++] = small_indexes[i];
+        position += entry->size + 1;
     }
 
-        return 0;
+    uint8_t (*digests)[16] = malloc(hashed_count * 16 + 1);
+    if (digests == NULL) {
+        for (size_t i = 0; i < hashed_count; ++i) {
+            is_ok[hashed_indexes[i]] = (compute_file_digest(entries[hashed_indexes[i]]) == 0);
+        }
+        free(buffer);
+        return;
+    }
+    md5_multi_buffer(messages, lengths, hashed_count, digests);
+    for (size_t i = 0; i < hashed_count; ++i) {
+        add_stat(STATS_HASHED_BYTES, lengths[i]);
+    }
+    for (size_t i = 0; i < hashed_count; ++i) {
+        files_list_entry_t *entry = entries[hashed_indexes[i]];
+        memset(entry->digest, 0, sizeof(entry->digest));
+        memcpy(entry->digest, digests[i], 16);
+        is_ok[hashed_indexes[i]] = true;
+    }
+    free(digests);
+    free(buffer);
+}
+
+
+/*!
+ * @brief digest_update adds a block of a file read by async_read_file to its digest
+ * @param context is a pointer to the tree_hash_context_t
+ * @param data is a pointer to the block
+ * @param length is the size of the block
+ */
+static void digest_update(void *context, const void *data, size_t length) {
+    tree_hash_update((tree_hash_context_t *) context, data, length);
+}
+
+
+/*!
+ * @brief finish_digest finishes the digest of a file and keeps the digests of its chunks in its entry
+ * @param entry is a pointer to the files list entry
+ * @param context is a pointer to the digest of the file
+ * @param is_ok is false when the file could not be read: the digest is dropped
+ * @return 0 in case of success, -1 else
+ */
+static int finish_digest(files_list_entry_t *entry, tree_hash_context_t *context, bool is_ok) {
+    chunk_digests_t *chunks = tree_hash_final(context, entry->digest);
+    if (!is_ok) {
+        free_chunk_digests(chunks);
+        return -1;
+    }
+    free_chunk_digests(entry->chunks);
+    entry->chunks = chunks;
+    return 0;
 }
 
 
 /*!
- * @brief compute_file_md5 computes a file's MD5 sum
+ * @brief compute_file_digest computes a file's digest, with the algorithm chosen by --hash ( @see get_hash_algorithm )
+ * In the tree hash mode, the digest of a file larger than a chunk is the root of the digests of its chunks ( @see tree-hash.h ).
  * @param the pointer to the files list entry
  * @return -1 in case of error, 0 else
- * Use libcrypto functions from openssl/evp.h
  */
-int compute_file_md5(files_list_entry_t *entry) {
-    FILE *file = fopen(entry->path_and_name, "rb");
-    if (file == NULL) {
-        printf("Error opening file for MD5 calculation");
+int compute_file_digest(files_list_entry_t *entry) {
+    static __thread uint8_t buffer[HASH_READ_SIZE];
+    tree_hash_context_t context;
+    if (tree_hash_init(&context) == -1) {
+        printf("Error creating hash context");
         return -1;
     }
 
-    char *md5sum;
+    //Avec io_uring, le fichier est ouvert et lu par l'anneau, avec plusieurs lectures en cours à la fois
+    if (async_io_available()) {
+        if (async_read_file(entry->path_and_name, digest_update, &context) == -1) {
+            printf("Error reading file for hash calculation");
+            return finish_digest(entry, &context, false);
+        }
+        add_stat(STATS_HASHED_BYTES, entry->size);
+        return finish_digest(entry, &context, true);
+    }
+
+    int fd = open(entry->path_and_name, O_RDONLY);
+    if (fd == -1) {
+        printf("Error opening file for hash calculation");
+        return finish_digest(entry, &context, false);
+    }
+
+    ssize_t bytes;
+    bool is_ok = true;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error reading file for hash calculation");
+            is_ok = false;
+            break;
+        }
+        is_ok = is_ok && tree_hash_update(&context, buffer, bytes) == 0;
+    }
+    close(fd);
 
-    EVP_MD_CTX *mdctx;
-    const EVP_MD *md;
-    unsigned char md_value[EVP_MAX_MD_SIZE];
-    unsigned int md_len;
+    // Empreinte conservée en binaire, complétée par des zéros après hash_digest_size octets
+    add_stat(STATS_HASHED_BYTES, entry->size);
+    return finish_digest(entry, &context, is_ok);
+}
 
-    md = EVP_md5();
-    mdctx = EVP_MD_CTX_new();
 
-    if (mdctx == NULL) {
-        printf("Error creating MD5 context");
-        fclose(file);
+/*!
+ * @brief begin_chunked_digest prepares the digest of a large file whose chunks are hashed separately, possibly by several threads
+ * @param entry is a pointer to the entry, whose size is known
+ * @param file_stat receives the stats of the file before it is read, for the cache
+ * @return 0 in case of success, -1 else (the file is not hashed as a tree, or out of memory)
+ */
+int begin_chunked_digest(files_list_entry_t *entry, struct stat *file_stat) {
+    size_t count = tree_hash_chunks_count(entry->size);
+    if (count == 0 || stat(entry->path_and_name, file_stat) == -1) {
         return -1;
     }
+    free_chunk_digests(entry->chunks);
+    entry->chunks = new_chunk_digests(count);
+    return (entry->chunks == NULL) ? -1 : 0;
+}
 
-    EVP_DigestInit_ex(mdctx, md, NULL);
-
-    char buffer[1024];
-    size_t bytes;
 
-    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) != 0) {
-        EVP_DigestUpdate(mdctx, buffer, bytes);
+/*!
+ * @brief compute_range_digest computes the digest of a range of a file, as the digest of a chunk of the tree hash mode
+ * @param path is the path of the file
+ * @param offset is the position of the range
+ * @param length is the size of the range
+ * @param digest receives the digest
+ * @return 0 in case of success, -1 else (the file could not be read up to the end of the range)
+ */
+int compute_range_digest(char *path, uint64_t offset, uint64_t length, uint8_t digest[HASH_MAX_DIGEST_SIZE]) {
+    static __thread uint8_t buffer[HASH_READ_SIZE];
+    hash_context_t context;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || hash_init(&context, get_hash_algorithm()) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    int result = 0;
+    for (uint64_t done = 0; done < length && result == 0; done += sizeof(buffer)) {
+        size_t part = (length - done < sizeof(buffer)) ? length - done : sizeof(buffer);
+        result = read_block(fd, buffer, part, offset + done);
+        hash_update(&context, buffer, part);
     }
+    close(fd);
+    hash_final(&context, digest);
+    add_stat(STATS_HASHED_BYTES, length);
+    return result;
+}
 
-    EVP_DigestFinal_ex(mdctx, md_value, &md_len);
 
-    EVP_MD_CTX_free(mdctx);
-    fclose(file);
+/*!
+ * @brief compute_chunk_digest computes the digest of a chunk of a file prepared by begin_chunked_digest
+ * Several threads may compute different chunks of the same file at once.
+ * @param entry is a pointer to the entry
+ * @param index is the index of the chunk
+ */
+void compute_chunk_digest(files_list_entry_t *entry, size_t index) {
+    uint64_t chunk_size = get_tree_hash_chunk_size();
+    uint64_t offset = index * chunk_size;
+    uint64_t length = (entry->size - offset < chunk_size) ? entry->size - offset : chunk_size;
+    if (compute_range_digest(entry->path_and_name, offset, length, entry->chunks->digests[index]) == -1) {
+        __atomic_add_fetch(&entry->chunks->failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
 
-    // Convertir la somme MD5 en format hexadécimal
-    for (unsigned int i = 0; i < md_len; i++) {
-        sprintf(&entry->md5sum[i * 2], "%02x", md_value[i]);
+/*!
+ * @brief end_chunked_digest combines the digests of the chunks of a file into its digest, and adds it to the cache
+ * @param entry is a pointer to the entry, whose chunks were all computed
+ * @param file_stat is a pointer to the stats given by begin_chunked_digest
+ * @return 0 in case of success, -1 else (a chunk could not be read)
+ */
+int end_chunked_digest(files_list_entry_t *entry, struct stat *file_stat) {
+    if (entry->chunks->failures != 0) {
+        free_chunk_digests(entry->chunks);
+        entry->chunks = NULL;
+        return -1;
     }
-    entry->md5sum[md_len * 2] = '\0';
+    tree_hash_root(entry->chunks, entry->digest);
+    entry->digest_flags |= ENTRY_HAS_DIGEST;
+    store_digest(entry, file_stat);
     return 0;
 }
 
@@ -161,66 +655,20 @@ bool directory_exists(char *path_to_dir) {
  * Hint: try to open a file in write mode in the target directory.
  */
 bool is_directory_writable(char *path_to_dir) {
-
-
-    //Définition du fichier à ouvrir
-    DIR *directory = opendir(path_to_dir); // Ouvre le dossier spécifié
-    if (directory == NULL) {
-        perror("Error opening directory");
+    //Création d'un fichier temporaire unique dans le répertoire : aucun fichier existant n'est touché
+    char test_file_path[PATH_SIZE];
+    if (concat_path(test_file_path, path_to_dir, ".lp25-backup-XXXXXX") == NULL) {
         return false;
     }
-    struct dirent *entry;
-    char chemin_abs_fichier[4096];
-
-
-    bool sur_fichier_exploitable = false;
 
-    while (!sur_fichier_exploitable) {
-
-        entry = readdir(directory);
-        if (entry == NULL) {
-            // End of directory reached
-            break;
-        }
-
-
-        if (strcmp(entry->d_name, ".") == 0 ||
-            strcmp(entry->d_name, "..") == 0) { // On ignore les dossiers spéciaux "." and ".."
-            continue;
-        }
-
-        snprintf(chemin_abs_fichier, sizeof(chemin_abs_fichier), "%s/%s", path_to_dir,
-                 entry->d_name); // Construction du chemin absolu
-
-        struct stat file_stat;
-        if (stat(chemin_abs_fichier, &file_stat) != 0) { // Appel de stat pour obtenir des informations
-            perror("Error getting file information");
-            continue;
-        }
-
-
-        if (S_ISREG(file_stat.st_mode)) { // Si fichier ordinaire
-            sur_fichier_exploitable = true;
-        }
+    int test_fd = mkstemp(test_file_path);
+    if (test_fd == -1) {
+        //Le fichier ne peut pas être créé, donc le répertoire n'est pas en mode writable
+        return false;
     }
 
-
-    // Ouvrir ce fichier
-    FILE *file = fopen(chemin_abs_fichier, "w");
-
-    // Vérification de si l'ouverture a réussi
-    if (file == NULL) {
-        //Le fichier n'est pas rédigeable, donc le répertoire n'est pas en mode writable
-
-        //Fermeture du ficher (à ne pas oublier !)
-        fclose(file);
-        //Fermeture du répertoire (à ne pas oublier aussi !)
-        closedir(directory);
-
-
-        closedir(directory); // Fermeture du répertoire ouvert
-
-
-    }
-    return sur_fichier_exploitable;
+    //Fermeture et suppression du fichier de test (à ne pas oublier !)
+    close(test_fd);
+    unlink(test_file_path);
+    return true;
 }
@@ -3,8 +3,24 @@
 #include <files-list.h>
 #include <stdbool.h>
 #include <configuration.h>
+#include <sys/stat.h>
+
+// Entries given at once to get_entries_stats by the lists and analyzers
+#define FILE_STATS_BATCH 64
+// Bytes read at once to compute a digest
+#define HASH_READ_SIZE (128 * 1024)
+// Blocks read for the sample digest of a file, which is read whole up to three blocks
+#define DIGEST_SAMPLE_BLOCK_SIZE (16 * 1024)
 
 int get_file_stats(files_list_entry_t *entry);
-int compute_file_md5(files_list_entry_t *entry);
+int compute_file_digest(files_list_entry_t *entry);
+size_t get_entries_stats(files_list_entry_t **entries, size_t count, bool *is_ok);
+void compute_files_digests(files_list_entry_t **entries, size_t count, bool *is_ok);
+size_t compute_entries_digests(files_list_entry_t **entries, size_t count);
+size_t compute_entries_samples(files_list_entry_t **entries, size_t count);
+int begin_chunked_digest(files_list_entry_t *entry, struct stat *file_stat);
+void compute_chunk_digest(files_list_entry_t *entry, size_t index);
+int compute_range_digest(char *path, uint64_t offset, uint64_t length, uint8_t digest[HASH_MAX_DIGEST_SIZE]);
+int end_chunked_digest(files_list_entry_t *entry, struct stat *file_stat);
 bool directory_exists(char *path_to_dir);
 bool is_directory_writable(char *path_to_dir);
\ No newline at end of file
@@ -1,24 +1,81 @@
+#define _GNU_SOURCE
 
 #include <files-list.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <defines.h>
 
 
 
 
+/*!
+ * @brief init_files_list initializes an empty files list
+ * @param list is a pointer to the list to be initialized
+ */
+void init_files_list(files_list_t *list) {
+    list->head = NULL;
+    list->tail = NULL;
+    list->free_entries = NULL;
+    init_arena(&list->storage);
+}
+
+
 /*!
  * @brief clear_files_list clears a files list
  * @param list is a pointer to the list to be cleared
- * This function is provided, you don't need to implement nor modify it
+ * The entries and their paths are all released at once with the arena of the list
  */
 void clear_files_list(files_list_t *list) {
-    while (list->head) {
-        files_list_entry_t *tmp = list->head;
-        list->head = tmp->next;
-        free(tmp);
+    //Seuls les morceaux des fichiers hachés en arbre sont hors de l'arène
+    for (files_list_entry_t *entry = list->head; entry != NULL; entry = entry->next) {
+        free_chunk_digests(entry->chunks);
+    }
+    list->head = NULL;
+    list->tail = NULL;
+    list->free_entries = NULL;
+    clear_arena(&list->storage);
+}
+
+
+/*!
+ * @brief new_file_entry allocates an entry in the arena of the list, with its path copied just after it
+ * Entries created one after the other (e.g. the files of a directory) are thus contiguous in memory.
+ * @param list the list that will own the entry
+ * @param file_path the full path of the file
+ * @param path_length the length of file_path
+ * @return a pointer to the new entry, NULL if out of memory or if the path is too long
+ */
+static files_list_entry_t *new_file_entry(files_list_t *list, char *file_path, size_t path_length) {
+    if (path_length >= PATH_SIZE) {
+        return NULL;
+    }
+    files_list_entry_t *new_entry = list->free_entries;
+    if (new_entry != NULL) { // Réutilisation d'une entrée retirée de la liste
+        list->free_entries = new_entry->next;
+    } else {
+        new_entry = arena_alloc(&list->storage, sizeof(files_list_entry_t), _Alignof(files_list_entry_t));
+        if (new_entry == NULL) {
+            return NULL;
+        }
     }
+    new_entry->path_and_name = arena_strndup(&list->storage, file_path, path_length);
+    if (new_entry->path_and_name == NULL) {
+        new_entry->next = list->free_entries;
+        list->free_entries = new_entry;
+        return NULL;
+    }
+    new_entry->path_length = path_length;
+    new_entry->digest_flags = 0;
+    new_entry->chunks = NULL;
+    new_entry->device = 0;
+    new_entry->inode = 0;
+    new_entry->links_count = 1;
+    new_entry->next = NULL;
+    new_entry->prev = NULL;
+    return new_entry;
 }
 
 
@@ -44,7 +101,7 @@ files_list_entry_t *add_file_entry(files_list_t *list, char *file_path) {
         existing_entry = existing_entry->next; // Incrémentation de la variable de parcours
     }
 
-    files_list_entry_t *new_entry = malloc(sizeof(files_list_entry_t)); // Créer une nouvelle entrée temporaire (parcours de la liste)
+    files_list_entry_t *new_entry = new_file_entry(list, file_path, strlen(file_path)); // Créer une nouvelle entrée temporaire (parcours de la liste)
     if (new_entry == NULL) {
         return NULL; // Erreur d'allocation donc sortie de fonction
     }
@@ -59,11 +116,10 @@ files_list_entry_t *add_file_entry(files_list_t *list, char *file_path) {
         new_entry->next = NULL; // Pas de suivante car fin de liste
         if (list->head == NULL) { // Verifie si liste vide (ajouter en tête)
             list->head = new_entry; // Ajouter en tête
-        } else if (list->tail != NULL) { // Si la queue de liste n'est pas vide
-            list->tail->next = new_entry; // Ajouter en queue
         } else {
-            list->tail = new_entry; // Si la queue de liste est vide
+            list->tail->next = new_entry; // Ajouter en queue
         }
+        list->tail = new_entry; // Le nouvel élément est la nouvelle queue
     } else { // Ajouter entre deux éléments
         new_entry->prev = temp->prev; // gestion des listes
         new_entry->next = temp;
@@ -91,7 +147,9 @@ int add_entry_to_tail(files_list_t *list, files_list_entry_t *entry) {
         return -1; // Si paramètres invalides
     }
 
+    entry->next = NULL; // L'élément devient la nouvelle queue
     if (list->head == NULL) { // La liste est vide
+        entry->prev = NULL;
         list->head = entry; // Ajoute de l'élément en tête de liste car liste vide
         list->tail = entry; // Ajout de l'élément en queue
     } else {
@@ -103,6 +161,93 @@ int add_entry_to_tail(files_list_t *list, files_list_entry_t *entry) {
 }
 
 
+/*!
+ * @brief append_file_entry creates an entry for a file and adds it to the tail of the list
+ * The path is copied into the arena of the list, the other fields are left to the caller.
+ * @param list the list to add the file entry into
+ * @param file_path the full path of the file
+ * @param path_length the length of file_path
+ * @return a pointer to the added element if success, NULL else (out of memory or path too long)
+ */
+files_list_entry_t *append_file_entry(files_list_t *list, char *file_path, size_t path_length) {
+    if (list == NULL || file_path == NULL) {
+        return NULL;
+    }
+    files_list_entry_t *new_entry = new_file_entry(list, file_path, path_length);
+    if (new_entry != NULL) {
+        add_entry_to_tail(list, new_entry);
+    }
+    return new_entry;
+}
+
+
+/*!
+ * @brief remove_file_entry takes an entry out of a list and keeps it for reuse by the list
+ * Its path stays in the arena of the list until the list is cleared
+ * @param list the list that contains the entry
+ * @param entry the entry to remove
+ */
+void remove_file_entry(files_list_t *list, files_list_entry_t *entry) {
+    if (list == NULL || entry == NULL) {
+        return;
+    }
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        list->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        list->tail = entry->prev;
+    }
+    free_chunk_digests(entry->chunks);
+    entry->chunks = NULL;
+    entry->next = list->free_entries;
+    list->free_entries = entry;
+}
+
+
+/*!
+ * @brief move_files_list moves all the entries of a list to the tail of another one, with the memory holding them
+ * Nothing is copied: the arena chunks of the source list are handed over. The source list is left empty.
+ * @param list is a pointer to the list receiving the entries
+ * @param other is a pointer to the list giving its entries
+ */
+void move_files_list(files_list_t *list, files_list_t *other) {
+    if (list == NULL || other == NULL || other->head == NULL) {
+        return;
+    }
+    if (list->tail != NULL) {
+        list->tail->next = other->head;
+        other->head->prev = list->tail;
+    } else {
+        list->head = other->head;
+    }
+    list->tail = other->tail;
+    // Les entrées retirées restent réutilisables par la liste qui reçoit leur mémoire
+    while (other->free_entries != NULL) {
+        files_list_entry_t *free_entry = other->free_entries;
+        other->free_entries = free_entry->next;
+        free_entry->next = list->free_entries;
+        list->free_entries = free_entry;
+    }
+    arena_absorb(&list->storage, &other->storage);
+    other->head = NULL;
+    other->tail = NULL;
+}
+
+
+/*!
+ * @brief files_list_memory_peak gives the highest amount of memory reserved by a list
+ * @param list is a pointer to the list
+ * @return the peak size in bytes of the arena of the list, kept after clear_files_list
+ */
+size_t files_list_memory_peak(files_list_t *list) {
+    return (list != NULL) ? list->storage.peak_reserved_size : 0;
+}
+
+
 /*!
  *  @brief find_entry_by_name looks up for a file in a list
  *  The function uses the ordering of the entries to interrupt its search
@@ -124,7 +269,7 @@ files_list_entry_t *find_entry_by_name(files_list_t *list, char *file_path, size
         size_t i = start_of_src; // Deux variables pour parcourir les chemins du fichier cherché et de ceux de la liste
         size_t j = start_of_dest;
 
-        while (i < strlen(temp->path_and_name) && j < file_path_length) {
+        while (i < temp->path_length && j < file_path_length) {
             char list_char = temp->path_and_name[i]; // incrémentation des caractères des chemin comparés
             char search_char = file_path[j];
 
@@ -145,6 +290,67 @@ files_list_entry_t *find_entry_by_name(files_list_t *list, char *file_path, size
 }
 
 
+/*!
+ * @brief compare_relative_paths compares two entries on their relative paths, for qsort_r
+ * @param lhd a pointer to a pointer to the first entry
+ * @param rhd a pointer to a pointer to the second entry
+ * @param start_of_path a pointer to the position of the relative path in the entries' paths
+ * @return the result of strcmp on the relative paths
+ */
+static int compare_relative_paths(const void *lhd, const void *rhd, void *start_of_path) {
+    size_t start = *(size_t *) start_of_path;
+    return strcmp((*(files_list_entry_t **) lhd)->path_and_name + start, (*(files_list_entry_t **) rhd)->path_and_name + start);
+}
+
+
+/*!
+ * @brief sort_files_list sorts a files list on the paths of its entries relative to the root of the tree
+ * The entries are sorted through an array of pointers (much fewer cache misses than sorting the chained
+ * list in place), then chained again in order. An already ordered list is detected in a single pass.
+ * @param list is a pointer to the list to sort
+ * @param start_of_path the position of the relative path in the entries' paths (@see path_root_length)
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+int sort_files_list(files_list_t *list, size_t start_of_path) {
+    if (list == NULL || list->head == NULL) {
+        return 0;
+    }
+
+    size_t entries_count = 1;
+    bool is_sorted = true; // Cas courant : la liste a été construite dans l'ordre
+    for (files_list_entry_t *cursor = list->head; cursor->next != NULL; cursor = cursor->next) {
+        if (is_sorted && strcmp(cursor->path_and_name + start_of_path, cursor->next->path_and_name + start_of_path) > 0) {
+            is_sorted = false;
+        }
+        ++entries_count;
+    }
+    if (is_sorted) {
+        return 0;
+    }
+
+    files_list_entry_t **entries = malloc(sizeof(files_list_entry_t *) * entries_count);
+    if (entries == NULL) {
+        return -1;
+    }
+    size_t i = 0;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        entries[i++] = cursor;
+    }
+
+    qsort_r(entries, entries_count, sizeof(files_list_entry_t *), compare_relative_paths, &start_of_path);
+
+    // Chaînage des entrées dans l'ordre trié
+    for (i = 0; i < entries_count; ++i) {
+        entries[i]->prev = (i > 0) ? entries[i - 1] : NULL;
+        entries[i]->next = (i + 1 < entries_count) ? entries[i + 1] : NULL;
+    }
+    list->head = entries[0];
+    list->tail = entries[entries_count - 1];
+    free(entries);
+    return 0;
+}
+
+
 /*!
  * @brief display_files_list displays a files list
  * @param list is the pointer to the list to be displayed
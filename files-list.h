@@ -6,18 +6,34 @@
 #include <stdint.h>
 #include <time.h>
 #include <sys/types.h>
+#include <stddef.h>
+#include <arena.h>
+#include <hash.h>
+#include <tree-hash.h>
 
 
 typedef enum { FICHIER, DOSSIER } file_type_t;
 
+// Bits of digest_flags: which digests of a file entry are known. They are computed on demand, when the
+// comparison of a pair of files needs them ( @see diff_files_lists ), or taken from the digests cache.
+#define ENTRY_HAS_DIGEST 1 // digest holds the digest of the whole file
+#define ENTRY_HAS_SAMPLE 2 // sample_digest holds the digest of the first, middle and last blocks
+
 
 typedef struct _files_list_entry {
-  char path_and_name[4096];
+  char *path_and_name; // Stored in the arena of the list, right after the entry
   struct timespec mtime;
   uint64_t size;
-  uint8_t md5sum[16];
+  uint64_t device; // Identity of the inode of a file, shared by all its hard links (0 for directories)
+  uint64_t inode;
+  uint32_t links_count; // Names of the inode, 1 when the file has no other hard link
+  uint8_t digest[HASH_MAX_DIGEST_SIZE]; // Of the algorithm chosen with --hash ( @see hash_algorithm_t )
+  uint64_t sample_digest; // XXH64 of the size and of a few blocks ( @see compute_entries_samples )
+  chunk_digests_t *chunks; // Digests of the chunks when the file was hashed as a tree ( @see tree-hash.h ), NULL else
   file_type_t entry_type;
   mode_t mode;
+  uint16_t path_length;
+  uint8_t digest_flags; // ENTRY_HAS_DIGEST, ENTRY_HAS_SAMPLE
   struct _files_list_entry *next;
   struct _files_list_entry *prev;
 } files_list_entry_t;
@@ -26,17 +42,31 @@ typedef struct _files_list_entry {
 typedef struct {
   struct _files_list_entry *head;
   struct _files_list_entry *tail;
+  arena_t storage; // Owns the entries and their paths
+  struct _files_list_entry *free_entries; // Removed entries, reused before taking memory from the arena
 } files_list_t;
 
 
+void init_files_list(files_list_t *list);
+
 void clear_files_list(files_list_t *list);
 
 files_list_entry_t *add_file_entry(files_list_t *list, char *file_path);
 
+files_list_entry_t *append_file_entry(files_list_t *list, char *file_path, size_t path_length);
+
+void remove_file_entry(files_list_t *list, files_list_entry_t *entry);
+
+void move_files_list(files_list_t *list, files_list_t *other);
+
+size_t files_list_memory_peak(files_list_t *list);
+
 int add_entry_to_tail(files_list_t *list, files_list_entry_t *entry);
 
 files_list_entry_t *find_entry_by_name(files_list_t *list, char *file_path, size_t start_of_src, size_t start_of_dest);
 
+int sort_files_list(files_list_t *list, size_t start_of_path);
+
 void display_files_list(files_list_t *list);
 
 void display_files_list_reversed(files_list_t *list);
@@ -0,0 +1,187 @@
+#include <hardlinks.h>
+#include <sync.h>
+#include <defines.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file copy each inode of the source once. The first name of an inode met by the
+// comparison is copied (or already up to date); its destination path is kept in a table indexed by
+// (device, inode), an open addressing table as the digests cache. The other names of the inode are
+// not copied: they are linked to this path once all the copies are done, since the copy of the first
+// name may still be in progress in a copy thread. A name whose link fails is copied as usual.
+// The functions are called by the main thread only ( @see apply_difference ).
+
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    char *destination_path; // NULL for an empty slot
+} hardlink_slot_t;
+
+// A name to link once the copies are done
+typedef struct {
+    files_list_entry_t entry; // A copy of the source entry, to copy it if the link fails
+    char *target; // Destination path of the first name, owned by the table
+    char *destination_path;
+} pending_link_t;
+
+static hardlink_slot_t *slots = NULL;
+static size_t slots_capacity = 0; // Power of two
+static size_t slots_count = 0;
+static pending_link_t *pending_links = NULL;
+static size_t pending_count = 0;
+static size_t pending_capacity = 0;
+
+/*!
+ * @brief find_slot looks for the slot of an inode in the table
+ * @param device is the device of the inode
+ * @param inode is the number of the inode
+ * @return a pointer to the slot of the inode, or to the empty slot where it would be inserted
+ */
+static hardlink_slot_t *find_slot(uint64_t device, uint64_t inode) {
+    size_t position = (size_t) ((inode ^ (device << 32)) * 0x9E3779B97F4A7C15ULL >> 16) & (slots_capacity - 1);
+    while (slots[position].destination_path != NULL && (slots[position].device != device || slots[position].inode != inode)) {
+        position = (position + 1) & (slots_capacity - 1);
+    }
+    return &slots[position];
+}
+
+/*!
+ * @brief grow_table doubles the capacity of the table (it is kept at most half full)
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+static int grow_table(void) {
+    size_t old_capacity = slots_capacity;
+    hardlink_slot_t *old_slots = slots;
+    size_t new_capacity = (old_capacity == 0) ? 256 : old_capacity * 2;
+    hardlink_slot_t *new_slots = calloc(new_capacity, sizeof(hardlink_slot_t));
+    if (new_slots == NULL) {
+        return -1;
+    }
+    slots = new_slots;
+    slots_capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].destination_path != NULL) {
+            *find_slot(old_slots[i].device, old_slots[i].inode) = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+/*!
+ * @brief first_name_of gives the destination path of the first name of an inode, or records it
+ * @param source_entry is a pointer to the source entry
+ * @param destination_path is the path of the entry in the destination
+ * @return the path of the first name, NULL if the entry is the first name (or out of memory)
+ */
+static char *first_name_of(files_list_entry_t *source_entry, char *destination_path) {
+    if (2 * (slots_count + 1) > slots_capacity && grow_table() == -1) {
+        return NULL;
+    }
+    hardlink_slot_t *slot = find_slot(source_entry->device, source_entry->inode);
+    if (slot->destination_path != NULL) {
+        return slot->destination_path;
+    }
+    slot->destination_path = strdup(destination_path);
+    if (slot->destination_path != NULL) {
+        slot->device = source_entry->device;
+        slot->inode = source_entry->inode;
+        ++slots_count;
+    }
+    return NULL;
+}
+
+/*!
+ * @brief note_hardlink records the destination of a name of an inode that is already up to date, so that its other names can be linked to it
+ * @param source_entry is a pointer to the source entry
+ * @param destination_path is the path of the entry in the destination
+ */
+void note_hardlink(files_list_entry_t *source_entry, char *destination_path) {
+    if (source_entry->entry_type == FICHIER && source_entry->links_count > 1) {
+        first_name_of(source_entry, destination_path);
+    }
+}
+
+/*!
+ * @brief defer_hardlink postpones the copy of a name whose inode was already met, to link it to the first name instead
+ * @param source_entry is a pointer to the source entry to copy
+ * @param destination_path is the path of the entry in the destination
+ * @return true if the name will be linked by apply_hardlinks, false if it must be copied now (first name of its inode)
+ */
+bool defer_hardlink(files_list_entry_t *source_entry, char *destination_path) {
+    if (source_entry->entry_type != FICHIER || source_entry->links_count <= 1) {
+        return false;
+    }
+    char *target = first_name_of(source_entry, destination_path);
+    if (target == NULL) {
+        return false;
+    }
+    if (pending_count == pending_capacity) {
+        size_t new_capacity = (pending_capacity == 0) ? 64 : pending_capacity * 2;
+        pending_link_t *new_links = realloc(pending_links, new_capacity * sizeof(pending_link_t));
+        if (new_links == NULL) {
+            return false;
+        }
+        pending_links = new_links;
+        pending_capacity = new_capacity;
+    }
+    pending_link_t *link_to_make = &pending_links[pending_count];
+    link_to_make->entry = *source_entry;
+    link_to_make->entry.path_and_name = strdup(source_entry->path_and_name);
+    link_to_make->entry.chunks = NULL; // Pas de réécriture par morceaux : le fichier est lié ou copié en entier
+    link_to_make->entry.next = NULL;
+    link_to_make->entry.prev = NULL;
+    link_to_make->target = target;
+    link_to_make->destination_path = strdup(destination_path);
+    if (link_to_make->entry.path_and_name == NULL || link_to_make->destination_path == NULL) {
+        free(link_to_make->entry.path_and_name);
+        free(link_to_make->destination_path);
+        return false;
+    }
+    ++pending_count;
+    return true;
+}
+
+/*!
+ * @brief apply_hardlinks links the postponed names to the first names of their inodes, then forgets all the inodes
+ * It must be called once all the copies are done ( @see finish_copy_pool ).
+ * @param the_config is a pointer to the configuration
+ * @param summary is a pointer to the counters of the links, may be NULL
+ */
+void apply_hardlinks(configuration_t *the_config, hardlinks_summary_t *summary) {
+    hardlinks_summary_t counters = {0, 0, 0};
+    for (size_t i = 0; i < pending_count; ++i) {
+        pending_link_t *link_to_make = &pending_links[i];
+        //L'ancien fichier de la destination est remplacé par un nouveau nom du premier
+        if ((unlink(link_to_make->destination_path) == 0 || errno == ENOENT) && link(link_to_make->target, link_to_make->destination_path) == 0) {
+            ++counters.linked_files;
+            counters.saved_bytes += link_to_make->entry.size;
+            if (the_config->is_verbose) {
+                printf("Lien de %s vers %s\n", link_to_make->destination_path, link_to_make->target);
+            }
+        } else {
+            copy_entry_to_destination(&link_to_make->entry, the_config);
+            ++counters.copied_files;
+        }
+        free(link_to_make->entry.path_and_name);
+        free(link_to_make->destination_path);
+    }
+    pending_count = 0;
+
+    for (size_t i = 0; i < slots_capacity; ++i) {
+        free(slots[i].destination_path);
+    }
+    free(slots);
+    slots = NULL;
+    slots_capacity = 0;
+    slots_count = 0;
+    free(pending_links);
+    pending_links = NULL;
+    pending_capacity = 0;
+    if (summary != NULL) {
+        *summary = counters;
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <files-list.h>
+#include <configuration.h>
+
+typedef struct {
+    uint64_t linked_files; // Names of the destination created with link() instead of a copy
+    uint64_t saved_bytes; // Bytes that were not copied thanks to them
+    uint64_t copied_files; // Names copied because their link could not be created
+} hardlinks_summary_t;
+
+void note_hardlink(files_list_entry_t *source_entry, char *destination_path);
+bool defer_hardlink(files_list_entry_t *source_entry, char *destination_path);
+void apply_hardlinks(configuration_t *the_config, hardlinks_summary_t *summary);
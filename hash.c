@@ -0,0 +1,390 @@
+#include <hash.h>
+#include <string.h>
+
+// Functions in this file compute the digests used to compare the content of files, with the
+// algorithm chosen on the command line. MD5 and BLAKE2b come from libcrypto; CRC32C and XXH64,
+// which are not cryptographic but are enough to detect changes, are computed here: CRC32C with the
+// crc32 instruction of SSE 4.2 when the processor has it, XXH64 with four independent lanes.
+// Digests are stored in binary, in big endian order for CRC32C and XXH64 (their canonical form).
+
+static hash_algorithm_t current_algorithm = HASH_MD5;
+
+static const char *algorithm_names[HASH_ALGORITHMS_COUNT] = {"md5", "crc32c", "xxh64", "blake2b"};
+static const size_t digest_sizes[HASH_ALGORITHMS_COUNT] = {16, 4, 8, 32};
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define CRC32C_POLYNOMIAL 0x82F63B78 // Castagnoli, bits inversés
+
+static uint32_t crc32c_tables[8][256];
+static bool are_crc32c_tables_ready = false;
+
+/*!
+ * @brief set_hash_algorithm sets the algorithm of the digests of the files
+ * It is set once, before the processes are created, so that analyzers inherit it.
+ * @param algorithm is the algorithm
+ */
+void set_hash_algorithm(hash_algorithm_t algorithm) {
+    current_algorithm = algorithm;
+}
+
+/*!
+ * @brief get_hash_algorithm gives the algorithm of the digests of the files
+ * @return the algorithm
+ */
+hash_algorithm_t get_hash_algorithm(void) {
+    return current_algorithm;
+}
+
+/*!
+ * @brief hash_algorithm_from_name finds an algorithm from its name on the command line
+ * @param name is the name (md5, crc32c, xxh64 or blake2b)
+ * @param algorithm is a pointer receiving the algorithm
+ * @return 0 in case of success, -1 if the name is unknown
+ */
+int hash_algorithm_from_name(const char *name, hash_algorithm_t *algorithm) {
+    for (int i = 0; i < HASH_ALGORITHMS_COUNT; ++i) {
+        if (strcmp(name, algorithm_names[i]) == 0) {
+            *algorithm = (hash_algorithm_t) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*!
+ * @brief hash_algorithm_name gives the name of an algorithm
+ * @param algorithm is the algorithm
+ * @return its name
+ */
+const char *hash_algorithm_name(hash_algorithm_t algorithm) {
+    return (algorithm < HASH_ALGORITHMS_COUNT) ? algorithm_names[algorithm] : "?";
+}
+
+/*!
+ * @brief hash_digest_size gives the size of the digests of an algorithm
+ * @param algorithm is the algorithm
+ * @return the size in bytes, at most HASH_MAX_DIGEST_SIZE
+ */
+size_t hash_digest_size(hash_algorithm_t algorithm) {
+    return (algorithm < HASH_ALGORITHMS_COUNT) ? digest_sizes[algorithm] : 0;
+}
+
+/*!
+ * @brief read_le64 reads a little endian 64 bits integer at any alignment
+ * @param data is a pointer to the bytes
+ * @return the integer
+ */
+static inline uint64_t read_le64(const uint8_t *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+/*!
+ * @brief read_le32 reads a little endian 32 bits integer at any alignment
+ * @param data is a pointer to the bytes
+ * @return the integer
+ */
+static inline uint32_t read_le32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t xxh64_round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * XXH_PRIME64_2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t accumulator, uint64_t value) {
+    accumulator ^= xxh64_round(0, value);
+    return accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/*!
+ * @brief xxh64_stripes processes the 32 bytes stripes of a block, one lane per 8 bytes
+ * @param state is a pointer to the XXH64 state
+ * @param data is a pointer to the block
+ * @param length is the size of the block, a multiple of 32
+ */
+static void xxh64_stripes(xxh64_state_t *state, const uint8_t *data, size_t length) {
+    uint64_t v1 = state->accumulators[0];
+    uint64_t v2 = state->accumulators[1];
+    uint64_t v3 = state->accumulators[2];
+    uint64_t v4 = state->accumulators[3];
+    for (const uint8_t *end = data + length; data < end; data += 32) {
+        v1 = xxh64_round(v1, read_le64(data));
+        v2 = xxh64_round(v2, read_le64(data + 8));
+        v3 = xxh64_round(v3, read_le64(data + 16));
+        v4 = xxh64_round(v4, read_le64(data + 24));
+    }
+    state->accumulators[0] = v1;
+    state->accumulators[1] = v2;
+    state->accumulators[2] = v3;
+    state->accumulators[3] = v4;
+}
+
+/*!
+ * @brief xxh64_update adds bytes to an XXH64 digest
+ * @param state is a pointer to the XXH64 state
+ * @param data is a pointer to the bytes
+ * @param length is the number of bytes
+ */
+static void xxh64_update(xxh64_state_t *state, const uint8_t *data, size_t length) {
+    state->total_length += length;
+    if (state->pending_length > 0) {
+        size_t missing = sizeof(state->pending) - state->pending_length;
+        if (length < missing) {
+            memcpy(state->pending + state->pending_length, data, length);
+            state->pending_length += length;
+            return;
+        }
+        memcpy(state->pending + state->pending_length, data, missing);
+        xxh64_stripes(state, state->pending, sizeof(state->pending));
+        data += missing;
+        length -= missing;
+        state->pending_length = 0;
+    }
+    size_t stripes_length = length & ~(size_t) 31;
+    xxh64_stripes(state, data, stripes_length);
+    memcpy(state->pending, data + stripes_length, length - stripes_length);
+    state->pending_length = length - stripes_length;
+}
+
+/*!
+ * @brief xxh64_final computes the XXH64 digest (seed 0) from its state
+ * @param state is a pointer to the XXH64 state
+ * @return the digest
+ */
+static uint64_t xxh64_final(xxh64_state_t *state) {
+    uint64_t hash;
+    if (state->total_length >= 32) {
+        uint64_t *v = state->accumulators;
+        hash = rotate_left(v[0], 1) + rotate_left(v[1], 7) + rotate_left(v[2], 12) + rotate_left(v[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            hash = xxh64_merge_round(hash, v[i]);
+        }
+    } else {
+        hash = state->accumulators[2] + XXH_PRIME64_5; // v3 vaut la graine
+    }
+    hash += state->total_length;
+
+    const uint8_t *data = state->pending;
+    const uint8_t *end = data + state->pending_length;
+    for (; data + 8 <= end; data += 8) {
+        hash ^= xxh64_round(0, read_le64(data));
+        hash = rotate_left(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (data + 4 <= end) {
+        hash ^= (uint64_t) read_le32(data) * XXH_PRIME64_1;
+        hash = rotate_left(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        data += 4;
+    }
+    for (; data < end; ++data) {
+        hash ^= *data * XXH_PRIME64_5;
+        hash = rotate_left(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/*!
+ * @brief init_crc32c_tables computes the tables of the software CRC32C (slicing by 8)
+ * The tables are only written with their final values, a concurrent initialization is harmless.
+ */
+static void init_crc32c_tables(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        crc32c_tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int table = 1; table < 8; ++table) {
+            crc32c_tables[table][i] = (crc32c_tables[table - 1][i] >> 8) ^ crc32c_tables[0][crc32c_tables[table - 1][i] & 0xff];
+        }
+    }
+    __atomic_store_n(&are_crc32c_tables_ready, true, __ATOMIC_RELEASE);
+}
+
+/*!
+ * @brief crc32c_software updates a CRC32C with the tables, 8 bytes at a time
+ * @param crc is the current CRC (inverted)
+ * @param data is a pointer to the bytes
+ * @param length is the number of bytes
+ * @return the updated CRC (inverted)
+ */
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *data, size_t length) {
+    if (!__atomic_load_n(&are_crc32c_tables_ready, __ATOMIC_ACQUIRE)) {
+        init_crc32c_tables();
+    }
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word = read_le64(data) ^ crc;
+        crc = crc32c_tables[7][word & 0xff] ^ crc32c_tables[6][(word >> 8) & 0xff]
+              ^ crc32c_tables[5][(word >> 16) & 0xff] ^ crc32c_tables[4][(word >> 24) & 0xff]
+              ^ crc32c_tables[3][(word >> 32) & 0xff] ^ crc32c_tables[2][(word >> 40) & 0xff]
+              ^ crc32c_tables[1][(word >> 48) & 0xff] ^ crc32c_tables[0][word >> 56];
+    }
+    for (; length > 0; ++data, --length) {
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/*!
+ * @brief crc32c_sse42 updates a CRC32C with the crc32 instruction, 8 bytes at a time
+ * @param crc is the current CRC (inverted)
+ * @param data is a pointer to the bytes
+ * @param length is the number of bytes
+ * @return the updated CRC (inverted)
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length) {
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+    for (; length > 0; ++data, --length) {
+        crc = __builtin_ia32_crc32qi(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+/*!
+ * @brief crc32c_update updates a CRC32C, with the fastest implementation available
+ * @param crc is the current CRC (inverted)
+ * @param data is a pointer to the bytes
+ * @param length is the number of bytes
+ * @return the updated CRC (inverted)
+ */
+static uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t length) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_sse42(crc, data, length);
+    }
+#endif
+    return crc32c_software(crc, data, length);
+}
+
+/*!
+ * @brief hash_init starts a digest
+ * @param context is a pointer to the context to initialize
+ * @param algorithm is the algorithm of the digest
+ * @return 0 in case of success, -1 else
+ */
+int hash_init(hash_context_t *context, hash_algorithm_t algorithm) {
+    memset(context, 0, sizeof(*context));
+    context->algorithm = algorithm;
+    switch (algorithm) {
+        case HASH_MD5:
+        case HASH_BLAKE2B:
+            context->state.evp = EVP_MD_CTX_new();
+            if (context->state.evp == NULL) {
+                return -1;
+            }
+            if (EVP_DigestInit_ex(context->state.evp, (algorithm == HASH_MD5) ? EVP_md5() : EVP_blake2b512(), NULL) != 1) {
+                EVP_MD_CTX_free(context->state.evp);
+                context->state.evp = NULL;
+                return -1;
+            }
+            return 0;
+        case HASH_CRC32C:
+            context->state.crc = 0xFFFFFFFF;
+            return 0;
+        case HASH_XXH64:
+            context->state.xxh64.accumulators[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+            context->state.xxh64.accumulators[1] = XXH_PRIME64_2;
+            context->state.xxh64.accumulators[2] = 0;
+            context->state.xxh64.accumulators[3] = -XXH_PRIME64_1;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/*!
+ * @brief hash_update adds bytes to a digest
+ * @param context is a pointer to the context
+ * @param data is a pointer to the bytes
+ * @param length is the number of bytes
+ */
+void hash_update(hash_context_t *context, const void *data, size_t length) {
+    switch (context->algorithm) {
+        case HASH_MD5:
+        case HASH_BLAKE2B:
+            EVP_DigestUpdate(context->state.evp, data, length);
+            break;
+        case HASH_CRC32C:
+            context->state.crc = crc32c_update(context->state.crc, data, length);
+            break;
+        case HASH_XXH64:
+            xxh64_update(&context->state.xxh64, data, length);
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * @brief hash_final ends a digest and frees its context
+ * @param context is a pointer to the context
+ * @param digest receives the digest, padded with zeros after hash_digest_size bytes
+ */
+void hash_final(hash_context_t *context, uint8_t digest[HASH_MAX_DIGEST_SIZE]) {
+    memset(digest, 0, HASH_MAX_DIGEST_SIZE);
+    switch (context->algorithm) {
+        case HASH_MD5:
+        case HASH_BLAKE2B: {
+            unsigned char value[EVP_MAX_MD_SIZE];
+            unsigned int length;
+            EVP_DigestFinal_ex(context->state.evp, value, &length);
+            EVP_MD_CTX_free(context->state.evp);
+            context->state.evp = NULL;
+            memcpy(digest, value, digest_sizes[context->algorithm]);
+            break;
+        }
+        case HASH_CRC32C: {
+            uint32_t crc = ~context->state.crc;
+            for (int i = 0; i < 4; ++i) {
+                digest[i] = (uint8_t) (crc >> (24 - 8 * i));
+            }
+            break;
+        }
+        case HASH_XXH64: {
+            uint64_t hash = xxh64_final(&context->state.xxh64);
+            for (int i = 0; i < 8; ++i) {
+                digest[i] = (uint8_t) (hash >> (56 - 8 * i));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <openssl/evp.h>
+
+// Room for the largest digest, the smaller ones are padded with zeros
+#define HASH_MAX_DIGEST_SIZE 32
+
+typedef enum {
+    HASH_MD5, // Default, cryptographic
+    HASH_CRC32C, // With the SSE 4.2 crc32 instruction when available
+    HASH_XXH64,
+    HASH_BLAKE2B, // BLAKE2b-512 truncated to 256 bits, cryptographic
+    HASH_ALGORITHMS_COUNT
+} hash_algorithm_t;
+
+typedef struct {
+    uint64_t accumulators[4];
+    uint64_t total_length;
+    uint8_t pending[32]; // Bytes not processed yet, less than a stripe
+    size_t pending_length;
+} xxh64_state_t;
+
+typedef struct {
+    hash_algorithm_t algorithm;
+    union {
+        EVP_MD_CTX *evp;
+        uint32_t crc;
+        xxh64_state_t xxh64;
+    } state;
+} hash_context_t;
+
+void set_hash_algorithm(hash_algorithm_t algorithm);
+hash_algorithm_t get_hash_algorithm(void);
+int hash_algorithm_from_name(const char *name, hash_algorithm_t *algorithm);
+const char *hash_algorithm_name(hash_algorithm_t algorithm);
+size_t hash_digest_size(hash_algorithm_t algorithm);
+
+int hash_init(hash_context_t *context, hash_algorithm_t algorithm);
+void hash_update(hash_context_t *context, const void *data, size_t length);
+void hash_final(hash_context_t *context, uint8_t digest[HASH_MAX_DIGEST_SIZE]);
@@ -1,94 +1,300 @@
 #include <messages.h>
+#include <shm-transport.h>
+#include <stats.h>
 #include <sys/msg.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
 
 // Functions in this file are required for inter processes communication
+// Messages go through the SysV MQ, or through the shared memory rings when they are enabled ( @see shm-transport.h )
+
+// Size of the fixed part of a batch that msgsnd counts (mtype excluded)
+#define BATCH_HEADER_SIZE (offsetof(entries_batch_t, data) - sizeof(long))
 
 /*!
- * @brief send_file_entry sends a file entry, with a given command code
- * @param msg_queue the MQ identifier through which to send the entry
- * @param recipient is the id of the recipient (as specified by mtype)
- * @param file_entry is a pointer to the entry to send (must be copied)
- * @param cmd_code is the cmd code to process the entry.
- * @return the result of the msgsnd function
- * Used by the specialized functions send_analyze*
+ * @brief record_size gives the space taken by a record in a batch
+ * @param path_length is the length of the path of the entry
+ * @return the size of the record, padded to 8 bytes
  */
-int send_file_entry(int msg_queue, int recipient, files_list_entry_t *file_entry, int cmd_code) {
+static size_t record_size(size_t path_length) {
+    return (sizeof(file_entry_record_t) + path_length + 1 + 7) & ~(size_t) 7;
+}
 
-    //Créer message
-    any_message_t message;
-    message.list_entry.mtype = recipient;
-    message.list_entry.op_code = cmd_code;
-    memcpy(&message.list_entry.payload, file_entry, sizeof(files_list_entry_t));
-    message.list_entry.reply_to=msg_queue;
-    //Envoyer message
-    int result = msgsnd(msg_queue, &message, sizeof(any_message_t) - sizeof(long), 0);
-    //Si erreur
-    if (result == -1) {
-        perror("msgsnd failed");
-        return -1;
+/*!
+ * @brief transmit sends a message through the transport in use
+ * @param msg_queue is the id of the MQ (unused with the shared memory transport)
+ * @param message is a pointer to the message, starting with its mtype
+ * @param size is the size of the message without its mtype
+ * @param msg_flags are the flags of msgsnd (IPC_NOWAIT not to block)
+ * @return 0 in case of success, -1 else
+ */
+static int transmit(int msg_queue, const void *message, size_t size, int msg_flags) {
+    int result = shm_transport_enabled() ? shm_send(message, size, msg_flags) : msgsnd(msg_queue, message, size, msg_flags);
+    if (result == 0) {
+        add_stat(STATS_MESSAGES_SENT, 1);
+        add_stat(STATS_BYTES_SENT, size);
     }
     return result;
+}
 
+/*!
+ * @brief receive_message receives a message through the transport in use, like msgrcv
+ * @param msg_queue is the id of the MQ (unused with the shared memory transport)
+ * @param message is a pointer to the buffer for the message
+ * @param msg_type is the type of the message to receive
+ * @param msg_flags are the flags of msgrcv
+ * @return the size of the message, -1 in case of error
+ */
+ssize_t receive_message(int msg_queue, any_message_t *message, long msg_type, int msg_flags) {
+    ssize_t size = shm_transport_enabled() ? shm_receive(message, sizeof(any_message_t) - sizeof(long), msg_type, msg_flags)
+                                           : msgrcv(msg_queue, message, sizeof(any_message_t) - sizeof(long), msg_type, msg_flags);
+    if (size != -1) {
+        add_stat(STATS_MESSAGES_RECEIVED, 1);
+        add_stat(STATS_BYTES_RECEIVED, size);
+    }
+    return size;
 }
 
 /*!
- * @brief send_analyze_dir_command sends a command to analyze a directory
- * @param msg_queue is the id of the MQ used to send the command
- * @param recipient is the recipient of the message (mtype)
- * @param target_dir is a string containing the path to the directory to analyze
- * @return the result of msgsnd
+ * @brief batch_capacity gives the number of data bytes a batch can carry
+ * It is the largest message the kernel accepts (msgmax), bounded by MSG_BATCH_MAX_DATA.
+ * The shared memory transport has no such limit.
+ * @return the capacity in bytes
  */
-int send_analyze_dir_command(int msg_queue, int recipient, char *target_dir) {
-    analyze_dir_command_t command;
-    command.mtype = recipient;
-    strcpy(command.target, target_dir);
-    command.op_code=COMMAND_CODE_ANALYZE_DIR;
-    return msgsnd(msg_queue, &command, sizeof(analyze_dir_command_t) - sizeof(long), 0); 
+size_t batch_capacity(void) {
+    static size_t capacity = 0;
+    if (shm_transport_enabled()) {
+        return MSG_BATCH_MAX_DATA;
+    }
+    if (capacity == 0) {
+        size_t msgmax = 8192; // Valeur par défaut de Linux
+        FILE *limit = fopen("/proc/sys/kernel/msgmax", "r");
+        if (limit != NULL) {
+            if (fscanf(limit, "%zu", &msgmax) != 1) {
+                msgmax = 8192;
+            }
+            fclose(limit);
+        }
+        capacity = (msgmax > BATCH_HEADER_SIZE) ? msgmax - BATCH_HEADER_SIZE : 0;
+        if (capacity > MSG_BATCH_MAX_DATA) {
+            capacity = MSG_BATCH_MAX_DATA;
+        }
+        if (capacity < record_size(PATH_SIZE - 1)) {
+            fprintf(stderr, "msgmax (%zu) est trop petit : les chemins les plus longs ne pourront pas etre transmis\n", msgmax);
+        }
+    }
+    return capacity;
 }
 
-// The 3 following functions are one-liners
+/*!
+ * @brief in_flight_budget gives the data bytes a lister may have in batches being analyzed
+ * With the MQ, requests and answers of both sides share the queue (msgmnb bytes): if they could fill it,
+ * analyzers and listers would block each other in msgsnd. Each lister keeps a quarter of it, the rest is
+ * left to the lists sent to the main process. The shared memory rings only carry references.
+ * @return the budget in bytes
+ */
+size_t in_flight_budget(void) {
+    static size_t budget = 0;
+    if (shm_transport_enabled()) {
+        return SIZE_MAX;
+    }
+    if (budget == 0) {
+        size_t msgmnb = 16384; // Valeur par défaut de Linux
+        FILE *limit = fopen("/proc/sys/kernel/msgmnb", "r");
+        if (limit != NULL) {
+            if (fscanf(limit, "%zu", &msgmnb) != 1) {
+                msgmnb = 16384;
+            }
+            fclose(limit);
+        }
+        budget = msgmnb / 4;
+    }
+    return budget;
+}
 
 /*!
- * @brief send_analyze_file_command sends a file entry to be analyzed
- * @param msg_queue the MQ identifier through which to send the entry
+ * @brief init_entries_batch prepares an empty batch
+ * @param batch is a pointer to the batch to initialize
  * @param recipient is the id of the recipient (as specified by mtype)
- * @param file_entry is a pointer to the entry to send (must be copied)
- * @return the result of the send_file_entry function
- * Calls send_file_entry function
+ * @param op_code is the command code applied to all the entries of the batch
  */
-int send_analyze_file_command(int msg_queue, int recipient, files_list_entry_t *file_entry) {
-    return send_file_entry(msg_queue, recipient, file_entry, COMMAND_CODE_ANALYZE_FILE);
+void init_entries_batch(entries_batch_t *batch, long recipient, char op_code) {
+    batch->mtype = recipient;
+    batch->op_code = op_code;
+    batch->is_shared = 0;
+    batch->entries_count = 0;
+    batch->data_length = 0;
 }
 
 /*!
- * @brief send_analyze_file_response sends a file entry after analyze
- * @param msg_queue the MQ identifier through which to send the entry
- * @param recipient is the id of the recipient (as specified by mtype)
- * @param file_entry is a pointer to the entry to send (must be copied)
- * @return the result of the send_file_entry function
- * Calls send_file_entry function
+ * @brief add_entry_to_batch copies an entry at the end of a batch
+ * @param batch is a pointer to the batch
+ * @param file_entry is a pointer to the entry to copy
+ * @param request_id is an opaque value sent back with the answer to this entry
+ * @param is_ok is false when the entry could not be analyzed
+ * @return true if the entry was added, false if the batch is full
+ */
+bool add_entry_to_batch(entries_batch_t *batch, files_list_entry_t *file_entry, uint64_t request_id, bool is_ok) {
+    size_t size = record_size(file_entry->path_length);
+    if (batch->data_length + size > batch_capacity()) {
+        return false;
+    }
+
+    file_entry_record_t *record = (file_entry_record_t *) (batch->data + batch->data_length);
+    record->request_id = request_id;
+    entry_to_record(file_entry, record, is_ok);
+    record->path_length = file_entry->path_length;
+    memcpy(record->path, file_entry->path_and_name, file_entry->path_length + 1);
+
+    batch->data_length += size;
+    ++batch->entries_count;
+    return true;
+}
+
+/*!
+ * @brief next_batch_record iterates over the records of a received batch
+ * @param batch is a pointer to the batch
+ * @param record is the current record, NULL to get the first one
+ * @return the next record, NULL at the end of the batch
  */
-int send_analyze_file_response(int msg_queue, int recipient, files_list_entry_t *file_entry) {
-    return send_file_entry(msg_queue, recipient, file_entry, COMMAND_CODE_FILE_ANALYZED);
+file_entry_record_t *next_batch_record(entries_batch_t *batch, file_entry_record_t *record) {
+    size_t offset = 0;
+    if (record != NULL) {
+        offset = (char *) record - batch->data + record_size(record->path_length);
+    }
+    if (offset + sizeof(file_entry_record_t) > batch->data_length) {
+        return NULL;
+    }
+    return (file_entry_record_t *) (batch->data + offset);
 }
 
 /*!
- * @brief send_files_list_element sends a files list entry from a complete files list
- * @param msg_queue the MQ identifier through which to send the entry
+ * @brief record_to_entry copies the properties of a received record into a file entry
+ * The path is not copied: the entry either already has it, or the caller points it to the record path.
+ * @param record is a pointer to the received record
+ * @param file_entry is a pointer to the entry to update
+ */
+void record_to_entry(file_entry_record_t *record, files_list_entry_t *file_entry) {
+    file_entry->mtime.tv_sec = record->mtime_sec;
+    file_entry->mtime.tv_nsec = record->mtime_nsec;
+    file_entry->size = record->size;
+    file_entry->device = record->device;
+    file_entry->inode = record->inode;
+    file_entry->links_count = record->links_count;
+    memcpy(file_entry->digest, record->digest, sizeof(file_entry->digest));
+    file_entry->digest_flags = record->has_digest ? ENTRY_HAS_DIGEST : 0;
+    file_entry->entry_type = record->entry_type;
+    file_entry->mode = record->mode;
+}
+
+/*!
+ * @brief entry_to_record copies the properties of a file entry into a record, its path excepted
+ * The analyzers use it to answer in the batch they received, whose records already hold the paths.
+ * @param file_entry is a pointer to the entry
+ * @param record is a pointer to the record to update
+ * @param is_ok is false when the entry could not be analyzed
+ */
+void entry_to_record(files_list_entry_t *file_entry, file_entry_record_t *record, bool is_ok) {
+    record->size = file_entry->size;
+    record->device = file_entry->device;
+    record->inode = file_entry->inode;
+    record->links_count = file_entry->links_count;
+    record->mtime_sec = file_entry->mtime.tv_sec;
+    record->mtime_nsec = file_entry->mtime.tv_nsec;
+    record->mode = file_entry->mode;
+    memcpy(record->digest, file_entry->digest, sizeof(record->digest));
+    record->has_digest = (file_entry->digest_flags & ENTRY_HAS_DIGEST) != 0;
+    record->entry_type = file_entry->entry_type;
+    record->is_ok = is_ok;
+}
+
+/*!
+ * @brief new_entries_batch gives an empty batch to fill
+ * With the shared memory transport, it is taken from the shared table (waiting for one to be released if needed).
+ * @param local_batch is a pointer to the batch of the caller, used with the MQ
  * @param recipient is the id of the recipient (as specified by mtype)
- * @param file_entry is a pointer to the entry to send (must be copied)
- * @param S_or_D a caractere to now if it's the source or destination list
- * @return the result of the send_file_entry function
- * Calls send_file_entry function
+ * @param op_code is the command code applied to all the entries of the batch
+ * @return a pointer to the batch to fill
  */
-int send_files_list_element(int msg_queue, int recipient, files_list_entry_t *file_entry,char S_or_D) {
-    if(S_or_D=='S') {
-        return send_file_entry(msg_queue,recipient,file_entry,COMMAND_CODE_FILE_ENTRY_FOR_SOURCE);
-    }else{
-     return send_file_entry(msg_queue,recipient,file_entry,COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION);
+entries_batch_t *new_entries_batch(entries_batch_t *local_batch, long recipient, char op_code) {
+    entries_batch_t *batch = shm_transport_enabled() ? shm_acquire_batch() : local_batch;
+    init_entries_batch(batch, recipient, op_code);
+    return batch;
+}
+
+/*!
+ * @brief send_entries_batch sends the used part of a batch, then empties it
+ * A shared batch is not copied: only its index is sent, and it belongs to the recipient afterwards,
+ * so the sender must get another one with new_entries_batch.
+ * @param msg_queue the MQ identifier through which to send the batch
+ * @param batch is a pointer to the batch to send
+ * @param msg_flags are the flags of msgsnd (IPC_NOWAIT not to block on a full queue, the batch is then kept)
+ * @return the result of the msgsnd function
+ */
+int send_entries_batch(int msg_queue, entries_batch_t *batch, int msg_flags) {
+    int result;
+    if (shm_is_shared_batch(batch)) {
+        batch_reference_t reference = {batch->mtype, batch->op_code, 1, shm_batch_index(batch)};
+        result = transmit(msg_queue, &reference, sizeof(reference) - sizeof(long), msg_flags);
+    } else {
+        result = transmit(msg_queue, batch, BATCH_HEADER_SIZE + batch->data_length, msg_flags);
+    }
+    //Si erreur (file pleine sans attente : ce n'est pas une erreur, l'appelant réessaiera)
+    if (result == -1) {
+        if (errno != EAGAIN) {
+            perror("msgsnd failed");
+        }
+        return -1;
+    }
+    if (!shm_is_shared_batch(batch)) {
+        batch->entries_count = 0;
+        batch->data_length = 0;
+    }
+    return result;
+}
+
+/*!
+ * @brief received_batch gives the batch carried by a received message
+ * @param message is a pointer to the received message
+ * @return a pointer to the batch, in the message itself or in the shared table
+ */
+entries_batch_t *received_batch(any_message_t *message) {
+    if (message->entries_batch.is_shared) {
+        return shm_batch_at(message->batch_reference.batch_index);
+    }
+    return &message->entries_batch;
+}
+
+/*!
+ * @brief release_batch gives a received batch back once it has been processed (only shared batches need it)
+ * @param batch is a pointer to the batch
+ */
+void release_batch(entries_batch_t *batch) {
+    shm_release_batch(batch);
+}
+
+/*!
+ * @brief send_analyze_dir_command sends a command to analyze a directory
+ * @param msg_queue is the id of the MQ used to send the command
+ * @param recipient is the recipient of the message (mtype)
+ * @param target_dir is a string containing the path to the directory to analyze
+ * @param is_recursive asks for the whole tree below the directory, else only for its own entries
+ * @param msg_flags are the flags of msgsnd (IPC_NOWAIT not to block on a full queue)
+ * @return the result of msgsnd
+ */
+int send_analyze_dir_command(int msg_queue, int recipient, char *target_dir, bool is_recursive, int msg_flags) {
+    analyze_dir_command_t command;
+    size_t target_length = strlen(target_dir);
+    if (target_length >= PATH_SIZE) {
+        errno = ENAMETOOLONG;
+        return -1;
     }
+    command.mtype = recipient;
+    memcpy(command.target, target_dir, target_length + 1);
+    command.op_code=is_recursive ? COMMAND_CODE_ANALYZE_DIR : COMMAND_CODE_ANALYZE_DIR_ENTRIES;
+    return transmit(msg_queue, &command, offsetof(analyze_dir_command_t, target) - sizeof(long) + target_length + 1, msg_flags);
 }
 
 /*!
@@ -100,15 +306,15 @@ int send_files_list_element(int msg_queue, int recipient, files_list_entry_t *fi
  */
 int send_list_end(int msg_queue, int recipient,char S_or_D) {
     //Créer message fin de liste
-    any_message_t msg;
-    msg.list_entry.mtype = recipient;
+    simple_command_t msg;
+    msg.mtype = recipient;
     if(S_or_D=='S'){
-        msg.list_entry.op_code=COMMAND_CODE_LIST_COMPLETE_FOR_SOURCE;
+        msg.message=COMMAND_CODE_LIST_COMPLETE_FOR_SOURCE;
     }else{
-        msg.list_entry.op_code=COMMAND_CODE_LIST_COMPLETE_FOR_DESTINATION;
+        msg.message=COMMAND_CODE_LIST_COMPLETE_FOR_DESTINATION;
     }
     //Envoyer message
-    return msgsnd(msg_queue, &msg, sizeof(files_list_entry_transmit_t) - sizeof(long), 0);
+    return transmit(msg_queue, &msg, sizeof(simple_command_t) - sizeof(long), 0);
 }
 
 /*!
@@ -123,7 +329,7 @@ int send_terminate_command(int msg_queue, int recipient) {
     msg.simple_command.mtype = recipient;
     msg.simple_command.message = COMMAND_CODE_TERMINATE;
     //Envoyer message
-    return msgsnd(msg_queue, &msg, sizeof(simple_command_t) - sizeof(long), 0);
+    return transmit(msg_queue, &msg, sizeof(simple_command_t) - sizeof(long), 0);
 }
 
 /*!
@@ -138,5 +344,5 @@ int send_terminate_confirm(int msg_queue, int recipient) {
     msg.simple_command.mtype = recipient;
     msg.simple_command.message = COMMAND_CODE_TERMINATE_OK;
     //Envoyer message
-    return msgsnd(msg_queue, &msg, sizeof(simple_command_t) - sizeof(long), 0);
+    return transmit(msg_queue, &msg, sizeof(simple_command_t) - sizeof(long), 0);
 }
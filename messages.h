@@ -2,12 +2,19 @@
 
 #include <files-list.h>
 #include <defines.h>
+#include <stdbool.h>
+#include <sys/types.h>
 
 #define COMMAND_CODE_TERMINATE 0x0
 #define COMMAND_CODE_TERMINATE_OK 0x10
 #define COMMAND_CODE_ANALYZE_FILE 0x01
 #define COMMAND_CODE_FILE_ANALYZED 0x11
 #define COMMAND_CODE_ANALYZE_DIR 0x02
+#define COMMAND_CODE_ANALYZE_DIR_ENTRIES 0x03 // Only the entries of the directory, not its subdirectories
+#define COMMAND_CODE_SAMPLE_FILES 0x04 // Sample digests of files asked by the main process to an analyzer
+#define COMMAND_CODE_DIGEST_FILES 0x05 // Digests of files asked by the main process to an analyzer
+#define COMMAND_CODE_DIGEST_CHUNKS 0x06 // Digests of chunks of files hashed as trees, asked by the main process to an analyzer
+#define COMMAND_CODE_FILES_HASHED 0x15 // Answer to a sample or digest request, in the digest field of the records
 #define COMMAND_CODE_FILE_ENTRY 0x12
 #define COMMAND_CODE_FILE_ENTRY_FOR_SOURCE 0x13
 #define COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION 0x14
@@ -21,42 +28,86 @@
 #define MSG_TYPE_TO_SOURCE_ANALYZERS 4
 #define MSG_TYPE_TO_DESTINATION_ANALYZERS 5
 
+// Upper bound of the data of a batch, the actual limit is given by batch_capacity (kernel msgmax)
+#define MSG_BATCH_MAX_DATA 65536
+// A lister sends at most this number of files to analyze in one batch, to keep analyzers balanced
+#define MSG_ANALYZE_BATCH_ENTRIES 32
+
 typedef struct {
     long mtype;
     char message;
 } simple_command_t;
 
+// An entry on the wire: fixed fields followed by the used part of the path only.
+// Records are padded to 8 bytes so that the next one stays aligned in the batch.
+typedef struct {
+    uint64_t request_id; // Opaque value set by the lister and sent back by the analyzer
+    uint64_t size;
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint32_t mode;
+    uint32_t links_count;
+    union {
+        uint8_t digest[HASH_MAX_DIGEST_SIZE];
+        struct {
+            uint64_t offset;
+            uint64_t length;
+        } chunk; // Only in a chunk request: the range of the file to hash, whose digest is the answer
+    };
+    uint8_t entry_type;
+    uint8_t is_ok; // Cleared by the analyzer when the file could not be analyzed
+    uint8_t has_digest; // The digest was found in the cache by the analyzer, it is not computed otherwise
+    uint16_t path_length;
+    char path[]; // path_length bytes followed by '\0'
+} file_entry_record_t;
+
+// Many entries packed in a single message, only data_length bytes of data are sent
 typedef struct {
     long mtype;
-    char op_code; // Contains the analyze file opcode
-    files_list_entry_t payload;
-} analyze_file_command_t;
+    char op_code; // Contains the analyze file, file analyzed or file entry opcode
+    uint8_t is_shared; // Always 0 here, 1 in a batch_reference_t
+    uint16_t entries_count;
+    uint32_t data_length;
+    char data[MSG_BATCH_MAX_DATA];
+} entries_batch_t;
 
+// With the shared memory transport, a batch stays in the shared table and only its index is sent.
+// The first fields match entries_batch_t so that the receiver can tell both apart.
 typedef struct {
     long mtype;
-    char op_code; // Contains the analyze file opcode
-    files_list_entry_t payload;
-    int reply_to; // MQ id of the sender, to build either source or destination list
-} files_list_entry_transmit_t;
+    char op_code;
+    uint8_t is_shared; // Always 1
+    uint32_t batch_index;
+} batch_reference_t;
 
 typedef struct {
     long mtype;
-    char op_code; // Contains the analyze dir opcode
-    char target[PATH_SIZE];
+    char op_code; // Contains the analyze dir (or dir entries) opcode
+    char target[PATH_SIZE]; // Only the used part is sent
 } analyze_dir_command_t;
 
 typedef union {
     simple_command_t simple_command;
-    analyze_file_command_t analyze_file_command;
     analyze_dir_command_t analyze_dir_command;
-    files_list_entry_transmit_t list_entry;
+    entries_batch_t entries_batch;
+    batch_reference_t batch_reference;
 } any_message_t;
 
-int send_analyze_dir_command(int msg_queue, int recipient, char *target_dir);
-int send_file_entry(int msg_queue, int recipient, files_list_entry_t *file_entry, int cmd_code);
-int send_analyze_file_command(int msg_queue, int recipient, files_list_entry_t *file_entry);
-int send_analyze_file_response(int msg_queue, int recipient, files_list_entry_t *file_entry);
-int send_files_list_element(int msg_queue, int recipient, files_list_entry_t *file_entry,char S_or_D);
+size_t batch_capacity(void);
+size_t in_flight_budget(void);
+void init_entries_batch(entries_batch_t *batch, long recipient, char op_code);
+bool add_entry_to_batch(entries_batch_t *batch, files_list_entry_t *file_entry, uint64_t request_id, bool is_ok);
+file_entry_record_t *next_batch_record(entries_batch_t *batch, file_entry_record_t *record);
+void record_to_entry(file_entry_record_t *record, files_list_entry_t *file_entry);
+void entry_to_record(files_list_entry_t *file_entry, file_entry_record_t *record, bool is_ok);
+entries_batch_t *new_entries_batch(entries_batch_t *local_batch, long recipient, char op_code);
+int send_entries_batch(int msg_queue, entries_batch_t *batch, int msg_flags);
+ssize_t receive_message(int msg_queue, any_message_t *message, long msg_type, int msg_flags);
+entries_batch_t *received_batch(any_message_t *message);
+void release_batch(entries_batch_t *batch);
+int send_analyze_dir_command(int msg_queue, int recipient, char *target_dir, bool is_recursive, int msg_flags);
 int send_list_end(int msg_queue, int recipient,char S_or_D);
 int send_terminate_command(int msg_queue, int recipient);
 int send_terminate_confirm(int msg_queue, int recipient);
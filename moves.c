@@ -0,0 +1,350 @@
+#include <moves.h>
+#include <sync.h>
+#include <diff.h>
+#include <dedup.h>
+#include <copy-pool.h>
+#include <tree-hash.h>
+#include <utility.h>
+#include <defines.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file rename the files of the destination that were moved in the source, instead of
+// copying them again. With --detect-moves, the new files of the source and the files only in the
+// destination are set aside by the comparison; once it is over, they are matched:
+// - by inode, when both sides are on one file system (the destination file is the source file);
+// - by size, mode and mtime, as the comparison without digests, or by size and digest with them: only the
+//   files of a size found on both sides are hashed ( @see compute_digests_on_demand ).
+// Among files of the same content, a file keeps its name when possible. A matched destination file is
+// renamed to the path of the new file, so a renamed directory costs a rename per file, whatever their
+// sizes. The directories emptied by the moves, that do not exist in the source anymore, are removed.
+// The other files are copied (or deduplicated) as usual. The functions are called by the main thread only.
+
+typedef struct {
+    files_list_entry_t entry; // Copy of the new source entry, or of the destination entry only in the destination
+    char *destination_path; // Path of the new file in the destination, NULL for a file only in the destination
+    long match; // Index of the matched candidate, -1 if none
+} move_candidate_t;
+
+static move_candidate_t *candidates = NULL;
+static size_t candidates_count = 0;
+static size_t candidates_capacity = 0;
+static bool are_digests_compared = false; // Matching by digest ( uses_md5 ), for the comparison functions
+
+/*!
+ * @brief add_candidate sets a file aside for the matching
+ * @param entry is a pointer to the entry of the file
+ * @param destination_path is the path of a new file in the destination, NULL for a file only in the destination
+ * @return true if the file was set aside, false else (out of memory)
+ */
+static bool add_candidate(files_list_entry_t *entry, char *destination_path) {
+    if (candidates_count == candidates_capacity) {
+        size_t new_capacity = (candidates_capacity == 0) ? 256 : candidates_capacity * 2;
+        move_candidate_t *new_candidates = realloc(candidates, new_capacity * sizeof(move_candidate_t));
+        if (new_candidates == NULL) {
+            return false;
+        }
+        candidates = new_candidates;
+        candidates_capacity = new_capacity;
+    }
+    move_candidate_t *candidate = &candidates[candidates_count];
+    candidate->entry = *entry;
+    candidate->entry.path_and_name = strdup(entry->path_and_name);
+    candidate->entry.chunks = (destination_path != NULL) ? copy_chunk_digests(entry->chunks) : NULL;
+    candidate->entry.next = NULL;
+    candidate->entry.prev = NULL;
+    candidate->destination_path = (destination_path != NULL) ? strdup(destination_path) : NULL;
+    candidate->match = -1;
+    if (candidate->entry.path_and_name == NULL || (destination_path != NULL && candidate->destination_path == NULL)) {
+        free(candidate->entry.path_and_name);
+        free(candidate->destination_path);
+        free_chunk_digests(candidate->entry.chunks);
+        return false;
+    }
+    ++candidates_count;
+    return true;
+}
+
+/*!
+ * @brief defer_moved_copy sets a new file of the source aside, until the end of the comparison tells if it was moved
+ * @param source_entry is a pointer to the new source entry
+ * @param destination_path is its path in the destination
+ * @param the_config is a pointer to the configuration
+ * @return true if the file is set aside ( @see apply_moves ), false if it must be copied now
+ */
+bool defer_moved_copy(files_list_entry_t *source_entry, char *destination_path, configuration_t *the_config) {
+    if (!the_config->is_detecting_moves || source_entry->entry_type != FICHIER || source_entry->size == 0) {
+        return false;
+    }
+    return add_candidate(source_entry, destination_path);
+}
+
+/*!
+ * @brief note_move_origin sets a file only in the destination aside, as the possible origin of a moved file
+ * @param destination_entry is a pointer to the destination entry
+ * @param the_config is a pointer to the configuration
+ * @return true if the file is set aside ( @see apply_moves ), false else
+ */
+bool note_move_origin(files_list_entry_t *destination_entry, configuration_t *the_config) {
+    if (!the_config->is_detecting_moves || destination_entry->entry_type != FICHIER || destination_entry->size == 0) {
+        return false;
+    }
+    return add_candidate(destination_entry, NULL);
+}
+
+/*!
+ * @brief compare_keys orders two candidates by the metadata that must be the same for a move
+ * By size, then by mtime and mode without digests (they are compared instead).
+ * @param left is a pointer to a candidate
+ * @param right is a pointer to a candidate
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_keys(const move_candidate_t *left, const move_candidate_t *right) {
+    if (left->entry.size != right->entry.size) {
+        return (left->entry.size < right->entry.size) ? -1 : 1;
+    }
+    if (are_digests_compared) {
+        return 0;
+    }
+    if (left->entry.mtime.tv_sec != right->entry.mtime.tv_sec) {
+        return (left->entry.mtime.tv_sec < right->entry.mtime.tv_sec) ? -1 : 1;
+    }
+    if (left->entry.mtime.tv_nsec != right->entry.mtime.tv_nsec) {
+        return (left->entry.mtime.tv_nsec < right->entry.mtime.tv_nsec) ? -1 : 1;
+    }
+    return (left->entry.mode == right->entry.mode) ? 0 : (left->entry.mode < right->entry.mode) ? -1 : 1;
+}
+
+/*!
+ * @brief compare_contents orders two candidates by key, then by digest when they are compared
+ * @param left is a pointer to a candidate
+ * @param right is a pointer to a candidate
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_contents(const move_candidate_t *left, const move_candidate_t *right) {
+    int order = compare_keys(left, right);
+    if (order != 0 || !are_digests_compared) {
+        return order;
+    }
+    bool left_has_digest = (left->entry.digest_flags & ENTRY_HAS_DIGEST) != 0;
+    bool right_has_digest = (right->entry.digest_flags & ENTRY_HAS_DIGEST) != 0;
+    if (left_has_digest != right_has_digest) {
+        return left_has_digest ? -1 : 1;
+    }
+    //Sans empreinte (fichier illisible), chaque fichier est seul de son contenu
+    return left_has_digest ? memcmp(left->entry.digest, right->entry.digest, HASH_MAX_DIGEST_SIZE) : (left < right) ? -1 : (left > right);
+}
+
+/*!
+ * @brief compare_names orders two candidates by content, then by name (without the directories)
+ * @param left is a pointer to a candidate
+ * @param right is a pointer to a candidate
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_names(const move_candidate_t *left, const move_candidate_t *right) {
+    int order = compare_contents(left, right);
+    return (order != 0) ? order : strcmp(strrchr(left->entry.path_and_name, '/'), strrchr(right->entry.path_and_name, '/'));
+}
+
+/*!
+ * @brief compare_inodes orders two candidates by device and inode
+ * @param left is a pointer to a candidate
+ * @param right is a pointer to a candidate
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_inodes(const move_candidate_t *left, const move_candidate_t *right) {
+    if (left->entry.device != right->entry.device) {
+        return (left->entry.device < right->entry.device) ? -1 : 1;
+    }
+    return (left->entry.inode == right->entry.inode) ? 0 : (left->entry.inode < right->entry.inode) ? -1 : 1;
+}
+
+/*!
+ * @brief sort_by_names is the qsort comparator of the pointers to the candidates, by name
+ */
+static int sort_by_names(const void *left, const void *right) {
+    return compare_names(*(move_candidate_t * const *) left, *(move_candidate_t * const *) right);
+}
+
+/*!
+ * @brief sort_by_inodes is the qsort comparator of the pointers to the candidates, by inode
+ */
+static int sort_by_inodes(const void *left, const void *right) {
+    return compare_inodes(*(move_candidate_t * const *) left, *(move_candidate_t * const *) right);
+}
+
+/*!
+ * @brief pair_runs matches the unmatched new files and origins of each run of equal candidates, in order
+ * @param sorted is the array of pointers to the candidates, sorted so that the equal ones are contiguous
+ * @param compare tells if two candidates are equal (0)
+ */
+static void pair_runs(move_candidate_t **sorted, int (*compare)(const move_candidate_t *, const move_candidate_t *)) {
+    for (size_t start = 0, end = 0; start < candidates_count; start = end) {
+        for (end = start + 1; end < candidates_count && compare(sorted[start], sorted[end]) == 0; ++end) {
+        }
+        if (compare == compare_inodes && sorted[start]->entry.inode == 0) { // Inode inconnu
+            continue;
+        }
+        size_t origin = start;
+        size_t source = start;
+        while (true) {
+            while (origin < end && (sorted[origin]->destination_path != NULL || sorted[origin]->match != -1)) {
+                ++origin;
+            }
+            while (source < end && (sorted[source]->destination_path == NULL || sorted[source]->match != -1)) {
+                ++source;
+            }
+            if (origin == end || source == end) {
+                break;
+            }
+            sorted[origin]->match = sorted[source] - candidates;
+            sorted[source]->match = sorted[origin] - candidates;
+        }
+    }
+}
+
+/*!
+ * @brief hash_unmatched computes the digests of the unmatched candidates whose size is found among both the new files and the origins
+ * @param sorted is the array of pointers to the candidates, sorted by size
+ */
+static void hash_unmatched(move_candidate_t **sorted) {
+    files_list_entry_t **entries = malloc(candidates_count * sizeof(files_list_entry_t *));
+    size_t entries_count = 0;
+    if (entries == NULL) {
+        return;
+    }
+    for (size_t start = 0, end = 0; start < candidates_count; start = end) {
+        bool has_origin = false;
+        bool has_source = false;
+        for (end = start; end < candidates_count && sorted[end]->entry.size == sorted[start]->entry.size; ++end) {
+            has_origin = has_origin || (sorted[end]->destination_path == NULL && sorted[end]->match == -1);
+            has_source = has_source || (sorted[end]->destination_path != NULL && sorted[end]->match == -1);
+        }
+        for (size_t i = start; has_origin && has_source && i < end; ++i) {
+            if (sorted[i]->match == -1 && !(sorted[i]->entry.digest_flags & ENTRY_HAS_DIGEST)) {
+                entries[entries_count++] = &sorted[i]->entry;
+            }
+        }
+    }
+    compute_digests_on_demand(entries, entries_count);
+    free(entries);
+}
+
+/*!
+ * @brief remove_empty_directories removes the directories of a moved file left empty, when they are not in the source anymore
+ * @param old_path is the former path of the moved file in the destination
+ * @param the_config is a pointer to the configuration
+ * @return the number of removed directories
+ */
+static uint64_t remove_empty_directories(char *old_path, configuration_t *the_config) {
+    uint64_t removed = 0;
+    size_t root_length = path_root_length(the_config->destination);
+    char directory[PATH_SIZE];
+    char source_path[PATH_SIZE];
+    struct stat source_stats;
+    strncpy(directory, old_path, PATH_SIZE - 1);
+    directory[PATH_SIZE - 1] = '\0';
+    for (char *slash = strrchr(directory, '/'); slash != NULL && (size_t) (slash - directory) >= root_length; slash = strrchr(directory, '/')) {
+        *slash = '\0';
+        if (concat_path(source_path, the_config->source, directory + root_length) == NULL || lstat(source_path, &source_stats) == 0
+            || rmdir(directory) == -1) {
+            break;
+        }
+        ++removed;
+    }
+    return removed;
+}
+
+/*!
+ * @brief copy_unmoved copies a new file of the source that was not moved, as apply_difference does
+ * @param candidate is a pointer to the new file
+ * @param the_config is a pointer to the configuration
+ */
+static void copy_unmoved(move_candidate_t *candidate, configuration_t *the_config) {
+    if (!defer_dedup_copy(&candidate->entry, candidate->destination_path, the_config)) {
+        submit_copy(&candidate->entry, the_config);
+    }
+}
+
+/*!
+ * @brief apply_moves matches the new files and the files only in the destination set aside, renames the matched ones, then forgets the candidates
+ * It must be called once the comparison is over. The unmatched new files are submitted to the copies.
+ * @param the_config is a pointer to the configuration
+ * @param summary is a pointer to the counters of the moves, may be NULL
+ */
+void apply_moves(configuration_t *the_config, moves_summary_t *summary) {
+    moves_summary_t counters = {0, 0, 0};
+    move_candidate_t **sorted = (candidates_count > 0) ? malloc(candidates_count * sizeof(move_candidate_t *)) : NULL;
+    for (size_t i = 0; sorted != NULL && i < candidates_count; ++i) {
+        sorted[i] = &candidates[i];
+    }
+    if (sorted != NULL) {
+        are_digests_compared = the_config->uses_md5;
+        //1 - Même inode des deux côtés, puis 2 - même contenu et même nom, puis 3 - même contenu
+        qsort(sorted, candidates_count, sizeof(move_candidate_t *), sort_by_inodes);
+        pair_runs(sorted, compare_inodes);
+        qsort(sorted, candidates_count, sizeof(move_candidate_t *), sort_by_names);
+        if (are_digests_compared) {
+            hash_unmatched(sorted);
+            qsort(sorted, candidates_count, sizeof(move_candidate_t *), sort_by_names);
+        }
+        pair_runs(sorted, compare_names);
+        pair_runs(sorted, compare_contents);
+        free(sorted);
+    }
+
+    for (size_t i = 0; i < candidates_count; ++i) {
+        move_candidate_t *candidate = &candidates[i];
+        if (candidate->destination_path == NULL) {
+            continue;
+        }
+        move_candidate_t *origin = (candidate->match != -1) ? &candidates[candidate->match] : NULL;
+        if (origin == NULL || rename(origin->entry.path_and_name, candidate->destination_path) == -1) {
+            if (origin != NULL) {
+                printf("Deplacement impossible de %s : %s\n", origin->entry.path_and_name, strerror(errno));
+                origin->match = -1;
+            }
+            copy_unmoved(candidate, the_config);
+            continue;
+        }
+        //Le fichier déplacé peut avoir d'autres noms dans la destination : ils gardent leurs métadonnées
+        if (mismatch(&candidate->entry, &origin->entry, false) && separate_destination_file(candidate->destination_path) == 0) {
+            set_destination_metadata(candidate->destination_path, &candidate->entry);
+        }
+        if (candidate->entry.digest_flags & ENTRY_HAS_DIGEST) {
+            store_destination_digest(candidate->destination_path, candidate->entry.digest);
+        }
+        note_dedup_content(&candidate->entry, candidate->destination_path, the_config);
+        ++counters.moved_files;
+        counters.saved_bytes += candidate->entry.size;
+        if (the_config->is_verbose) {
+            printf("Deplacement de %s vers %s\n", origin->entry.path_and_name, candidate->destination_path);
+        }
+    }
+
+    //Les fichiers restés en trop gardent leur contenu pour la déduplication, les répertoires vidés disparaissent
+    for (size_t i = 0; i < candidates_count; ++i) {
+        if (candidates[i].destination_path == NULL && candidates[i].match == -1) {
+            note_dedup_content(&candidates[i].entry, candidates[i].entry.path_and_name, the_config);
+        } else if (candidates[i].destination_path == NULL) {
+            counters.removed_directories += remove_empty_directories(candidates[i].entry.path_and_name, the_config);
+        }
+    }
+
+    for (size_t i = 0; i < candidates_count; ++i) {
+        free(candidates[i].entry.path_and_name);
+        free(candidates[i].destination_path);
+        free_chunk_digests(candidates[i].entry.chunks);
+    }
+    free(candidates);
+    candidates = NULL;
+    candidates_count = 0;
+    candidates_capacity = 0;
+    if (summary != NULL) {
+        *summary = counters;
+    }
+}
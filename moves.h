@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <files-list.h>
+#include <configuration.h>
+
+typedef struct {
+    uint64_t moved_files; // New files of the source renamed from a file only in the destination
+    uint64_t saved_bytes; // Bytes that were not copied thanks to them
+    uint64_t removed_directories; // Destination directories left empty by the moves, removed
+} moves_summary_t;
+
+bool defer_moved_copy(files_list_entry_t *source_entry, char *destination_path, configuration_t *the_config);
+bool note_move_origin(files_list_entry_t *destination_entry, configuration_t *the_config);
+void apply_moves(configuration_t *the_config, moves_summary_t *summary);
@@ -0,0 +1,212 @@
+#include <multi-hash.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Functions in this file compute the MD5 sums of many small messages at once, in the style of the
+// multi-buffer implementations: each 32 bits lane of a SIMD register works on its own message, so
+// 4 (SSE2, NEON) or 8 (AVX2) blocks go through the 64 steps of MD5 together. When the message of
+// a lane is done, the lane takes the next message, until all of them are hashed.
+// The kernels use the vector extensions of GCC, the widest one is chosen when the processor runs.
+
+typedef uint32_t vector4_t __attribute__((vector_size(16)));
+typedef uint32_t vector8_t __attribute__((vector_size(32)));
+
+static const uint32_t md5_k[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const int md5_shifts[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static const uint32_t md5_initial_state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+// Message of a lane: its full blocks are read in place, the last bytes and the padding are in tail
+typedef struct {
+    size_t message; // Index of the message, -1 when the lane is free
+    const uint8_t *data;
+    size_t full_blocks;
+    size_t total_blocks;
+    size_t next_block;
+    uint8_t tail[128];
+} lane_t;
+
+static const uint8_t idle_block[64]; // Hashed by the free lanes, the result is dropped
+
+/*!
+ * @brief read_le32 reads a little endian 32 bits integer at any alignment
+ * @param data is a pointer to the bytes
+ * @return the integer
+ */
+static inline uint32_t read_le32(const uint8_t *data) {
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+// Hashes one block per lane: state holds the 4 words of the MD5 state of each lane
+#define DEFINE_MD5_BLOCKS(name, vector_type, lanes, attributes)                                          \
+    attributes static void name(uint32_t state[4][MULTI_HASH_MAX_LANES], const uint8_t **blocks) {     \
+        vector_type words[16];                                                                          \
+        for (int i = 0; i < 16; ++i) {                                                                  \
+            uint32_t lane_words[lanes];                                                                 \
+            for (int lane = 0; lane < (lanes); ++lane) {                                                \
+                lane_words[lane] = read_le32(blocks[lane] + 4 * i);                                     \
+            }                                                                                           \
+            memcpy(&words[i], lane_words, sizeof(words[i]));                                            \
+        }                                                                                               \
+        vector_type a, b, c, d;                                                                         \
+        memcpy(&a, state[0], sizeof(a));                                                                \
+        memcpy(&b, state[1], sizeof(b));                                                                \
+        memcpy(&c, state[2], sizeof(c));                                                                \
+        memcpy(&d, state[3], sizeof(d));                                                                \
+        vector_type initial_a = a, initial_b = b, initial_c = c, initial_d = d;                         \
+        _Pragma("GCC unroll 64")                                                                        \
+        for (int i = 0; i < 64; ++i) {                                                                  \
+            vector_type f;                                                                              \
+            int g;                                                                                      \
+            if (i < 16) {                                                                               \
+                f = d ^ (b & (c ^ d));                                                                  \
+                g = i;                                                                                  \
+            } else if (i < 32) {                                                                        \
+                f = c ^ (d & (b ^ c));                                                                  \
+                g = (5 * i + 1) & 15;                                                                   \
+            } else if (i < 48) {                                                                        \
+                f = b ^ c ^ d;                                                                          \
+                g = (3 * i + 5) & 15;                                                                   \
+            } else {                                                                                    \
+                f = c ^ (b | ~d);                                                                       \
+                g = (7 * i) & 15;                                                                       \
+            }                                                                                           \
+            vector_type t = a + f + md5_k[i] + words[g];                                                \
+            a = d;                                                                                      \
+            d = c;                                                                                      \
+            c = b;                                                                                      \
+            b = b + ((t << md5_shifts[i]) | (t >> (32 - md5_shifts[i])));                               \
+        }                                                                                               \
+        a += initial_a;                                                                                 \
+        b += initial_b;                                                                                 \
+        c += initial_c;                                                                                 \
+        d += initial_d;                                                                                 \
+        memcpy(state[0], &a, sizeof(a));                                                                \
+        memcpy(state[1], &b, sizeof(b));                                                                \
+        memcpy(state[2], &c, sizeof(c));                                                                \
+        memcpy(state[3], &d, sizeof(d));                                                                \
+    }
+
+DEFINE_MD5_BLOCKS(md5_blocks_x4, vector4_t, 4, )
+#if defined(__x86_64__)
+DEFINE_MD5_BLOCKS(md5_blocks_x8, vector8_t, 8, __attribute__((target("avx2"))))
+#endif
+
+/*!
+ * @brief multi_hash_lanes gives the number of messages hashed together on this processor
+ * @return 8 with AVX2, 4 else
+ */
+int multi_hash_lanes(void) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        return 8;
+    }
+#endif
+    return 4;
+}
+
+/*!
+ * @brief start_lane gives a message to a lane and prepares its padded tail
+ * @param lane is a pointer to the lane
+ * @param state is the MD5 state of the lanes
+ * @param lane_index is the index of the lane
+ * @param message is the index of the message
+ * @param data is a pointer to the message
+ * @param length is the size of the message
+ */
+static void start_lane(lane_t *lane, uint32_t state[4][MULTI_HASH_MAX_LANES], int lane_index, size_t message, const uint8_t *data, size_t length) {
+    lane->message = message;
+    lane->data = data;
+    lane->full_blocks = length / 64;
+    lane->next_block = 0;
+
+    //Derniers octets, bit 1, zéros puis longueur en bits (petit-boutiste) : un ou deux blocs
+    size_t rest = length % 64;
+    memset(lane->tail, 0, sizeof(lane->tail));
+    memcpy(lane->tail, data + lane->full_blocks * 64, rest);
+    lane->tail[rest] = 0x80;
+    size_t tail_length = (rest < 56) ? 64 : 128;
+    uint64_t length_bits = (uint64_t) length * 8;
+    for (int i = 0; i < 8; ++i) {
+        lane->tail[tail_length - 8 + i] = (uint8_t) (length_bits >> (8 * i));
+    }
+    lane->total_blocks = lane->full_blocks + tail_length / 64;
+
+    for (int word = 0; word < 4; ++word) {
+        state[word][lane_index] = md5_initial_state[word];
+    }
+}
+
+/*!
+ * @brief md5_multi_buffer computes the MD5 sums of many messages, several at once in SIMD lanes
+ * @param messages is an array of pointers to the messages
+ * @param lengths is an array of the sizes of the messages
+ * @param count is the number of messages
+ * @param digests is an array receiving the 16 bytes MD5 sum of each message
+ */
+void md5_multi_buffer(const uint8_t **messages, const size_t *lengths, size_t count, uint8_t (*digests)[16]) {
+    int lanes_count = multi_hash_lanes();
+    uint32_t state[4][MULTI_HASH_MAX_LANES];
+    lane_t lanes[MULTI_HASH_MAX_LANES];
+    const uint8_t *blocks[MULTI_HASH_MAX_LANES];
+    size_t next_message = 0;
+    for (int i = 0; i < lanes_count; ++i) {
+        lanes[i].message = (size_t) -1;
+    }
+
+    while (true) {
+        bool is_busy = false;
+        for (int i = 0; i < lanes_count; ++i) {
+            if (lanes[i].message == (size_t) -1 && next_message < count) {
+                start_lane(&lanes[i], state, i, next_message, messages[next_message], lengths[next_message]);
+                ++next_message;
+            }
+            if (lanes[i].message == (size_t) -1) {
+                blocks[i] = idle_block;
+                continue;
+            }
+            is_busy = true;
+            size_t block = lanes[i].next_block;
+            blocks[i] = (block < lanes[i].full_blocks) ? lanes[i].data + 64 * block : lanes[i].tail + 64 * (block - lanes[i].full_blocks);
+        }
+        if (!is_busy) {
+            break;
+        }
+
+#if defined(__x86_64__)
+        if (lanes_count == 8) {
+            md5_blocks_x8(state, blocks);
+        } else {
+            md5_blocks_x4(state, blocks);
+        }
+#else
+        md5_blocks_x4(state, blocks);
+#endif
+
+        for (int i = 0; i < lanes_count; ++i) {
+            if (lanes[i].message != (size_t) -1 && ++lanes[i].next_block == lanes[i].total_blocks) {
+                for (int word = 0; word < 4; ++word) {
+                    for (int byte = 0; byte < 4; ++byte) {
+                        digests[lanes[i].message][4 * word + byte] = (uint8_t) (state[word][i] >> (8 * byte));
+                    }
+                }
+                lanes[i].message = (size_t) -1;
+            }
+        }
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Files up to this size are hashed together by the multi-buffer kernel, the larger ones one by one
+#define MULTI_HASH_MAX_FILE_SIZE (64 * 1024)
+// Widest kernel: 8 lanes of 32 bits with AVX2
+#define MULTI_HASH_MAX_LANES 8
+
+int multi_hash_lanes(void);
+void md5_multi_buffer(const uint8_t **messages, const size_t *lengths, size_t count, uint8_t (*digests)[16]);
@@ -5,32 +5,80 @@
 #include <stdio.h>
 #include <messages.h>
 #include <file-properties.h>
+#include <checksum-cache.h>
+#include <shm-transport.h>
+#include <tree-walk.h>
+#include <async-io.h>
+#include <tree-hash.h>
+#include <streaming.h>
 #include <sync.h>
+#include <stats.h>
 #include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/wait.h>
+#include <signal.h>
 
 /*!
- * @brief prepare prepares (only when parallel is enabled) the processes used for the synchronization.
+ * @brief prepare prepares (only when parallel is enabled with processes) the processes used for the synchronization.
+ * It also opens the digests cache, sets the number of tree walkers, the hash algorithm, the tree hash chunks and io_uring before any fork, so that children inherit them.
+ * With --stats, the counters shared by all the processes are created here too ( @see start_stats ).
+ * In watch mode, children ignore SIGINT and SIGTERM, which only stop the watch of the main process.
  * @param the_config is a pointer to the program configuration
  * @param p_context is a pointer to the program processes context
  * @return 0 if all went good, -1 else
  */
 int prepare(configuration_t *the_config, process_context_t *p_context) {
-    if (the_config!=NULL && the_config->is_parallel==true){
-        if(the_config->is_verbose==true){
-            printf("Creation de la MSQ_Key\n");
+    if (the_config!=NULL){
+        set_tree_walkers(the_config->walkers_count);
+        set_async_io(the_config->uses_io_uring);
+        set_hash_algorithm(the_config->hash_algorithm);
+        set_tree_hash_chunk_size(the_config->tree_chunk_size);
+        if (the_config->is_watching){
+            //La surveillance s'arrête sur SIGINT ou SIGTERM : les fils ignorent ces signaux et attendent la commande de fin
+            signal(SIGINT,SIG_IGN);
+            signal(SIGTERM,SIG_IGN);
         }
-        p_context->shared_key= ftok("lp25-backup",49);
-        if (p_context->shared_key==-1){
-            printf("Erreur avec la MQKey\n");
-            return -1;
+        if (the_config->stats_path[0]!='\0' && start_stats()==-1){
+            printf("Les statistiques ne seront pas ecrites dans %s\n",the_config->stats_path);
         }
-        if(the_config->is_verbose==true){
-            printf("Ouverture de la MSQ\n");
+        if (the_config->uses_io_uring && !async_io_available()){
+            printf("io_uring n'est pas disponible, les appels systeme bloquants seront utilises\n");
         }
-        p_context->message_queue_id=msgget(p_context->shared_key,0666 |IPC_CREAT);
-        if (p_context->message_queue_id==-1){
-            printf("Erreur lors de la création de la MsgQueue\n");
-            return -1;
+    }
+    if (the_config!=NULL && the_config->cache_path[0]!='\0'){
+        if (open_checksum_cache(the_config->cache_path)==-1){
+            printf("Le cache %s ne peut pas etre utilise, les empreintes seront toutes calculees\n",the_config->cache_path);
+        }
+    }
+    if (the_config!=NULL && the_config->is_parallel==true && the_config->workers==WORKERS_PROCESSES){
+        if (the_config->transport==TRANSPORT_SHM){
+            if(the_config->is_verbose==true){
+                printf("Creation de la memoire partagee\n");
+            }
+            //Au plus un lot en cours par analyseur, plus les lots en attente pour le processus principal
+            if (create_shm_transport(4*the_config->processes_count+SHM_SPARE_BATCHES)==-1){
+                return -1;
+            }
+            p_context->shared_key=-1;
+            p_context->message_queue_id=-1;
+        }else{
+            if(the_config->is_verbose==true){
+                printf("Creation de la MSQ_Key\n");
+            }
+            p_context->shared_key= ftok("lp25-backup",49);
+            if (p_context->shared_key==-1){
+                printf("Erreur avec la MQKey\n");
+                return -1;
+            }
+            if(the_config->is_verbose==true){
+                printf("Ouverture de la MSQ\n");
+            }
+            p_context->message_queue_id=msgget(p_context->shared_key,0666 |IPC_CREAT);
+            if (p_context->message_queue_id==-1){
+                printf("Erreur lors de la création de la MsgQueue\n");
+                return -1;
+            }
         }
         p_context->main_process_pid=getpid();
         p_context->processes_count=0;
@@ -91,6 +139,7 @@ int prepare(configuration_t *the_config, process_context_t *p_context) {
  * @return the PID of the child process (it never returns in the child process)
  */
 int make_process(process_context_t *p_context, process_loop_t func, void *parameters) {
+    fflush(stdout); //Sinon le fils réafficherait ce qui est encore dans le tampon
     pid_t  child_pid = fork();
     if (child_pid==0){
         func(parameters);
@@ -101,80 +150,258 @@ int make_process(process_context_t *p_context, process_loop_t func, void *parame
     return child_pid;
 }
 
+/*!
+ * @brief send_files_to_analyze sends batches of files to analyze, as long as analyzers are available
+ * @param msq_id is the id of the MQ
+ * @param configuration is a pointer to the lister configuration
+ * @param list is a pointer to the list being analyzed
+ * @param cursor is a pointer to the next entry to send, updated as entries are sent
+ * @param remaining is a pointer to the number of entries not sent yet, updated as entries are sent
+ * @param in_flight is a pointer to the number of batches being analyzed, updated as batches are sent
+ * @param in_flight_bytes is a pointer to the size of the batches being analyzed, updated as batches are sent
+ */
+static void send_files_to_analyze(int msq_id, lister_configuration_t *configuration, files_list_t *list, files_list_entry_t **cursor, size_t *remaining, long *in_flight, size_t *in_flight_bytes) {
+    static entries_batch_t local_batch;
+    size_t budget = in_flight_budget();
+    while (*in_flight < configuration->analyzers_count && *cursor != NULL && (*in_flight == 0 || *in_flight_bytes < budget)) {
+        //Lots plus petits en fin de liste pour que tous les analyseurs aient du travail
+        size_t batch_size = (*remaining + configuration->analyzers_count - 1) / configuration->analyzers_count;
+        if (batch_size > MSG_ANALYZE_BATCH_ENTRIES) {
+            batch_size = MSG_ANALYZE_BATCH_ENTRIES;
+        }
+        entries_batch_t *batch = new_entries_batch(&local_batch, configuration->my_recipient_id, COMMAND_CODE_ANALYZE_FILE);
+        //L'entrée elle-même sert d'identifiant de la requête
+        while (*cursor != NULL && batch->entries_count < batch_size && (batch->entries_count == 0 || *in_flight_bytes + batch->data_length < budget)
+               && add_entry_to_batch(batch, *cursor, (uint64_t) (uintptr_t) *cursor, true)) {
+            *cursor = (*cursor)->next;
+            --*remaining;
+        }
+        if (batch->entries_count == 0) { //Chemin trop long pour un message : l'entrée est abandonnée
+            files_list_entry_t *too_long = *cursor;
+            *cursor = too_long->next;
+            --*remaining;
+            remove_file_entry(list, too_long);
+            release_batch(batch);
+            continue;
+        }
+        size_t batch_bytes = batch->data_length;
+        if (send_entries_batch(msq_id, batch, 0) != -1) {
+            ++*in_flight;
+            *in_flight_bytes += batch_bytes;
+        } else {
+            release_batch(batch);
+        }
+    }
+}
+
 /*!
  * @brief lister_process_loop is the lister process function (@see make_process)
  * @param parameters is a pointer to its parameters, to be cast to a lister_configuration_t
  */
 void lister_process_loop(void *parameters) {
-    files_list_t new_list;
-    new_list.head=NULL;
-    new_list.tail=NULL;
-    any_message_t message;
+    static any_message_t message;
+    static entries_batch_t local_batch;
+    //En mode flux, le répertoire suivant peut arriver pendant l'analyse du répertoire courant : il est gardé ici.
+    //Le processus principal n'envoie pas plus de STREAMING_DIRECTORIES_IN_FLIGHT répertoires sans leur fin de liste,
+    //le répertoire courant compris : les répertoires gardés tiennent toujours dans ce tableau
+    static analyze_dir_command_t pending_commands[STREAMING_DIRECTORIES_IN_FLIGHT];
+    int pending_count=0;
     lister_configuration_t* configuration= (lister_configuration_t*) parameters;
-    files_list_entry_t * file_without_detail;
-    files_list_entry_t * file_with_detail;
-    int msq_id=msgget(configuration->mq_key,0666);
-    long p_used=0;
+    int msq_id= shm_transport_enabled() ? -1 : msgget(configuration->mq_key,0666);
+    char S_or_D = (configuration->my_receiver_id == MSG_TYPE_TO_SOURCE_LISTER) ? 'S' : 'D';
+    register_stats_process((S_or_D=='S') ? STATS_ROLE_SOURCE_LISTER : STATS_ROLE_DESTINATION_LISTER);
 
     do{
-        if (msgrcv(msq_id,&message, sizeof(any_message_t)- sizeof(long),configuration->my_receiver_id,0)!=-1){
-            if (message.analyze_file_command.op_code==COMMAND_CODE_ANALYZE_DIR){
-                make_list(&new_list,message.analyze_dir_command.target);
-                file_without_detail= new_list.head;
-                file_with_detail= new_list.head;
-                while (file_without_detail!=NULL) {
-                    while (p_used < configuration->analyzers_count && file_without_detail != NULL) {
-                        send_analyze_file_command(msq_id,configuration->my_recipient_id,file_without_detail);
-                        file_without_detail=file_without_detail->next;
-                        ++p_used;
+        bool has_message;
+        if (pending_count>0){
+            message.analyze_dir_command=pending_commands[0];
+            memmove(pending_commands,pending_commands+1,(pending_count-1)*sizeof(analyze_dir_command_t));
+            --pending_count;
+            has_message=true;
+        }else{
+            has_message= (receive_message(msq_id,&message,configuration->my_receiver_id,0)!=-1);
+        }
+        if (has_message){
+            if (message.analyze_dir_command.op_code==COMMAND_CODE_ANALYZE_DIR || message.analyze_dir_command.op_code==COMMAND_CODE_ANALYZE_DIR_ENTRIES){
+                files_list_t new_list;
+                init_files_list(&new_list);
+                if (message.analyze_dir_command.op_code==COMMAND_CODE_ANALYZE_DIR){
+                    make_list(&new_list,message.analyze_dir_command.target);
+                }else{
+                    make_directory_list(&new_list,message.analyze_dir_command.target);
+                }
+
+                size_t remaining=0;
+                for (files_list_entry_t *cursor=new_list.head; cursor!=NULL; cursor=cursor->next){
+                    ++remaining;
+                }
+
+                //Chaque analyseur a au plus un lot en cours, et les lots en cours ne peuvent pas remplir la file
+                files_list_entry_t * file_without_detail= new_list.head;
+                long p_used=0;
+                size_t used_bytes=0;
+                send_files_to_analyze(msq_id,configuration,&new_list,&file_without_detail,&remaining,&p_used,&used_bytes);
+                while (p_used>0) {
+                    if (receive_message(msq_id,&message,configuration->my_receiver_id,0)==-1){
+                        continue;
                     }
-                    while (p_used>0){
-                        msgrcv(msq_id, &message,sizeof(any_message_t)- sizeof(long),configuration->my_receiver_id,0);
-                        memcpy(file_with_detail, &message.analyze_file_command.payload, sizeof(files_list_entry_t));
+                    if (message.analyze_dir_command.op_code==COMMAND_CODE_ANALYZE_DIR || message.analyze_dir_command.op_code==COMMAND_CODE_ANALYZE_DIR_ENTRIES){
+                        assert(pending_count<STREAMING_DIRECTORIES_IN_FLIGHT);
+                        pending_commands[pending_count++]=message.analyze_dir_command;
+                    }else if (message.entries_batch.op_code==COMMAND_CODE_FILE_ANALYZED){
+                        entries_batch_t *analyzed=received_batch(&message);
+                        for (file_entry_record_t *record=next_batch_record(analyzed,NULL); record!=NULL; record=next_batch_record(analyzed,record)){
+                            files_list_entry_t * file_with_detail= (files_list_entry_t *) (uintptr_t) record->request_id;
+                            if (record->is_ok){
+                                record_to_entry(record,file_with_detail);
+                            }else{
+                                remove_file_entry(&new_list,file_with_detail);
+                            }
+                        }
+                        used_bytes-=analyzed->data_length; //La réponse est la demande complétée : même taille
+                        release_batch(analyzed);
                         --p_used;
-                        file_with_detail=file_with_detail->next;
+                        send_files_to_analyze(msq_id,configuration,&new_list,&file_without_detail,&remaining,&p_used,&used_bytes);
                     }
                 }
-                while (file_with_detail->prev!=NULL){
-                    file_with_detail=file_with_detail->prev;
-                }
 
-                while (file_with_detail!=NULL){
-                    if (configuration->my_receiver_id ==MSG_TYPE_TO_SOURCE_LISTER){
-                        send_files_list_element(msq_id,MSG_TYPE_TO_MAIN,file_with_detail,'S');
-                    }else{
-                        send_files_list_element(msq_id,MSG_TYPE_TO_MAIN,file_with_detail,'D');
+                //Envoi de la liste au processus principal, par lots aussi gros que possible
+                char list_op_code=(S_or_D=='S') ? COMMAND_CODE_FILE_ENTRY_FOR_SOURCE : COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION;
+                entries_batch_t *list_batch=new_entries_batch(&local_batch,MSG_TYPE_TO_MAIN,list_op_code);
+                for (files_list_entry_t * file_with_detail= new_list.head; file_with_detail!=NULL; file_with_detail=file_with_detail->next){
+                    if (!add_entry_to_batch(list_batch,file_with_detail,0,true)){
+                        if (send_entries_batch(msq_id,list_batch,0)==-1){
+                            release_batch(list_batch);
+                        }
+                        list_batch=new_entries_batch(&local_batch,MSG_TYPE_TO_MAIN,list_op_code);
+                        add_entry_to_batch(list_batch,file_with_detail,0,true);
                     }
-                    file_with_detail=file_with_detail->next;
                 }
-                if (configuration->my_receiver_id==MSG_TYPE_TO_SOURCE_LISTER){
-                    send_list_end(msq_id,MSG_TYPE_TO_MAIN,'S');
-                }else{
-                    send_list_end(msq_id,MSG_TYPE_TO_MAIN,'D');
+                if (list_batch->entries_count==0 || send_entries_batch(msq_id,list_batch,0)==-1){
+                    release_batch(list_batch);
                 }
+                send_list_end(msq_id,MSG_TYPE_TO_MAIN,S_or_D);
+                clear_files_list(&new_list);
             }
         }
     }while (message.simple_command.message!=COMMAND_CODE_TERMINATE);
+    end_stats_process();
     send_terminate_confirm(msq_id,MSG_TYPE_TO_MAIN);
     exit(EXIT_SUCCESS);
 }
 
+/*!
+ * @brief hash_requested_files computes the sample digests or the digests of the files of a request of the main process
+ * The answers are written in the records of the request: the digest, or the sample digest in the first bytes of the digest.
+ * @param batch is a pointer to the received batch
+ * @param is_sample selects the sample digests (true) or the digests (false)
+ */
+static void hash_requested_files(entries_batch_t *batch, bool is_sample){
+    uint8_t flag=is_sample ? ENTRY_HAS_SAMPLE : ENTRY_HAS_DIGEST;
+    file_entry_record_t *record=next_batch_record(batch,NULL);
+    while (record!=NULL){
+        files_list_entry_t entries[FILE_STATS_BATCH];
+        files_list_entry_t *entries_pointers[FILE_STATS_BATCH];
+        file_entry_record_t *records[FILE_STATS_BATCH];
+        size_t count=0;
+        for (; record!=NULL && count<FILE_STATS_BATCH; record=next_batch_record(batch,record), ++count){
+            memset(&entries[count],0,sizeof(entries[count]));
+            record_to_entry(record,&entries[count]);
+            entries[count].path_and_name=record->path;
+            entries[count].path_length=record->path_length;
+            entries_pointers[count]=&entries[count];
+            records[count]=record;
+        }
+        if (is_sample){
+            compute_entries_samples(entries_pointers,count);
+        }else{
+            compute_entries_digests(entries_pointers,count);
+        }
+        for (size_t i=0; i<count; ++i){
+            records[i]->is_ok=(entries[i].digest_flags & flag)!=0;
+            if (is_sample){
+                memcpy(records[i]->digest,&entries[i].sample_digest,sizeof(entries[i].sample_digest));
+            }else{
+                memcpy(records[i]->digest,entries[i].digest,sizeof(records[i]->digest));
+            }
+            free_chunk_digests(entries[i].chunks);
+        }
+    }
+}
+
+/*!
+ * @brief hash_requested_chunks computes the digests of the chunks of a request of the main process
+ * The digest of each chunk replaces its range in its record.
+ * @param batch is a pointer to the received batch
+ */
+static void hash_requested_chunks(entries_batch_t *batch){
+    for (file_entry_record_t *record=next_batch_record(batch,NULL); record!=NULL; record=next_batch_record(batch,record)){
+        uint8_t digest[HASH_MAX_DIGEST_SIZE]={0};
+        record->is_ok=(compute_range_digest(record->path,record->chunk.offset,record->chunk.length,digest)==0);
+        memcpy(record->digest,digest,sizeof(record->digest));
+    }
+}
+
 /*!
  * @brief analyzer_process_loop is the analyzer process function
  * @param parameters is a pointer to its parameters, to be cast to an analyzer_configuration_t
  */
 void analyzer_process_loop(void *parameters) {
+    static any_message_t message;
     analyzer_configuration_t* configuration=(analyzer_configuration_t*) parameters;
-    any_message_t message;
-    int msq_id=msgget(configuration->mq_key,0666);
+    int msq_id= shm_transport_enabled() ? -1 : msgget(configuration->mq_key,0666);
+    register_stats_process((configuration->my_receiver_id==MSG_TYPE_TO_SOURCE_ANALYZERS) ? STATS_ROLE_SOURCE_ANALYZER : STATS_ROLE_DESTINATION_ANALYZER);
     do{
-        if (msgrcv(msq_id, &message, sizeof(any_message_t)- sizeof(long),configuration->my_receiver_id,0)!=-1){
-            if (message.analyze_file_command.op_code==COMMAND_CODE_ANALYZE_FILE){
-                get_file_stats(&message.analyze_file_command.payload);
-                send_analyze_file_command(msq_id,configuration->my_recipient_id,&message.analyze_file_command.payload);
+        if (receive_message(msq_id,&message,configuration->my_receiver_id,0)!=-1){
+            if (message.entries_batch.op_code==COMMAND_CODE_ANALYZE_FILE){
+                //La réponse est écrite dans le lot reçu : les chemins y sont déjà et ne sont pas recopiés
+                entries_batch_t *batch=received_batch(&message);
+                //Les entrées sont analysées par groupes, dont les requêtes sont envoyées ensemble avec io_uring
+                file_entry_record_t *record=next_batch_record(batch,NULL);
+                while (record!=NULL){
+                    files_list_entry_t entries[FILE_STATS_BATCH];
+                    files_list_entry_t *entries_pointers[FILE_STATS_BATCH];
+                    file_entry_record_t *records[FILE_STATS_BATCH];
+                    bool is_ok[FILE_STATS_BATCH];
+                    size_t count=0;
+                    for (; record!=NULL && count<FILE_STATS_BATCH; record=next_batch_record(batch,record), ++count){
+                        memset(&entries[count],0,sizeof(entries[count]));
+                        entries[count].path_and_name=record->path;
+                        entries[count].path_length=record->path_length;
+                        entries_pointers[count]=&entries[count];
+                        records[count]=record;
+                    }
+                    get_entries_stats(entries_pointers,count,is_ok);
+                    for (size_t i=0; i<count; ++i){
+                        entry_to_record(&entries[i],records[i],is_ok[i]);
+                    }
+                }
+                batch->mtype=configuration->my_recipient_id;
+                batch->op_code=COMMAND_CODE_FILE_ANALYZED;
+                send_entries_batch(msq_id,batch,0);
+                add_stat(STATS_ANALYZED_BATCHES,1);
+            }else if (message.entries_batch.op_code==COMMAND_CODE_SAMPLE_FILES || message.entries_batch.op_code==COMMAND_CODE_DIGEST_FILES){
+                //Empreintes demandées par le processus principal pendant la comparaison, renvoyées dans le lot reçu
+                uint64_t start_ns=stats_now();
+                entries_batch_t *batch=received_batch(&message);
+                hash_requested_files(batch,batch->op_code==COMMAND_CODE_SAMPLE_FILES);
+                add_stat_since(STATS_HASHING_NS,start_ns);
+                batch->mtype=MSG_TYPE_TO_MAIN;
+                batch->op_code=COMMAND_CODE_FILES_HASHED;
+                send_entries_batch(msq_id,batch,0);
+            }else if (message.entries_batch.op_code==COMMAND_CODE_DIGEST_CHUNKS){
+                //Morceaux des fichiers hachés en arbre : un gros fichier est réparti entre tous les analyseurs
+                uint64_t start_ns=stats_now();
+                entries_batch_t *batch=received_batch(&message);
+                hash_requested_chunks(batch);
+                add_stat_since(STATS_HASHING_NS,start_ns);
+                batch->mtype=MSG_TYPE_TO_MAIN;
+                batch->op_code=COMMAND_CODE_FILES_HASHED;
+                send_entries_batch(msq_id,batch,0);
             }
         }
     }while (message.simple_command.message!= COMMAND_CODE_TERMINATE);
+    end_stats_process();
     send_terminate_confirm(msq_id,MSG_TYPE_TO_MAIN);
 }
 
@@ -185,34 +412,45 @@ void analyzer_process_loop(void *parameters) {
  */
 void clean_processes(configuration_t *the_config, process_context_t *p_context) {
     if(the_config!=NULL && p_context!=NULL){
-        if(the_config->is_parallel!=false){
+        if(the_config->is_parallel!=false && the_config->workers==WORKERS_PROCESSES){
             any_message_t message;
             long nbr_message=0;
             //Envoie des messages terminaux au processus lister
             if(the_config->is_verbose==true){
-                printf("Envoie des messages terminaux au processus lister");
+                printf("Envoie des messages terminaux au processus lister\n");
             }
             send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_SOURCE_LISTER);
             send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_DESTINATION_LISTER);
             //Boucle pour envoie des messages terminaux à tous les processus analyseurs
             if(the_config->is_verbose==true){
-                printf("Envoie des messages terminaux au processus");
+                printf("Envoie des messages terminaux au processus analyseurs\n");
             }
-            for (int i = 0; i < p_context->processes_count; ++i) {
-                send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_SOURCE_LISTER);
-                send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_DESTINATION_LISTER);
+            for (int i = 0; i < the_config->processes_count; ++i) {
+                send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_SOURCE_ANALYZERS);
+                send_terminate_command(p_context->message_queue_id,MSG_TYPE_TO_DESTINATION_ANALYZERS);
             }
-            //Attente de reception de tous les messages de confirmation de fermeture
-            while (nbr_message<(p_context->processes_count*2)+2){
-                if(msgrcv(p_context->message_queue_id,&message, sizeof(any_message_t)- sizeof(long),MSG_TYPE_TO_MAIN,0)!=-1){
+            //Attente de reception de tous les messages de confirmation de fermeture (un par processus créé)
+            while (nbr_message<p_context->processes_count){
+                if(receive_message(p_context->message_queue_id,&message,MSG_TYPE_TO_MAIN,0)!=-1){
                     ++nbr_message;
                 }
             }
+            //Attente de la fin des processus fils
+            while (wait(NULL)>0);
             //Liberation de la mémoire
             free(p_context->source_analyzers_pids);
             free(p_context->destination_analyzers_pids);
-            //Fermeture de la MSQ
-            msgctl(p_context->message_queue_id,IPC_RMID,NULL);
+            //Fermeture de la MSQ ou de la mémoire partagée
+            if (shm_transport_enabled()){
+                destroy_shm_transport();
+            }else{
+                msgctl(p_context->message_queue_id,IPC_RMID,NULL);
+            }
+        }
+        //Tous les analyseurs sont terminés : le cache peut être compacté, et leurs compteurs sont complets
+        close_checksum_cache(true);
+        if (stats_enabled() && write_stats_report(the_config->stats_path,the_config)==-1){
+            printf("Erreur lors de l'ecriture des statistiques dans %s\n",the_config->stats_path);
         }
     }else{
         printf("Error for cleaning processes");
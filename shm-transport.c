@@ -0,0 +1,275 @@
+#include <shm-transport.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/ipc.h>
+
+// Functions in this file implement a transport in a shared memory region, as an alternative to the SysV MQ.
+// The region is mapped before the fork, so all the processes share it. It holds:
+// - one ring per message type: variable-length messages, each preceded by its size, protected by a
+//   process-shared mutex, with condition variables to wait for data or for room;
+// - a table of batches: a lister fills a batch in place, only its index crosses the ring, and the
+//   analyzer writes its results into the same batch before sending the index back.
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t read_position;
+    size_t used;
+    char data[SHM_RING_CAPACITY];
+} shm_ring_t;
+
+typedef struct {
+    shm_ring_t rings[SHM_RINGS_COUNT];
+    pthread_mutex_t batches_mutex;
+    pthread_cond_t batch_released;
+    uint32_t batches_count;
+    uint32_t free_count;
+    uint32_t free_batches[]; // Followed by the batches themselves ( @see batch_table )
+} shm_region_t;
+
+static shm_region_t *region = NULL;
+static size_t region_size = 0;
+static entries_batch_t *batch_table = NULL;
+
+/*!
+ * @brief init_shared_sync initializes a mutex and condition variables usable across processes
+ * @param mutex is a pointer to the mutex
+ * @param first is a pointer to a first condition variable
+ * @param second is a pointer to a second condition variable, may be NULL
+ * @return 0 in case of success, -1 else
+ */
+static int init_shared_sync(pthread_mutex_t *mutex, pthread_cond_t *first, pthread_cond_t *second) {
+    pthread_mutexattr_t mutex_attributes;
+    pthread_condattr_t cond_attributes;
+    int result = 0;
+
+    pthread_mutexattr_init(&mutex_attributes);
+    pthread_mutexattr_setpshared(&mutex_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_init(&cond_attributes);
+    pthread_condattr_setpshared(&cond_attributes, PTHREAD_PROCESS_SHARED);
+
+    if (pthread_mutex_init(mutex, &mutex_attributes) != 0 || pthread_cond_init(first, &cond_attributes) != 0
+        || (second != NULL && pthread_cond_init(second, &cond_attributes) != 0)) {
+        result = -1;
+    }
+    pthread_mutexattr_destroy(&mutex_attributes);
+    pthread_condattr_destroy(&cond_attributes);
+    return result;
+}
+
+/*!
+ * @brief create_shm_transport maps the shared region, must be called before the processes are created
+ * @param batches_count is the number of batches of the shared table (at most one per batch in flight)
+ * @return 0 in case of success, -1 else
+ */
+int create_shm_transport(int batches_count) {
+    size_t table_offset = (sizeof(shm_region_t) + sizeof(uint32_t) * batches_count + 63) & ~(size_t) 63;
+    region_size = table_offset + sizeof(entries_batch_t) * batches_count;
+    region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        region = NULL;
+        perror("Erreur lors de la creation de la memoire partagee");
+        return -1;
+    }
+    batch_table = (entries_batch_t *) ((char *) region + table_offset);
+
+    for (int i = 0; i < SHM_RINGS_COUNT; ++i) {
+        region->rings[i].read_position = 0;
+        region->rings[i].used = 0;
+        if (init_shared_sync(&region->rings[i].mutex, &region->rings[i].not_empty, &region->rings[i].not_full) == -1) {
+            destroy_shm_transport();
+            return -1;
+        }
+    }
+    if (init_shared_sync(&region->batches_mutex, &region->batch_released, NULL) == -1) {
+        destroy_shm_transport();
+        return -1;
+    }
+    region->batches_count = batches_count;
+    region->free_count = batches_count;
+    for (int i = 0; i < batches_count; ++i) {
+        region->free_batches[i] = i;
+    }
+    return 0;
+}
+
+/*!
+ * @brief shm_transport_enabled tells which transport is used
+ * @return true when the shared memory transport is used, false for the MQ
+ */
+bool shm_transport_enabled(void) {
+    return region != NULL;
+}
+
+/*!
+ * @brief ring_copy copies bytes into or out of a ring, wrapping at its end
+ * @param ring is a pointer to the ring
+ * @param position is the position in the ring of the first byte
+ * @param buffer is the buffer to copy from (is_write) or to
+ * @param size is the number of bytes
+ * @param is_write gives the direction of the copy
+ */
+static void ring_copy(shm_ring_t *ring, size_t position, void *buffer, size_t size, bool is_write) {
+    size_t first_part = SHM_RING_CAPACITY - position;
+    if (first_part > size) {
+        first_part = size;
+    }
+    if (is_write) {
+        memcpy(ring->data + position, buffer, first_part);
+        memcpy(ring->data, (char *) buffer + first_part, size - first_part);
+    } else {
+        memcpy(buffer, ring->data + position, first_part);
+        memcpy((char *) buffer + first_part, ring->data, size - first_part);
+    }
+}
+
+/*!
+ * @brief shm_send sends a message, like msgsnd
+ * @param message is a pointer to the message, starting with its mtype
+ * @param size is the size of the message without its mtype (as for msgsnd)
+ * @param msg_flags IPC_NOWAIT not to block on a full ring
+ * @return 0 in case of success, -1 else (errno EAGAIN when the ring is full with IPC_NOWAIT)
+ */
+int shm_send(const void *message, size_t size, int msg_flags) {
+    long msg_type = *(const long *) message;
+    if (region == NULL || msg_type <= 0 || msg_type >= SHM_RINGS_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+    shm_ring_t *ring = &region->rings[msg_type];
+    size_t total_size = sizeof(size_t) + size;
+    if (total_size > SHM_RING_CAPACITY) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    pthread_mutex_lock(&ring->mutex);
+    while (SHM_RING_CAPACITY - ring->used < total_size) {
+        if (msg_flags & IPC_NOWAIT) {
+            pthread_mutex_unlock(&ring->mutex);
+            errno = EAGAIN;
+            return -1;
+        }
+        pthread_cond_wait(&ring->not_full, &ring->mutex);
+    }
+    size_t write_position = (ring->read_position + ring->used) % SHM_RING_CAPACITY;
+    ring_copy(ring, write_position, &size, sizeof(size_t), true);
+    ring_copy(ring, (write_position + sizeof(size_t)) % SHM_RING_CAPACITY, (char *) message + sizeof(long), size, true);
+    ring->used += total_size;
+    pthread_cond_signal(&ring->not_empty);
+    pthread_mutex_unlock(&ring->mutex);
+    return 0;
+}
+
+/*!
+ * @brief shm_receive receives a message, like msgrcv
+ * @param message is a pointer to the buffer for the message, starting with its mtype
+ * @param max_size is the size of the buffer without its mtype (as for msgrcv)
+ * @param msg_type is the type of the message to receive (must be > 0)
+ * @param msg_flags IPC_NOWAIT not to block on an empty ring
+ * @return the size of the received message, -1 in case of error (errno ENOMSG for an empty ring with IPC_NOWAIT)
+ */
+ssize_t shm_receive(void *message, size_t max_size, long msg_type, int msg_flags) {
+    if (region == NULL || msg_type <= 0 || msg_type >= SHM_RINGS_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+    shm_ring_t *ring = &region->rings[msg_type];
+
+    pthread_mutex_lock(&ring->mutex);
+    while (ring->used == 0) {
+        if (msg_flags & IPC_NOWAIT) {
+            pthread_mutex_unlock(&ring->mutex);
+            errno = ENOMSG;
+            return -1;
+        }
+        pthread_cond_wait(&ring->not_empty, &ring->mutex);
+    }
+    size_t size;
+    ring_copy(ring, ring->read_position, &size, sizeof(size_t), false);
+    size_t copied_size = (size < max_size) ? size : max_size;
+    ring_copy(ring, (ring->read_position + sizeof(size_t)) % SHM_RING_CAPACITY, (char *) message + sizeof(long), copied_size, false);
+    ring->read_position = (ring->read_position + sizeof(size_t) + size) % SHM_RING_CAPACITY;
+    ring->used -= sizeof(size_t) + size;
+    pthread_cond_broadcast(&ring->not_full); // Plusieurs producteurs peuvent attendre des tailles différentes
+    pthread_mutex_unlock(&ring->mutex);
+
+    *(long *) message = msg_type;
+    return copied_size;
+}
+
+/*!
+ * @brief shm_acquire_batch takes a free batch from the shared table, waiting for one if needed
+ * @return a pointer to the batch, NULL if the transport is not enabled
+ */
+entries_batch_t *shm_acquire_batch(void) {
+    if (region == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&region->batches_mutex);
+    while (region->free_count == 0) {
+        pthread_cond_wait(&region->batch_released, &region->batches_mutex);
+    }
+    uint32_t batch_index = region->free_batches[--region->free_count];
+    pthread_mutex_unlock(&region->batches_mutex);
+    return &batch_table[batch_index];
+}
+
+/*!
+ * @brief shm_release_batch gives a batch back to the shared table
+ * @param batch is a pointer to the batch, obtained with shm_acquire_batch
+ */
+void shm_release_batch(entries_batch_t *batch) {
+    if (!shm_is_shared_batch(batch)) {
+        return;
+    }
+    pthread_mutex_lock(&region->batches_mutex);
+    region->free_batches[region->free_count++] = shm_batch_index(batch);
+    pthread_cond_signal(&region->batch_released);
+    pthread_mutex_unlock(&region->batches_mutex);
+}
+
+/*!
+ * @brief shm_is_shared_batch tells if a batch is in the shared table
+ * @param batch is a pointer to the batch
+ * @return true if the batch is in the shared table, false else
+ */
+bool shm_is_shared_batch(entries_batch_t *batch) {
+    return region != NULL && batch >= batch_table && batch < batch_table + region->batches_count;
+}
+
+/*!
+ * @brief shm_batch_index gives the index of a shared batch, the only thing sent through the rings
+ * @param batch is a pointer to a batch of the shared table
+ * @return its index
+ */
+uint32_t shm_batch_index(entries_batch_t *batch) {
+    return batch - batch_table;
+}
+
+/*!
+ * @brief shm_batch_at gives the shared batch of an index received through a ring
+ * @param batch_index is the index of the batch
+ * @return a pointer to the batch, NULL if the index is not valid
+ */
+entries_batch_t *shm_batch_at(uint32_t batch_index) {
+    if (region == NULL || batch_index >= region->batches_count) {
+        return NULL;
+    }
+    return &batch_table[batch_index];
+}
+
+/*!
+ * @brief destroy_shm_transport unmaps the shared region (once all the processes are done)
+ */
+void destroy_shm_transport(void) {
+    if (region != NULL) {
+        munmap(region, region_size);
+        region = NULL;
+        batch_table = NULL;
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <messages.h>
+
+// One ring per message type (mtype 1 to SHM_RINGS_COUNT - 1), like the topics of the MQ
+#define SHM_RINGS_COUNT 6
+#define SHM_RING_CAPACITY (1024 * 1024)
+// Batches of the shared table beyond the ones in flight between listers and analyzers
+#define SHM_SPARE_BATCHES 16
+
+int create_shm_transport(int batches_count);
+bool shm_transport_enabled(void);
+int shm_send(const void *message, size_t size, int msg_flags);
+ssize_t shm_receive(void *message, size_t max_size, long msg_type, int msg_flags);
+entries_batch_t *shm_acquire_batch(void);
+void shm_release_batch(entries_batch_t *batch);
+bool shm_is_shared_batch(entries_batch_t *batch);
+uint32_t shm_batch_index(entries_batch_t *batch);
+entries_batch_t *shm_batch_at(uint32_t batch_index);
+void destroy_shm_transport(void);
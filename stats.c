@@ -0,0 +1,176 @@
+#include <stats.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Functions in this file gather the counters of a run with --stats, in every process. The counters live in
+// a shared anonymous mapping created before the forks: each process takes its own slot when it starts
+// ( @see register_stats_process ), so that it adds to its counters without lock nor message, and the
+// main process reads all of them once its children have ended. The threads of a process share its slot
+// (atomic additions). Without --stats, every function returns at once.
+
+typedef struct {
+    uint32_t processes_count;
+    process_stats_t processes[STATS_MAX_PROCESSES];
+} shared_stats_t;
+
+static shared_stats_t *shared_stats = NULL;
+static process_stats_t *my_stats = NULL;
+
+static const char *roles_names[] = {"main", "source_lister", "destination_lister", "source_analyzer", "destination_analyzer"};
+
+/*!
+ * @brief stats_now gives the monotonic time used by the counters
+ * @return the time in nanoseconds, 0 when the stats are disabled (the clock is not read)
+ */
+uint64_t stats_now(void) {
+    if (my_stats == NULL) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*!
+ * @brief start_stats creates the counters shared by all the processes, it must be called before the forks
+ * The calling process takes the first slot, as the main process.
+ * @return 0 in case of success, -1 else (the stats stay disabled)
+ */
+int start_stats(void) {
+    shared_stats_t *stats = mmap(NULL, sizeof(shared_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    memset(stats, 0, sizeof(shared_stats_t));
+    shared_stats = stats;
+    shared_stats->processes_count = 1;
+    my_stats = &shared_stats->processes[0];
+    my_stats->pid = getpid();
+    my_stats->role = STATS_ROLE_MAIN;
+    my_stats->start_ns = stats_now();
+    return 0;
+}
+
+/*!
+ * @brief stats_enabled tells if the counters are gathered
+ * @return true with --stats, false else
+ */
+bool stats_enabled(void) {
+    return my_stats != NULL;
+}
+
+/*!
+ * @brief register_stats_process gives its own slot to a child process, it must be called when it starts
+ * @param role is the role of the process
+ */
+void register_stats_process(stats_role_t role) {
+    if (shared_stats == NULL) {
+        return;
+    }
+    uint32_t index = __atomic_fetch_add(&shared_stats->processes_count, 1, __ATOMIC_RELAXED);
+    if (index >= STATS_MAX_PROCESSES) { // Slot commun aux derniers processus
+        my_stats = &shared_stats->processes[STATS_MAX_PROCESSES - 1];
+        return;
+    }
+    my_stats = &shared_stats->processes[index];
+    my_stats->pid = getpid();
+    my_stats->role = role;
+    my_stats->start_ns = stats_now();
+}
+
+/*!
+ * @brief end_stats_process records the end of the process, for its utilisation
+ */
+void end_stats_process(void) {
+    if (my_stats != NULL) {
+        my_stats->end_ns = stats_now();
+    }
+}
+
+/*!
+ * @brief add_stat adds a value to a counter of the process
+ * @param counter is the counter
+ * @param value is the value to add
+ */
+void add_stat(stats_counter_t counter, uint64_t value) {
+    if (my_stats != NULL) {
+        __atomic_add_fetch(&my_stats->counters[counter], value, __ATOMIC_RELAXED);
+    }
+}
+
+/*!
+ * @brief add_stat_since adds the time elapsed since a start to a counter of the process
+ * @param counter is the counter, in nanoseconds
+ * @param start_ns is the start, given by stats_now
+ */
+void add_stat_since(stats_counter_t counter, uint64_t start_ns) {
+    if (my_stats != NULL) {
+        add_stat(counter, stats_now() - start_ns);
+    }
+}
+
+/*!
+ * @brief write_stats_report writes the counters of all the processes as JSON, it must be called once the children have ended
+ * @param path is the path of the report
+ * @param the_config is a pointer to the configuration
+ * @return 0 in case of success, -1 else
+ */
+int write_stats_report(char *path, configuration_t *the_config) {
+    if (shared_stats == NULL) {
+        return -1;
+    }
+    FILE *report = fopen(path, "w");
+    if (report == NULL) {
+        perror(path);
+        return -1;
+    }
+    shared_stats->processes[0].end_ns = stats_now();
+    uint32_t count = (shared_stats->processes_count < STATS_MAX_PROCESSES) ? shared_stats->processes_count : STATS_MAX_PROCESSES;
+    uint64_t totals[STATS_COUNTERS_COUNT] = {0};
+    for (uint32_t i = 0; i < count; ++i) {
+        for (int c = 0; c < STATS_COUNTERS_COUNT; ++c) {
+            totals[c] += shared_stats->processes[i].counters[c];
+        }
+    }
+
+    fprintf(report, "{\n  \"configuration\": {\"parallel\": %s, \"workers\": \"%s\", \"transport\": \"%s\", \"processes\": %u, "
+                    "\"digests\": %s, \"hash\": \"%s\"},\n",
+            the_config->is_parallel ? "true" : "false", (the_config->workers == WORKERS_THREADS) ? "threads" : "processes",
+            (the_config->transport == TRANSPORT_SHM) ? "shm" : "mq", (unsigned) the_config->processes_count,
+            the_config->uses_md5 ? "true" : "false", hash_algorithm_name(the_config->hash_algorithm));
+    //Listage et analyse : temps cumulé de tous les processus et threads ; les autres phases : temps du processus principal
+    fprintf(report, "  \"phases_seconds\": {\"lists\": %.6f, \"listing\": %.6f, \"analysis\": %.6f, \"diff\": %.6f, \"copy\": %.6f, \"total\": %.6f},\n",
+            totals[STATS_LISTS_NS] / 1e9, totals[STATS_LISTING_NS] / 1e9, totals[STATS_ANALYSIS_NS] / 1e9, totals[STATS_DIFF_NS] / 1e9,
+            totals[STATS_COPY_NS] / 1e9, totals[STATS_TOTAL_NS] / 1e9);
+    fprintf(report, "  \"entries\": {\"files\": %lu, \"directories\": %lu, \"others\": %lu},\n", (unsigned long) totals[STATS_FILES],
+            (unsigned long) totals[STATS_DIRECTORIES], (unsigned long) totals[STATS_OTHER_ENTRIES]);
+    fprintf(report, "  \"bytes\": {\"hashed\": %lu, \"sampled\": %lu, \"copied\": %lu, \"copied_files\": %lu},\n",
+            (unsigned long) totals[STATS_HASHED_BYTES], (unsigned long) totals[STATS_SAMPLED_BYTES], (unsigned long) totals[STATS_COPIED_BYTES],
+            (unsigned long) totals[STATS_COPIED_FILES]);
+    fprintf(report, "  \"ipc\": {\"messages_sent\": %lu, \"bytes_sent\": %lu, \"messages_received\": %lu, \"bytes_received\": %lu},\n",
+            (unsigned long) totals[STATS_MESSAGES_SENT], (unsigned long) totals[STATS_BYTES_SENT], (unsigned long) totals[STATS_MESSAGES_RECEIVED],
+            (unsigned long) totals[STATS_BYTES_RECEIVED]);
+
+    fprintf(report, "  \"processes\": [\n");
+    for (uint32_t i = 0; i < count; ++i) {
+        process_stats_t *process = &shared_stats->processes[i];
+        uint64_t lifetime = (process->end_ns > process->start_ns) ? process->end_ns - process->start_ns : 0;
+        //Utilisation : part de sa durée de vie qu'un processus passe à lister, à analyser ou à calculer des empreintes
+        uint64_t busy = process->counters[STATS_LISTING_NS] + process->counters[STATS_ANALYSIS_NS] + process->counters[STATS_HASHING_NS];
+        fprintf(report, "    {\"pid\": %d, \"role\": \"%s\", \"seconds\": %.6f, \"busy_seconds\": %.6f, \"utilisation\": %.4f, "
+                        "\"batches\": %lu, \"files\": %lu, \"directories\": %lu, \"messages_sent\": %lu, \"bytes_sent\": %lu, "
+                        "\"messages_received\": %lu, \"bytes_received\": %lu}%s\n",
+                (int) process->pid, roles_names[process->role], lifetime / 1e9, busy / 1e9, (lifetime > 0) ? (double) busy / lifetime : 0.0,
+                (unsigned long) process->counters[STATS_ANALYZED_BATCHES], (unsigned long) process->counters[STATS_FILES],
+                (unsigned long) process->counters[STATS_DIRECTORIES], (unsigned long) process->counters[STATS_MESSAGES_SENT],
+                (unsigned long) process->counters[STATS_BYTES_SENT], (unsigned long) process->counters[STATS_MESSAGES_RECEIVED],
+                (unsigned long) process->counters[STATS_BYTES_RECEIVED], (i + 1 < count) ? "," : "");
+    }
+    fprintf(report, "  ]\n}\n");
+    return (fclose(report) == 0) ? 0 : -1;
+}
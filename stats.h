@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <configuration.h>
+
+// Processes with their own counters, the next ones share the last slot
+#define STATS_MAX_PROCESSES 64
+
+typedef enum {STATS_ROLE_MAIN, STATS_ROLE_SOURCE_LISTER, STATS_ROLE_DESTINATION_LISTER, STATS_ROLE_SOURCE_ANALYZER, STATS_ROLE_DESTINATION_ANALYZER} stats_role_t;
+
+typedef enum {
+    STATS_LISTING_NS, // Listing of the directories ( @see make_list )
+    STATS_ANALYSIS_NS, // Stats of the entries ( @see get_entries_stats )
+    STATS_HASHING_NS, // Digests computed by an analyzer process for the main process ( @see request_digests )
+    STATS_DIFF_NS, // Comparison of the lists ( @see diff_files_lists )
+    STATS_LISTS_NS, // Wall time of the main process until both lists are made (listing and analysis)
+    STATS_COPY_NS, // Wall time of the main process from the first copy to the end of the last one
+    STATS_TOTAL_NS, // Wall time of the synchronization
+    STATS_FILES, // Entries analyzed, by type
+    STATS_DIRECTORIES,
+    STATS_OTHER_ENTRIES,
+    STATS_ANALYZED_BATCHES, // Batches of entries analyzed by an analyzer process
+    STATS_HASHED_BYTES, // Bytes read for the digests of whole files or of chunks
+    STATS_SAMPLED_BYTES, // Bytes read for the sample digests
+    STATS_COPIED_FILES,
+    STATS_COPIED_BYTES,
+    STATS_MESSAGES_SENT, // Messages between the processes, through the MQ or the shared memory
+    STATS_BYTES_SENT,
+    STATS_MESSAGES_RECEIVED,
+    STATS_BYTES_RECEIVED,
+    STATS_COUNTERS_COUNT
+} stats_counter_t;
+
+typedef struct {
+    pid_t pid;
+    stats_role_t role;
+    uint64_t start_ns; // Monotonic times of the start and of the end of the process
+    uint64_t end_ns;
+    uint64_t counters[STATS_COUNTERS_COUNT];
+} process_stats_t;
+
+int start_stats(void);
+bool stats_enabled(void);
+void register_stats_process(stats_role_t role);
+void end_stats_process(void);
+uint64_t stats_now(void);
+void add_stat(stats_counter_t counter, uint64_t value);
+void add_stat_since(stats_counter_t counter, uint64_t start_ns);
+int write_stats_report(char *path, configuration_t *the_config);
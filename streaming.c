@@ -0,0 +1,246 @@
+#include <streaming.h>
+#include <sync.h>
+#include <messages.h>
+#include <digest-requests.h>
+#include <utility.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/msg.h>
+
+// Functions in this file implement the streaming mode: instead of waiting for both whole trees,
+// the main process asks the listers for one directory at a time. A directory is compared (and its
+// differences copied) as soon as both sides have sent it, while the listers and analyzers already
+// work on the next directories. The subdirectories found in the source are asked for in turn; new
+// ones are only listed on the source side, the destination has nothing there yet.
+
+#define SOURCE_SIDE 0
+#define DESTINATION_SIDE 1
+
+typedef struct _stream_directory {
+    char *relative_path; // From the roots of the source and of the destination, "" for the roots themselves
+    bool needs_destination; // False when the directory does not exist in the destination
+    bool is_listed[2]; // By the source and destination listers
+    files_list_t lists[2];
+    struct _stream_directory *next[2]; // In the waiting or in flight FIFO of each side
+} stream_directory_t;
+
+typedef struct {
+    stream_directory_t *head;
+    stream_directory_t *tail;
+    int count;
+} stream_fifo_t;
+
+typedef struct {
+    configuration_t *the_config;
+    stream_fifo_t waiting[2]; // Not sent to the lister yet
+    stream_fifo_t in_flight[2]; // Sent to the lister, in the order it answers
+    size_t directories_left; // Directories not compared yet
+    diff_summary_t summary;
+    bool is_failed;
+} stream_state_t;
+
+/*!
+ * @brief fifo_push adds a directory at the end of a FIFO of one side
+ * @param fifo is a pointer to the FIFO
+ * @param directory is a pointer to the directory
+ * @param side is SOURCE_SIDE or DESTINATION_SIDE
+ */
+static void fifo_push(stream_fifo_t *fifo, stream_directory_t *directory, int side) {
+    directory->next[side] = NULL;
+    if (fifo->tail != NULL) {
+        fifo->tail->next[side] = directory;
+    } else {
+        fifo->head = directory;
+    }
+    fifo->tail = directory;
+    ++fifo->count;
+}
+
+/*!
+ * @brief fifo_pop removes the first directory of a FIFO of one side
+ * @param fifo is a pointer to the FIFO
+ * @param side is SOURCE_SIDE or DESTINATION_SIDE
+ * @return the directory, NULL if the FIFO is empty
+ */
+static stream_directory_t *fifo_pop(stream_fifo_t *fifo, int side) {
+    stream_directory_t *directory = fifo->head;
+    if (directory != NULL) {
+        fifo->head = directory->next[side];
+        if (fifo->head == NULL) {
+            fifo->tail = NULL;
+        }
+        --fifo->count;
+    }
+    return directory;
+}
+
+/*!
+ * @brief add_directory creates a directory to stream and puts it in the waiting FIFOs
+ * @param state is a pointer to the streaming state
+ * @param relative_path is the path of the directory, relative to the roots
+ * @param needs_destination tells if the destination lister must list it too
+ */
+static void add_directory(stream_state_t *state, char *relative_path, bool needs_destination) {
+    stream_directory_t *directory = malloc(sizeof(stream_directory_t));
+    if (directory == NULL || (directory->relative_path = strdup(relative_path)) == NULL) {
+        printf("Erreur lors de l'allocation de mémoire pour le repertoire %s\n", relative_path);
+        free(directory);
+        state->is_failed = true;
+        return;
+    }
+    directory->needs_destination = needs_destination;
+    directory->is_listed[SOURCE_SIDE] = false;
+    directory->is_listed[DESTINATION_SIDE] = !needs_destination;
+    init_files_list(&directory->lists[SOURCE_SIDE]);
+    init_files_list(&directory->lists[DESTINATION_SIDE]);
+    fifo_push(&state->waiting[SOURCE_SIDE], directory, SOURCE_SIDE);
+    if (needs_destination) {
+        fifo_push(&state->waiting[DESTINATION_SIDE], directory, DESTINATION_SIDE);
+    }
+    ++state->directories_left;
+}
+
+/*!
+ * @brief stream_difference applies a difference, then asks for the content of the subdirectories
+ * @param result is the result of the comparison for this path
+ * @param source_entry is the source entry (NULL for entries only present in the destination)
+ * @param destination_entry is the destination entry (NULL for new entries)
+ * @param parameters is a pointer to the streaming state
+ */
+static void stream_difference(diff_result_t result, files_list_entry_t *source_entry, files_list_entry_t *destination_entry, void *parameters) {
+    stream_state_t *state = (stream_state_t *) parameters;
+    apply_difference(result, source_entry, destination_entry, state->the_config);
+    // Le répertoire est créé dans la destination avant que son contenu ne soit demandé
+    if (source_entry != NULL && source_entry->entry_type == DOSSIER) {
+        add_directory(state, source_entry->path_and_name + path_root_length(state->the_config->source), destination_entry != NULL);
+    }
+}
+
+/*!
+ * @brief compare_directory compares a directory listed by both sides and frees it
+ * @param state is a pointer to the streaming state
+ * @param directory is a pointer to the directory
+ */
+static void compare_directory(stream_state_t *state, stream_directory_t *directory) {
+    diff_summary_t summary;
+    diff_files_lists(&directory->lists[SOURCE_SIDE], &directory->lists[DESTINATION_SIDE], path_root_length(state->the_config->source),
+                     path_root_length(state->the_config->destination), state->the_config->uses_md5, state->the_config->is_content_always_compared, stream_difference, state, &summary);
+    state->summary.new_count += summary.new_count;
+    state->summary.changed_count += summary.changed_count;
+    state->summary.metadata_count += summary.metadata_count;
+    state->summary.identical_count += summary.identical_count;
+    state->summary.extra_count += summary.extra_count;
+
+    clear_files_list(&directory->lists[SOURCE_SIDE]);
+    clear_files_list(&directory->lists[DESTINATION_SIDE]);
+    free(directory->relative_path);
+    free(directory);
+    --state->directories_left;
+}
+
+/*!
+ * @brief send_directories sends the waiting directories to a lister, up to STREAMING_DIRECTORIES_IN_FLIGHT
+ * The commands are sent without blocking: with a full queue, they are sent after the next reception.
+ * @param state is a pointer to the streaming state
+ * @param msg_queue is the id of the MQ
+ * @param side is SOURCE_SIDE or DESTINATION_SIDE
+ */
+static void send_directories(stream_state_t *state, int msg_queue, int side) {
+    char *root = (side == SOURCE_SIDE) ? state->the_config->source : state->the_config->destination;
+    long lister = (side == SOURCE_SIDE) ? MSG_TYPE_TO_SOURCE_LISTER : MSG_TYPE_TO_DESTINATION_LISTER;
+    while (state->waiting[side].head != NULL && state->in_flight[side].count < STREAMING_DIRECTORIES_IN_FLIGHT) {
+        stream_directory_t *directory = state->waiting[side].head;
+        char target[PATH_SIZE];
+        if (concat_path(target, root, directory->relative_path) == NULL) {
+            printf("Chemin trop long : %s/%s\n", root, directory->relative_path);
+            state->is_failed = true;
+            return;
+        }
+        if (send_analyze_dir_command(msg_queue, lister, target, false, IPC_NOWAIT) == -1) {
+            if (errno != EAGAIN) {
+                perror("Erreur lors de l'envoi d'une commande a un listeur");
+                state->is_failed = true;
+            }
+            return;
+        }
+        fifo_pop(&state->waiting[side], side);
+        fifo_push(&state->in_flight[side], directory, side);
+    }
+}
+
+/*!
+ * @brief synchronize_streaming synchronizes the destination directory by directory, with the lister and analyzer processes
+ * It also prints the changes in dry-run mode, as synchronize does.
+ * @param the_config is a pointer to the configuration
+ * @param p_context is a pointer to the processes context
+ * @param summary is a pointer to the counters of each result of the comparisons
+ */
+void synchronize_streaming(configuration_t *the_config, process_context_t *p_context, diff_summary_t *summary) {
+    static any_message_t message;
+    int msg_queue = p_context->message_queue_id;
+    stream_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.the_config = the_config;
+    add_directory(&state, "", true);
+
+    while (state.directories_left > 0 && !state.is_failed) {
+        send_directories(&state, msg_queue, SOURCE_SIDE);
+        send_directories(&state, msg_queue, DESTINATION_SIDE);
+        if (state.is_failed) {
+            break;
+        }
+
+        //Les listes reçues pendant que les analyseurs calculaient des empreintes sont données d'abord
+        if (receive_main_message(msg_queue, &message, 0) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur lors de la reception des listes");
+            break;
+        }
+        int side = SOURCE_SIDE;
+        bool is_complete = false;
+        switch (message.entries_batch.op_code) {
+            case COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION:
+                side = DESTINATION_SIDE;
+                // fall through
+            case COMMAND_CODE_FILE_ENTRY_FOR_SOURCE: {
+                //Un listeur traite ses répertoires dans l'ordre : les entrées sont celles du plus ancien en cours
+                entries_batch_t *batch = received_batch(&message);
+                if (state.in_flight[side].head != NULL) {
+                    files_list_t *list = &state.in_flight[side].head->lists[side];
+                    for (file_entry_record_t *record = next_batch_record(batch, NULL); record != NULL; record = next_batch_record(batch, record)) {
+                        files_list_entry_t *new_entry = append_file_entry(list, record->path, record->path_length);
+                        if (new_entry != NULL) {
+                            record_to_entry(record, new_entry);
+                        }
+                    }
+                }
+                release_batch(batch);
+                break;
+            }
+            case COMMAND_CODE_LIST_COMPLETE_FOR_DESTINATION:
+                side = DESTINATION_SIDE;
+                // fall through
+            case COMMAND_CODE_LIST_COMPLETE_FOR_SOURCE:
+                is_complete = true;
+                break;
+        }
+        if (is_complete) {
+            stream_directory_t *directory = fifo_pop(&state.in_flight[side], side);
+            if (directory != NULL) {
+                directory->is_listed[side] = true;
+                if (directory->is_listed[SOURCE_SIDE] && directory->is_listed[DESTINATION_SIDE]) {
+                    compare_directory(&state, directory);
+                }
+            }
+        }
+    }
+
+    if (state.directories_left > 0) {
+        printf("Synchronisation interrompue : %lu repertoire(s) non traite(s)\n", (unsigned long) state.directories_left);
+    }
+    *summary = state.summary;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <configuration.h>
+#include <processes.h>
+#include <diff.h>
+
+// Directories a lister may have to list at once: the next one is ready when it finishes the current one
+#define STREAMING_DIRECTORIES_IN_FLIGHT 2
+
+void synchronize_streaming(configuration_t *the_config, process_context_t *p_context, diff_summary_t *summary);
@@ -5,9 +5,22 @@
 #include "utility.h"
 #include "messages.h"
 #include "file-properties.h"
+#include "diff.h"
+#include "digest-requests.h"
+#include "thread-pool.h"
+#include "tree-walk.h"
+#include "streaming.h"
+#include "copy-pool.h"
+#include "copy-engine.h"
+#include "delta.h"
+#include "checksum-cache.h"
+#include "watch.h"
+#include "hardlinks.h"
+#include "dedup.h"
+#include "moves.h"
+#include "stats.h"
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/sendfile.h>
 #include <unistd.h>
 #include <sys/msg.h>
 
@@ -15,204 +28,496 @@
 
 //Bibliothèques rajoutées pour pouvoir utiliser free() et utiliser les structures de mtime et utiliser l'attente wait()
 #include <stdlib.h>
-#include <utime.h>
 #include <sys/wait.h>
+#include <errno.h>
 
-#define MAX_PATH_SIZE 5121
-//Calculée selon la taille des différents string : 1024+1+4096
+
+// Time of the first change applied to the destination (0 before it), reported in verbose mode
+static double first_copy_time = 0;
+// Copies checked with --verify-copy, those whose data differed from the analyzed source, and those without a source digest
+static uint64_t verified_copies = 0;
+static uint64_t mismatched_copies = 0;
+static uint64_t unchecked_copies = 0;
+
+
+/*!
+ * @brief destination_path_of gives the path in the destination of a source entry
+ * @param destination_path receives the path, it must hold PATH_SIZE bytes
+ * @param source_entry is a pointer to the source entry
+ * @param the_config is a pointer to the configuration
+ * @return 0 in case of success, -1 else (the path is too long)
+ */
+static int destination_path_of(char *destination_path, files_list_entry_t *source_entry, configuration_t *the_config) {
+    //Le chemin de l'entrée contient déjà la racine source
+    if (concat_path(destination_path, the_config->destination, source_entry->path_and_name + path_root_length(the_config->source)) == NULL) {
+        printf("Chemin de destination trop long pour %s\n", source_entry->path_and_name);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief set_destination_metadata gives a destination file the mode and mtime of its source
+ * @param destination_path is the path of the destination file
+ * @param source_entry is a pointer to the source entry
+ */
+void set_destination_metadata(char *destination_path, files_list_entry_t *source_entry) {
+    //Modification des droits d'accès du fichier destination
+    chmod(destination_path, source_entry->mode);
+
+    //Modification du mtime dans la destination (à la nanoseconde près)
+    struct timespec times[2];
+    times[0] = source_entry->mtime; // Access time same as source
+    times[1] = source_entry->mtime; // Modification time same as source
+    utimensat(AT_FDCWD, destination_path, times, 0);
+}
+
+/*!
+ * @brief separate_destination_file gives a destination file with other names (hard links) an inode of its own, with the same content
+ * The copy replaces this name only: the other names keep the old inode, which an update of this name in place would change too.
+ * @param destination_path is the path of the destination file
+ * @return 0 in case of success or when the file has no other name, -1 else
+ */
+int separate_destination_file(char *destination_path) {
+    struct stat destination_stat;
+    if (lstat(destination_path, &destination_stat) == -1 || !S_ISREG(destination_stat.st_mode) || destination_stat.st_nlink <= 1) {
+        return 0;
+    }
+    char temporary_path[PATH_SIZE];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.lp25-link-XXXXXX", destination_path) >= (int) sizeof(temporary_path)) {
+        return -1;
+    }
+    int old_fd = open(destination_path, O_RDONLY);
+    if (old_fd == -1) {
+        return -1;
+    }
+    int temporary_fd = mkstemp(temporary_path);
+    if (temporary_fd == -1) {
+        close(old_fd);
+        return -1;
+    }
+    int result = copy_file_contents(old_fd, temporary_fd, NULL);
+    close(old_fd);
+    if (close(temporary_fd) == -1) {
+        result = -1;
+    }
+    if (result == 0) {
+        result = rename(temporary_path, destination_path);
+    }
+    if (result == -1) {
+        perror(destination_path);
+        unlink(temporary_path);
+    }
+    return result;
+}
+
+/*!
+ * @brief store_destination_digest adds the digest of a destination file that was just written or updated to the cache
+ * @param destination_path is the path of the destination file
+ * @param digest is the digest of its content
+ */
+void store_destination_digest(char *destination_path, uint8_t *digest) {
+    struct stat destination_stat;
+    if (stat(destination_path, &destination_stat) == 0) {
+        checksum_cache_key_t cache_key;
+        make_checksum_cache_key(&destination_stat, &cache_key);
+        checksum_cache_store_copy(&cache_key, digest);
+    }
+}
+
+/*!
+ * @brief update_destination_metadata updates the mode and mtime of a destination file whose content is the one of the source
+ * @param source_entry is a pointer to the source entry, whose digest is known
+ * @param the_config is a pointer to the configuration
+ */
+static void update_destination_metadata(files_list_entry_t *source_entry, configuration_t *the_config) {
+    char destination_path[PATH_SIZE];
+    if (destination_path_of(destination_path, source_entry, the_config) == -1) {
+        return;
+    }
+    //Destination liée à d'autres noms : ils gardent leurs métadonnées ( @see apply_hardlinks pour ceux que la source partage)
+    if (separate_destination_file(destination_path) == -1) {
+        return;
+    }
+    set_destination_metadata(destination_path, source_entry);
+    //Le ctime de la destination a changé : son empreinte est enregistrée avec sa nouvelle clé
+    store_destination_digest(destination_path, source_entry->digest);
+    if (the_config->is_verbose) {
+        printf("Metadonnees de %s mises a jour\n", source_entry->path_and_name);
+    }
+}
+
+/*!
+ * @brief apply_difference is the diff handler used by synchronize to update the destination
+ * @param result is the result of the comparison for this path
+ * @param source_entry is the source entry (NULL for entries only present in the destination)
+ * @param destination_entry is the destination entry (NULL for new entries)
+ * @param parameters is a pointer to the configuration
+ */
+void apply_difference(diff_result_t result, files_list_entry_t *source_entry, files_list_entry_t *destination_entry, void *parameters) {
+    configuration_t *the_config = (configuration_t *) parameters;
+
+    //Liens physiques : seul le premier nom d'un inode est copié ou mis à jour, les autres seront liés à sa copie
+    //(la copie ou la mise à jour d'un nom remplace son inode de la destination, il n'est plus partagé)
+    char destination_path[PATH_SIZE];
+    if (!the_config->is_dry_run && source_entry != NULL && source_entry->links_count > 1
+        && destination_path_of(destination_path, source_entry, the_config) == 0) {
+        if (result == DIFF_NEW || result == DIFF_CHANGED || result == DIFF_METADATA) {
+            if (defer_hardlink(source_entry, destination_path)) {
+                return;
+            }
+        } else {
+            note_hardlink(source_entry, destination_path);
+        }
+    }
+
+    //Déplacements : un nouveau fichier peut être un fichier en trop de la destination, renommé une fois la comparaison terminée
+    if (!the_config->is_dry_run && the_config->is_detecting_moves) {
+        if (source_entry == NULL && note_move_origin(destination_entry, the_config)) {
+            return;
+        }
+        if (result == DIFF_NEW && destination_path_of(destination_path, source_entry, the_config) == 0
+            && defer_moved_copy(source_entry, destination_path, the_config)) {
+            return;
+        }
+    }
+
+    //Déduplication : un fichier à copier dont le contenu est déjà dans la destination y sera lié
+    if (!the_config->is_dry_run && the_config->dedup_mode != DEDUP_NONE) {
+        if (source_entry == NULL) {
+            note_dedup_content(destination_entry, destination_entry->path_and_name, the_config);
+        } else if (destination_path_of(destination_path, source_entry, the_config) == 0) {
+            if (result == DIFF_NEW || result == DIFF_CHANGED) {
+                if (defer_dedup_copy(source_entry, destination_path, the_config)) {
+                    return;
+                }
+            } else {
+                note_dedup_content(source_entry, destination_path, the_config);
+            }
+        }
+    }
+
+    if (result != DIFF_NEW && result != DIFF_CHANGED && result != DIFF_METADATA) { // Rien à faire pour les fichiers identiques ou en trop
+        return;
+    }
+    if (first_copy_time == 0) {
+        first_copy_time = monotonic_seconds();
+    }
+
+    if (the_config->is_dry_run) {
+        printf("%s %s\n", (result == DIFF_NEW) ? "Nouveau :" : (result == DIFF_CHANGED) ? "Modifie :" : "Metadonnees :",
+               source_entry->path_and_name + path_root_length(the_config->source));
+    } else if (result == DIFF_METADATA) {
+        update_destination_metadata(source_entry, the_config);
+    } else {
+        submit_copy(source_entry, the_config);
+    }
+}
 
 
 /*!
  * @brief synchronize is the main function for synchronization
- * It will build the lists (source and destination), then make a third list with differences (???), and apply differences to the destination
- * It must adapt to the parallel or not operation of the program.
+ * It synchronizes both trees once ( @see synchronize_trees ), or keeps on synchronizing the changes
+ * of the source in watch mode ( @see watch_source ).
  * @param the_config is a pointer to the configuration
  * @param p_context is a pointer to the processes context
  */
 void synchronize(configuration_t *the_config, process_context_t *p_context) {
-    //1&2 - Construction listes source et destination
-    files_list_t source_list, dest_list;
-
-    if (! the_config->is_parallel) {
-        //Si mode parallèle désactivé
-        make_files_list(&source_list, the_config->source);
-        make_files_list(&dest_list, the_config->destination);
+    if (the_config->is_watching) {
+        watch_source(the_config, p_context);
     } else {
-        //Si mode parallèle activé
-        make_files_lists_parallel(&source_list, &dest_list, the_config, p_context->message_queue_id);
+        synchronize_trees(the_config, p_context);
     }
+}
 
-    //3 - Vérification des différences : parcourir la liste des sources et synchroniser les fichiers
-
-    files_list_entry_t *current_entry = source_list.head;
-    files_list_entry_t *current_dest; //= dest_list.head;  Définie autrement après
 
-    while (current_entry != NULL) {
-        // Trouver l'entrée correspondante dans la liste de destination
-        files_list_entry_t *current_dest = find_entry_by_name(&dest_list, current_entry->path_and_name, 0 ,0);
+/*!
+ * @brief start_content_hashing chooses who computes the digests of the compared files, on demand
+ * In the processes mode, the analyzers do it once the lists are made ( @see request_digests ); with threads,
+ * as many threads as analyzers; without parallelism, the main thread.
+ * @param the_config is a pointer to the configuration
+ * @param p_context is a pointer to the processes context
+ */
+static void start_content_hashing(configuration_t *the_config, process_context_t *p_context) {
+    if (the_config->is_parallel && the_config->workers == WORKERS_PROCESSES) {
+        start_content_checks(0);
+        start_digest_requests(p_context->message_queue_id, the_config->processes_count);
+    } else if (start_content_checks(the_config->is_parallel ? the_config->processes_count : 0) == -1) {
+        printf("Impossible de creer les threads de calcul des empreintes, elles seront calculees sans parallelisme\n");
+    }
+}
 
-        if (current_dest == NULL) {
-            //Si l'entrée n'existe pas dans la liste de destination, copier le fichier
-            copy_entry_to_destination(current_entry, the_config);
+/*!
+ * @brief synchronize_trees synchronizes the whole trees
+ * It will build the lists (source and destination), then compare them with a single merge-join pass
+ * ( @see diff_files_lists ), and apply differences to the destination
+ * It must adapt to the parallel or not operation of the program.
+ * @param the_config is a pointer to the configuration
+ * @param p_context is a pointer to the processes context
+ */
+void synchronize_trees(configuration_t *the_config, process_context_t *p_context) {
+    double start_time = monotonic_seconds();
+    diff_summary_t summary;
+    copy_pool_summary_t copy_summary;
+    first_copy_time = 0;
+    verified_copies = 0;
+    mismatched_copies = 0;
+    unchecked_copies = 0;
+    init_copy_pool(the_config);
+    start_content_hashing(the_config, p_context);
+
+    if (the_config->is_streaming && the_config->is_parallel && the_config->workers == WORKERS_PROCESSES) {
+        //Mode flux : chaque répertoire est comparé et copié dès que les deux listeurs l'ont envoyé
+        synchronize_streaming(the_config, p_context, &summary);
+    } else {
+        //1&2 - Construction listes source et destination
+        files_list_t source_list, dest_list;
+        init_files_list(&source_list);
+        init_files_list(&dest_list);
+
+        uint64_t lists_start = stats_now();
+        if (! the_config->is_parallel) {
+            //Si mode parallèle désactivé
+            make_files_list(&source_list, the_config->source);
+            make_files_list(&dest_list, the_config->destination);
+        } else if (the_config->workers == WORKERS_THREADS) {
+            //Si mode parallèle avec des threads
+            make_files_lists_threaded(&source_list, &dest_list, the_config);
         } else {
-            //Comparer les attributs du fichier et recopier le fichier si besoin
-            if (mismatch(current_entry, current_dest, the_config->uses_md5)) {
-                copy_entry_to_destination(current_entry, the_config);
-            }
+            //Si mode parallèle activé
+            make_files_lists_parallel(&source_list, &dest_list, the_config, p_context->message_queue_id);
         }
+        add_stat_since(STATS_LISTS_NS, lists_start);
 
-        current_entry = current_entry->next;
-    }
+        //3 - Comparaison des deux listes en un seul parcours et application des différences
+        diff_files_lists(&source_list, &dest_list, path_root_length(the_config->source), path_root_length(the_config->destination),
+                         the_config->uses_md5, the_config->is_content_always_compared, apply_difference, the_config, &summary);
 
-    //Libération des listes créées
-    if (&source_list != NULL) {
-        // Libérer la mémoire pour chaque entrée de la liste
-        files_list_entry_t *current = source_list.head;
-        while (current != NULL) {
-            files_list_entry_t *next = current->next;
-            free(current);
-            current = next;
+        //Libération des listes créées (toutes les entrées d'une liste sont libérées d'un coup avec son arène)
+        clear_files_list(&source_list);
+        clear_files_list(&dest_list);
+
+        if (the_config->is_verbose) {
+            printf("Memoire maximale des listes : source %lu Kio, destination %lu Kio\n",
+                   (unsigned long) (files_list_memory_peak(&source_list) / 1024), (unsigned long) (files_list_memory_peak(&dest_list) / 1024));
         }
+    }
 
-        // Libérer la mémoire pour la structure de la liste
-        free(&source_list);
+    //Attente des copies encore en cours dans les threads de copie, puis création des liens vers elles
+    moves_summary_t moves_summary;
+    apply_moves(the_config, &moves_summary);
+    submit_dedup_copies(the_config);
+    finish_copy_pool(&copy_summary);
+    dedup_summary_t dedup_summary;
+    link_dedup_copies(the_config, &dedup_summary);
+    hardlinks_summary_t hardlinks_summary;
+    apply_hardlinks(the_config, &hardlinks_summary);
+    uint64_t samples_count, digests_count;
+    stop_content_checks(&samples_count, &digests_count);
+    stop_digest_requests();
+    if (stats_enabled()) {
+        add_stat(STATS_COPIED_FILES, copy_summary.small_copies + copy_summary.large_copies);
+        add_stat(STATS_COPIED_BYTES, copy_summary.copied_bytes);
+        add_stat(STATS_COPY_NS, (first_copy_time != 0) ? (uint64_t) ((monotonic_seconds() - first_copy_time) * 1e9) : 0);
+        add_stat(STATS_TOTAL_NS, (uint64_t) ((monotonic_seconds() - start_time) * 1e9));
     }
 
-    if (&dest_list != NULL) {
-        // Libérer la mémoire pour chaque entrée de la liste
-        files_list_entry_t *current = dest_list.head;
-        while (current != NULL) {
-            files_list_entry_t *next = current->next;
-            free(current);
-            current = next;
+    if (the_config->is_verbose) {
+        printf("Comparaison terminee : %lu nouveau(x), %lu modifie(s), %lu metadonnees seules, %lu identique(s), %lu en trop dans la destination\n",
+               (unsigned long) summary.new_count, (unsigned long) summary.changed_count, (unsigned long) summary.metadata_count,
+               (unsigned long) summary.identical_count, (unsigned long) summary.extra_count);
+        printf("Empreintes calculees a la demande : %lu echantillon(s), %lu complete(s)\n", (unsigned long) samples_count, (unsigned long) digests_count);
+        if (first_copy_time != 0) {
+            printf("Premiere copie apres %.3f s\n", first_copy_time - start_time);
         }
+        printf("Fichiers copies : %lu petit(s), %lu gros, %lu octets\n", (unsigned long) copy_summary.small_copies,
+               (unsigned long) copy_summary.large_copies, (unsigned long) copy_summary.copied_bytes);
+        uint64_t method_counts[COPY_METHODS_COUNT];
+        get_copy_method_counts(method_counts);
+        printf("Methodes de copie :");
+        for (int i = 0; i < COPY_METHODS_COUNT; ++i) {
+            printf(" %s %lu%s", copy_method_name(i), (unsigned long) method_counts[i], (i + 1 < COPY_METHODS_COUNT) ? "," : "\n");
+        }
+        if (hardlinks_summary.linked_files > 0 || hardlinks_summary.copied_files > 0) {
+            printf("Liens physiques recrees : %lu fichier(s), %lu octets non copies, %lu lien(s) impossible(s) copie(s)\n",
+                   (unsigned long) hardlinks_summary.linked_files, (unsigned long) hardlinks_summary.saved_bytes,
+                   (unsigned long) hardlinks_summary.copied_files);
+        }
+        if (the_config->is_detecting_moves) {
+            printf("Deplacements : %lu fichier(s) renomme(s), %lu octets non copies, %lu repertoire(s) vide(s) supprime(s)\n",
+                   (unsigned long) moves_summary.moved_files, (unsigned long) moves_summary.saved_bytes,
+                   (unsigned long) moves_summary.removed_directories);
+        }
+        if (the_config->dedup_mode != DEDUP_NONE) {
+            uint64_t written_bytes = dedup_summary.candidate_bytes - dedup_summary.shared_bytes;
+            printf("Deduplication : %lu lie(s), %lu reflink(s), %lu copie(s) locale(s), %lu collision(s), ratio %.2f\n",
+                   (unsigned long) dedup_summary.linked_files, (unsigned long) dedup_summary.reflinked_files,
+                   (unsigned long) dedup_summary.local_copies, (unsigned long) dedup_summary.collisions,
+                   (written_bytes > 0) ? (double) dedup_summary.candidate_bytes / written_bytes : 1.0);
+        }
+        delta_summary_t delta_summary;
+        get_delta_summary(&delta_summary);
+        if (delta_summary.files > 0) {
+            printf("Copies par difference : %lu fichier(s), %lu octets reecrits, %lu octets economises\n", (unsigned long) delta_summary.files,
+                   (unsigned long) delta_summary.written_bytes, (unsigned long) delta_summary.saved_bytes);
+        }
+        if (the_config->is_copy_verified) {
+            printf("Copies verifiees : %lu conforme(s), %lu differente(s) de la source analysee, %lu sans empreinte de la source\n",
+                   (unsigned long) verified_copies, (unsigned long) mismatched_copies, (unsigned long) unchecked_copies);
+        }
+        printf("Duree totale de la synchronisation : %.3f s\n", monotonic_seconds() - start_time);
+    }
+}
+
+/*!
+ * @brief synchronize_paths synchronizes only some directories of the source, as synchronize_trees does for the whole trees
+ * The lists are made by the main process: they only hold the changed directories.
+ * @param the_config is a pointer to the configuration
+ * @param p_context is a pointer to the processes context
+ * @param paths is an array of directories relative to the source, parents first ( @see watch_source )
+ * @param count is the number of directories
+ */
+void synchronize_paths(configuration_t *the_config, process_context_t *p_context, dirty_path_t *paths, size_t count) {
+    double start_time = monotonic_seconds();
+    diff_summary_t total;
+    memset(&total, 0, sizeof(total));
+    init_copy_pool(the_config);
+    start_content_hashing(the_config, p_context);
+
+    for (size_t i = 0; i < count; ++i) {
+        char source_path[PATH_SIZE];
+        char destination_path[PATH_SIZE];
+        if (concat_path(source_path, the_config->source, paths[i].path) == NULL
+            || concat_path(destination_path, the_config->destination, paths[i].path) == NULL) {
+            continue;
+        }
+        if (!directory_exists(source_path)) {
+            continue; // Supprimé depuis : rien à copier
+        }
+
+        //Listes limitées au répertoire (ou au sous-arbre d'un nouveau répertoire), comparées comme les arborescences complètes
+        files_list_t source_list, dest_list;
+        init_files_list(&source_list);
+        init_files_list(&dest_list);
+        bool has_destination = directory_exists(destination_path);
+        if (paths[i].is_recursive) {
+            make_files_list(&source_list, source_path);
+            if (has_destination) {
+                make_files_list(&dest_list, destination_path);
+            }
+        } else {
+            make_directory_list(&source_list, source_path);
+            get_files_list_stats(&source_list);
+            if (has_destination) {
+                make_directory_list(&dest_list, destination_path);
+                get_files_list_stats(&dest_list);
+            }
+        }
+        diff_summary_t summary;
+        diff_files_lists(&source_list, &dest_list, path_root_length(the_config->source), path_root_length(the_config->destination),
+                         the_config->uses_md5, the_config->is_content_always_compared, apply_difference, the_config, &summary);
+        total.new_count += summary.new_count;
+        total.changed_count += summary.changed_count;
+        total.metadata_count += summary.metadata_count;
+        clear_files_list(&source_list);
+        clear_files_list(&dest_list);
+    }
 
-        // Libérer la mémoire pour la structure de la liste
-        free(&dest_list);
+    apply_moves(the_config, NULL);
+    submit_dedup_copies(the_config);
+    finish_copy_pool(NULL);
+    link_dedup_copies(the_config, NULL);
+    apply_hardlinks(the_config, NULL);
+    stop_content_checks(NULL, NULL);
+    stop_digest_requests();
+    if (the_config->is_verbose) {
+        printf("Synchronisation de %lu repertoire(s) modifie(s) : %lu nouveau(x), %lu modifie(s), %lu metadonnees seules en %.3f s\n",
+               (unsigned long) count, (unsigned long) total.new_count, (unsigned long) total.changed_count,
+               (unsigned long) total.metadata_count, monotonic_seconds() - start_time);
     }
 }
 
 /*!
  * @brief mismatch tests if two files with the same name (one in source, one in destination) are equal
+ * It only uses what the entries already hold: the contents are compared by diff_files_lists, which computes the digests they need.
  * @param lhd a files list entry from the source
  * @param rhd a files list entry from the destination
- * @param has_md5 a value to enable or disable MD5 sum check
+ * @param has_md5 a value to enable or disable the check of the digests, when both are known
  * @return true if both files are not equal, false else
  */
 bool mismatch(files_list_entry_t *lhd, files_list_entry_t *rhd, bool has_md5) {
     if ((lhd == NULL) || (rhd == NULL)) {                               //Cas des structures vides
         printf("Error : the definition of source and/or destination file(s) is null.");
         return true;
-    } else {
-        int retour_erreurs;
-        bool etat_comparaison = false;              //Variable qui contient le booléen du match entre les 2 fichiers (false = fichiers équivalents, true sinon)
-
-        //Définition pointeurs éléments fichiers actuellement traités dans boucle while
-        files_list_entry_t *pointeur_l = lhd;
-        files_list_entry_t *pointeur_r = rhd;
-
-        while ((pointeur_l != NULL) && (pointeur_r != NULL)) {
-            //Vérification de chacun des attributs et comparaison + enregistrement dans etat_comparaison (booléen utilisant le connecteur "et" associé à l'addition).
-            etat_comparaison += !(pointeur_l->entry_type == pointeur_r->entry_type);
-            etat_comparaison += !(pointeur_l->mode == pointeur_r->mode);
-            etat_comparaison += !(pointeur_l->mtime.tv_nsec == pointeur_r->mtime.tv_nsec);
-            etat_comparaison += !(pointeur_l->size == pointeur_r->size);
-            if (has_md5) {
-                etat_comparaison += !(pointeur_l->md5sum == pointeur_r->md5sum);
-            }
-
-            return etat_comparaison;
-        }
     }
-    return false;
+    //Vérification de chacun des attributs (false = fichiers équivalents, true sinon)
+    bool etat_comparaison = lhd->entry_type != rhd->entry_type || lhd->mode != rhd->mode || lhd->size != rhd->size
+                            || lhd->mtime.tv_sec != rhd->mtime.tv_sec || lhd->mtime.tv_nsec != rhd->mtime.tv_nsec;
+    if (has_md5 && lhd->entry_type == FICHIER && (lhd->digest_flags & ENTRY_HAS_DIGEST) && (rhd->digest_flags & ENTRY_HAS_DIGEST)) {
+        etat_comparaison = etat_comparaison || (memcmp(lhd->digest, rhd->digest, sizeof(lhd->digest)) != 0);
+    }
+    return etat_comparaison;
 }
 
 
 /*!
  * @brief make_files_list buils a files list in no parallel mode
+ * The paths are listed by make_list, then each entry gets its properties;
+ * entries that cannot be analyzed are dropped from the list.
  * @param list is a pointer to the list that will be built
  * @param target_path is the path whose files to list
  */
 void make_files_list(files_list_t *list, char *target_path) {
-    // Ouvrir le répertoire donné
-    DIR *directory = open_dir(target_path);
-
-    struct dirent *entry;
-
-    // Parcourir chaque fichier du répertoire
-    while ((entry = get_next_entry(directory)) != NULL) {
-        // Construire le chemin complet du fichier
-        char file_path[4096];
-        //snprintf(file_path, sizeof(file_path), "%s/%s", target_path, entry->d_name);
-        concat_path(file_path, target_path, entry->d_name);
-
-        // Obtenir les stats sur le fichier
-        struct stat file_stat;
-        if (lstat(file_path, &file_stat) == -1) {
-            printf("Erreur lors de l'obtention des informations sur le fichier.");
-            continue;
-        }
+    make_list(list, target_path);
+    get_files_list_stats(list);
+}
 
-        // Vérifier si le fichier est un répertoire ou un fichier ordinaire
-        if (! S_ISDIR(file_stat.st_mode) || ! S_ISREG(file_stat.st_mode)) {
-            continue;
-        }
 
-        // Allouer de la mémoire pour une nouvelle entrée de la liste
-        files_list_entry_t *new_entry = malloc(sizeof(files_list_entry_t));
-        if (new_entry == NULL) {
-            printf("Erreur lors de l'allocation de mémoire lors de la constitution de la liste de fichiers.");
-            closedir(directory);
-            return;
-        }
-
-        // Initialiser les champs de la nouvelle entrée
-        strcpy(new_entry->path_and_name, file_path);
-        if (new_entry->path_and_name == NULL) {
-            printf("Erreur lors de l'allocation de mémoire.");
-            free(new_entry);
-            closedir(directory);
-            return;
+/*!
+ * @brief get_files_list_stats gets the properties of all the entries of a list, dropping the ones that cannot be analyzed
+ * @param list is a pointer to the list
+ */
+void get_files_list_stats(files_list_t *list) {
+    files_list_entry_t *entry = list->head;
+    while (entry != NULL) {
+        //Récupération informations sur les fichiers, par groupes (envoyés ensemble avec io_uring)
+        files_list_entry_t *entries[FILE_STATS_BATCH];
+        bool is_ok[FILE_STATS_BATCH];
+        size_t count = 0;
+        for (; entry != NULL && count < FILE_STATS_BATCH; entry = entry->next) {
+            entries[count++] = entry;
         }
-
-        //Récupération informations sur le fichier
-        if (get_file_stats(new_entry) == -1) {
-            //Si erreur venant de get_file_stats, message erreur et free variable créée
-            printf("Erreur lors de l'obtention des informations du fichier.");
-            free(new_entry);
-            continue;
+        get_entries_stats(entries, count, is_ok);
+        for (size_t i = 0; i < count; ++i) {
+            if (!is_ok[i]) {
+                //Si erreur venant de get_file_stats, message erreur et retrait de l'entrée
+                printf("Erreur lors de l'obtention des informations du fichier.");
+                remove_file_entry(list, entries[i]);
+            }
         }
+    }
+}
 
-        // Ajouter la nouvelle entrée fichier à la liste doublement chaînée
-        if (list == NULL) {
-            //Si la liste est vide
 
-            // Allouer de la mémoire pour la liste
-            list = malloc(sizeof(files_list_t));
-            if (list == NULL) {
-                // La allocation a échoué, gérer l'erreur
-                printf("Erreur d'allocation mémoire pour la liste.");
-            }
-
-            list->head = new_entry;
-            list->tail = new_entry;
-            new_entry->prev = NULL;
-            new_entry->next = NULL;
-        } else {
-            new_entry->prev = list->tail;
-            new_entry->next = NULL;
-            list->tail->next = new_entry;
-            list->tail = new_entry;
+/*!
+ * @brief add_batch_to_list appends all the entries of a received batch to a list
+ * @param list is a pointer to the list to complete
+ * @param batch is a pointer to the received batch
+ */
+static void add_batch_to_list(files_list_t *list, entries_batch_t *batch) {
+    for (file_entry_record_t *record = next_batch_record(batch, NULL); record != NULL; record = next_batch_record(batch, record)) {
+        files_list_entry_t *new_entry = append_file_entry(list, record->path, record->path_length);
+        if (new_entry != NULL) {
+            record_to_entry(record, new_entry);
         }
     }
-
-    // Fermer le répertoire
-    closedir(directory);
 }
 
 
 /*!
  * @brief make_files_lists_parallel makes both (src and dest) files list with parallel processing
+ * The commands to the listers are sent without blocking: when the queue is full of entries
+ * for the main process, they must be received before the remaining command can be sent.
  * @param src_list is a pointer to the source list to build
  * @param dst_list is a pointer to the destination list to build
  * @param the_config is a pointer to the program configuration
@@ -220,49 +525,55 @@ void make_files_list(files_list_t *list, char *target_path) {
  */
 void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, configuration_t *the_config, int msg_queue) {
 
-    any_message_t msg;
-    //Envoie des messages au listeur
-    if(the_config->is_verbose==true){
-        printf("Envoie d'un message a chaque processus listeur\n");
-    }
-    send_analyze_dir_command(msg_queue,MSG_TYPE_TO_SOURCE_LISTER,the_config->source);
-    send_analyze_dir_command(msg_queue,MSG_TYPE_TO_DESTINATION_LISTER,the_config->destination);
+    static any_message_t msg;
+    int listers[2] = {MSG_TYPE_TO_SOURCE_LISTER, MSG_TYPE_TO_DESTINATION_LISTER};
+    char *targets[2] = {the_config->source, the_config->destination};
+    int commands_sent = 0;
 
     bool list_source_complete= false;
     bool list_destination_complete=false;
     //Boucle de reception de message avec les fichiers analysés jusqu'à ce que les deux listes soit terminé
     if(the_config->is_verbose==true){
-        printf("Début de la boucle de reception de message\n");
+        printf("Envoie d'un message a chaque processus listeur et début de la boucle de reception de message\n");
     }
     do{
-        msgrcv(msg_queue,&msg, sizeof(any_message_t)- sizeof(long),MSG_TYPE_TO_MAIN,0);
+        //Envoie des messages aux listeurs tant que la file a de la place
+        while (commands_sent < 2 && send_analyze_dir_command(msg_queue, listers[commands_sent], targets[commands_sent], true, IPC_NOWAIT) == 0) {
+            ++commands_sent;
+        }
+        if (commands_sent < 2 && errno != EAGAIN) {
+            perror("Erreur lors de l'envoi d'une commande a un listeur");
+            return;
+        }
 
-        if (msg.list_entry.op_code==COMMAND_CODE_FILE_ENTRY_FOR_SOURCE){
-            if(the_config->is_verbose==true){
-                printf("Reception d'une entree de la source\n");
+        if (receive_message(msg_queue,&msg,MSG_TYPE_TO_MAIN,0) == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            files_list_entry_t* new_entry= malloc(sizeof(files_list_entry_t));
-            memcpy(new_entry,&msg.list_entry.payload, sizeof(files_list_entry_t));
+            perror("Erreur lors de la reception des listes");
+            return;
+        }
+
+        if (msg.entries_batch.op_code==COMMAND_CODE_FILE_ENTRY_FOR_SOURCE){
+            entries_batch_t *batch = received_batch(&msg);
             if(the_config->is_verbose==true){
-                printf("Ajout de la nouvelle entree a la liste source\n");
+                printf("Reception de %u entree(s) de la source\n", batch->entries_count);
             }
-            add_entry_to_tail(src_list,new_entry);
-        }else if (msg.list_entry.op_code==COMMAND_CODE_LIST_COMPLETE_FOR_SOURCE){
+            add_batch_to_list(src_list, batch);
+            release_batch(batch);
+        }else if (msg.simple_command.message==COMMAND_CODE_LIST_COMPLETE_FOR_SOURCE){
             if(the_config->is_verbose==true){
                 printf("Reception du message de fin de liste pour la source\n");
             }
             list_source_complete=true;
-        }else if (msg.list_entry.op_code==COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION) {
+        }else if (msg.entries_batch.op_code==COMMAND_CODE_FILE_ENTRY_FOR_DESTINATION) {
+            entries_batch_t *batch = received_batch(&msg);
             if(the_config->is_verbose==true){
-                printf("Reception d'une entree de la destination\n");
+                printf("Reception de %u entree(s) de la destination\n", batch->entries_count);
             }
-            files_list_entry_t *new_entry = malloc(sizeof(files_list_entry_t));
-            memcpy(new_entry, &msg.list_entry.payload, sizeof(files_list_entry_t));
-            if(the_config->is_verbose==true){
-                printf("Ajout de la nouvelle entree a la liste destination\n");
-            }
-            add_entry_to_tail(dst_list, new_entry);
-        }else if (msg.list_entry.op_code==COMMAND_CODE_LIST_COMPLETE_FOR_DESTINATION){
+            add_batch_to_list(dst_list, batch);
+            release_batch(batch);
+        }else if (msg.simple_command.message==COMMAND_CODE_LIST_COMPLETE_FOR_DESTINATION){
             if(the_config->is_verbose==true){
                 printf("Reception du message de fin de lsite pour la destination\n");
             }
@@ -275,87 +586,320 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
 }
 
 
+// Entries analyzed by one task of the threaded mode: a slice of consecutive entries of a list
+typedef struct {
+    files_list_entry_t *first;
+    uint32_t entries_count;
+    uint32_t failures; // Bit i set when the entry i could not be analyzed
+} analyze_slice_t;
+
+// Lister role of the threaded mode, for one side
+typedef struct {
+    files_list_t *list;
+    char *target;
+    thread_pool_t *pool;
+    analyze_slice_t *slices;
+    size_t slices_count;
+} threaded_lister_t;
+
+
+/*!
+ * @brief analyze_slice_task is the analyzer role of the threaded mode: it gets the properties of a slice of entries
+ * The entries are updated directly in the list; failures are only recorded, the list is not modified by the tasks.
+ * @param argument is a pointer to the analyze_slice_t
+ */
+static void analyze_slice_task(void *argument) {
+    analyze_slice_t *slice = (analyze_slice_t *) argument;
+    files_list_entry_t *entries[MSG_ANALYZE_BATCH_ENTRIES];
+    bool is_ok[MSG_ANALYZE_BATCH_ENTRIES];
+    files_list_entry_t *entry = slice->first;
+    for (uint32_t i = 0; i < slice->entries_count; ++i, entry = entry->next) {
+        entries[i] = entry;
+    }
+    get_entries_stats(entries, slice->entries_count, is_ok);
+    for (uint32_t i = 0; i < slice->entries_count; ++i) {
+        if (!is_ok[i]) {
+            slice->failures |= (uint32_t) 1 << i;
+        }
+    }
+}
+
+
+/*!
+ * @brief list_directory_task is the lister role of the threaded mode: it lists a side, then submits its entries to analyze
+ * The analyze tasks go to the deque of the current worker, the other workers steal them.
+ * @param argument is a pointer to the threaded_lister_t
+ */
+static void list_directory_task(void *argument) {
+    threaded_lister_t *lister = (threaded_lister_t *) argument;
+    make_list(lister->list, lister->target);
+
+    size_t entries_count = 0;
+    for (files_list_entry_t *entry = lister->list->head; entry != NULL; entry = entry->next) {
+        ++entries_count;
+    }
+    lister->slices_count = (entries_count + MSG_ANALYZE_BATCH_ENTRIES - 1) / MSG_ANALYZE_BATCH_ENTRIES;
+    lister->slices = malloc(lister->slices_count * sizeof(analyze_slice_t));
+    if (lister->slices == NULL) { //Pas de mémoire pour les tâches : analyse ici même
+        lister->slices_count = 0;
+        get_files_list_stats(lister->list);
+        return;
+    }
+
+    files_list_entry_t *entry = lister->list->head;
+    for (size_t i = 0; i < lister->slices_count; ++i) {
+        analyze_slice_t *slice = &lister->slices[i];
+        slice->first = entry;
+        slice->entries_count = 0;
+        slice->failures = 0;
+        while (entry != NULL && slice->entries_count < MSG_ANALYZE_BATCH_ENTRIES) {
+            ++slice->entries_count;
+            entry = entry->next;
+        }
+        if (submit_task(lister->pool, analyze_slice_task, slice) == -1) {
+            analyze_slice_task(slice);
+        }
+    }
+}
+
+
+/*!
+ * @brief make_files_lists_threaded makes both (src and dest) files lists with threads instead of processes
+ * The lister and analyzer roles are tasks of a work-stealing pool ( @see thread-pool.h ): they work
+ * directly on the lists, nothing is copied between them. Entries that could not be analyzed are
+ * removed once all the tasks are done.
+ * @param src_list is a pointer to the source list to build
+ * @param dst_list is a pointer to the destination list to build
+ * @param the_config is a pointer to the program configuration
+ */
+void make_files_lists_threaded(files_list_t *src_list, files_list_t *dst_list, configuration_t *the_config) {
+    thread_pool_t pool;
+    //Autant de threads que d'analyseurs en mode processus, les listeurs étant des tâches comme les autres
+    if (init_thread_pool(&pool, 2 * the_config->processes_count) == -1) {
+        printf("Impossible de creer les threads, les listes sont construites sans parallelisme\n");
+        make_files_list(src_list, the_config->source);
+        make_files_list(dst_list, the_config->destination);
+        return;
+    }
+    threaded_lister_t listers[2] = {
+            {src_list, the_config->source, &pool, NULL, 0},
+            {dst_list, the_config->destination, &pool, NULL, 0}
+    };
+    for (int i = 0; i < 2; ++i) {
+        if (submit_task(&pool, list_directory_task, &listers[i]) == -1) {
+            list_directory_task(&listers[i]);
+        }
+    }
+    wait_thread_pool(&pool);
+    destroy_thread_pool(&pool);
+
+    for (int i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < listers[i].slices_count; ++j) {
+            analyze_slice_t *slice = &listers[i].slices[j];
+            files_list_entry_t *entry = slice->first;
+            for (uint32_t k = 0; k < slice->entries_count; ++k) {
+                files_list_entry_t *next = entry->next;
+                if (slice->failures & ((uint32_t) 1 << k)) {
+                    remove_file_entry(listers[i].list, entry);
+                }
+                entry = next;
+            }
+        }
+        free(listers[i].slices);
+    }
+    if (the_config->is_verbose) {
+        printf("Listes construites par %d thread(s)\n", 2 * the_config->processes_count);
+    }
+}
+
+
+/*!
+ * @brief is_source_unchanged tells if a source file is still as it was analyzed
+ * @param source_fd is the descriptor of the source file
+ * @param source_entry is a pointer to the entry of the file, from the analysis
+ * @return true if the size and mtime of the file are the ones of the entry, false else
+ */
+static bool is_source_unchanged(int source_fd, files_list_entry_t *source_entry) {
+    struct stat source_stat;
+    return fstat(source_fd, &source_stat) == 0 && (uint64_t) source_stat.st_size == source_entry->size
+           && source_stat.st_mtim.tv_sec == source_entry->mtime.tv_sec && source_stat.st_mtim.tv_nsec == source_entry->mtime.tv_nsec;
+}
+
+/*!
+ * @brief check_copy_digest compares the digest of the data written by a copy with the digest of the source, when it is known
+ * A difference means the source was modified since its digest was computed: the copy holds its new content, but it is reported.
+ * The digest of a source is only known when its comparison needed it or when it was in the cache: the other copies are counted
+ * apart, and the digest of the copy becomes the one of their source, since the source was read once, by the copy.
+ * @param source_entry is a pointer to the entry of the source file
+ * @param copy_digest is the digest of the written data
+ * @param the_config is a pointer to the configuration
+ */
+static void check_copy_digest(files_list_entry_t *source_entry, uint8_t *copy_digest, configuration_t *the_config) {
+    if (!(source_entry->digest_flags & ENTRY_HAS_DIGEST)) {
+        __atomic_add_fetch(&unchecked_copies, 1, __ATOMIC_RELAXED);
+        memcpy(source_entry->digest, copy_digest, HASH_MAX_DIGEST_SIZE);
+        source_entry->digest_flags |= ENTRY_HAS_DIGEST;
+    } else if (memcmp(copy_digest, source_entry->digest, HASH_MAX_DIGEST_SIZE) != 0) {
+        __atomic_add_fetch(&mismatched_copies, 1, __ATOMIC_RELAXED);
+        printf("Copie de %s differente de la source analysee : le fichier a ete modifie pendant la synchronisation\n", source_entry->path_and_name);
+        return;
+    } else {
+        __atomic_add_fetch(&verified_copies, 1, __ATOMIC_RELAXED);
+    }
+    if (the_config->is_verbose) {
+        printf("Copie de %s par read/write, avec empreinte\n", source_entry->path_and_name);
+    }
+}
+
+/*!
+ * @brief copy_changed_chunks rewrites in place the chunks of a file found different by the comparison ( @see tree-hash.h )
+ * @param source_fd is the descriptor of the source file
+ * @param destination_path is the path of the destination file, of the same size as the source
+ * @param source_entry is a pointer to the source entry, whose chunks tell which ones changed
+ * @return 0 in case of success, -1 else (the file must be copied whole)
+ */
+static int copy_changed_chunks(int source_fd, char *destination_path, files_list_entry_t *source_entry) {
+    chunk_digests_t *chunks = source_entry->chunks;
+    uint64_t chunk_size = get_tree_hash_chunk_size();
+    struct stat destination_stat;
+    if (chunks == NULL || chunks->changed == NULL || chunk_size == 0 || tree_hash_chunks_count(source_entry->size) != chunks->count
+        || stat(destination_path, &destination_stat) == -1 || !S_ISREG(destination_stat.st_mode)
+        || (uint64_t) destination_stat.st_size != source_entry->size) {
+        return -1;
+    }
+    int destination_fd = open(destination_path, O_WRONLY);
+    if (destination_fd == -1) {
+        return -1;
+    }
+    int result = 0;
+    for (size_t i = 0; i < chunks->count && result == 0; ++i) {
+        if (chunks->changed[i]) {
+            uint64_t offset = i * chunk_size;
+            uint64_t length = (source_entry->size - offset < chunk_size) ? source_entry->size - offset : chunk_size;
+            result = copy_file_part(source_fd, (off_t) offset, destination_fd, (off_t) offset, length);
+        }
+    }
+    if (close(destination_fd) == -1) {
+        result = -1;
+    }
+    return result;
+}
+
+
 /*!
  * @brief copy_entry_to_destination copies a file from the source to the destination
  * It keeps access modes and mtime ( @see utimensat )
  * Pay attention to the path so that the prefixes are not repeated from the source to the destination
- * Use sendfile to copy the file, mkdir to create the directory
+ * Use copy_file_contents to copy the file, mkdir to create the directory
  */
 void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t *the_config) {
     //Définition des chemins absolus de façon complète des fichiers
-    char source_path[2048];
-    char destination_path[4096];
-    snprintf(source_path, MAX_PATH_SIZE, "%s/%s", the_config->source, source_entry->path_and_name);
-    snprintf(destination_path, MAX_PATH_SIZE, "%s/%s", the_config->destination, source_entry->path_and_name);
-
-    struct stat buffer_type;
-    stat(source_entry->path_and_name, &buffer_type);
-    if (&buffer_type != NULL) {                         //Si erreur avec le fichier dans le buffer
-        printf("Erreur lors de l'obtention des stats du fichier.");
+    char *source_path = source_entry->path_and_name;
+    char destination_path[PATH_SIZE];
+    if (destination_path_of(destination_path, source_entry, the_config) == -1) {
+        return;
     }
 
     //Test type du fichier donné
-    if (S_ISDIR(buffer_type.st_mode)) {              //Le fichier est un répertoire
-        //Création d'un répertoire dans la destination
-        int retour_mkdir = mkdir(destination_path, source_entry->mode);
-
-        //Vérification de la bonne création
-        if (retour_mkdir == -1) {
+    if (source_entry->entry_type == DOSSIER) {              //Le fichier est un répertoire
+        //Création d'un répertoire dans la destination (s'il existe déjà, seuls ses droits sont mis à jour)
+        if (mkdir(destination_path, source_entry->mode) == -1 && errno != EEXIST) {
             printf("Erreur lors de la création du répertoire copie.");
             return;
         }
 
         //Réattribution des mêmes droits
-        if (chmod(destination_path, buffer_type.st_mode) == -1) {
+        if (chmod(destination_path, source_entry->mode) == -1) {
             printf("Erreur lors de l'attribution des permissions au répertoire en destination.\n");
             return;
         }
 
-        if (chown(destination_path, buffer_type.st_uid, buffer_type.st_gid) == -1) {
-            printf("Erreur lors de l'attribution du propriétaire et du groupe au répertoire en destination.\n");
-            return;
-        }
-
-    } else if (S_ISREG(buffer_type.st_mode)) {       //Le fichier est un fichier ordinaire
+    } else if (source_entry->entry_type == FICHIER) {       //Le fichier est un fichier ordinaire
         //Ouverture du fichier source
-        FILE *source_file = fopen(source_path, "rb");
-        if (source_file == NULL) {
+        int source_fd = open(source_path, O_RDONLY);
+        if (source_fd == -1) {
             printf("Erreur à l'ouverture du fichier source.");
             return;
         }
 
-        //Ouverture ou création du fichier dans la destination
-        FILE *destination_file = fopen(destination_path, "wb");
-        if (destination_file == NULL) {
-            perror("Erreur lors de l'ouverture/la création du fichier dans la destination.");
-            fclose(source_file);
-            return;
-        }
-
-        //Copiage du contenu du fichier source dans le fichier de destination
-        /*
-        int caract;
-        while ((caract = fgetc(source_file)) != EOF) {
-            fputc(caract, destination_file);
+        //Destination liée à d'autres noms : elle n'est jamais réécrite sur place, ces noms garderaient le nouveau contenu.
+        //Elle est remplacée par un nouveau fichier, auquel les noms que la source partage encore sont liés ( @see apply_hardlinks )
+        struct stat destination_stat;
+        bool has_destination = lstat(destination_path, &destination_stat) == 0 && S_ISREG(destination_stat.st_mode);
+        bool is_destination_shared = has_destination && destination_stat.st_nlink > 1;
+
+        //Gros fichier déjà présent dans la destination : seuls les blocs modifiés sont réécrits
+        bool is_copied = false;
+        bool has_copy_digest = false; // Empreinte des données écrites connue, elle sera mise dans le cache
+        uint8_t copy_digest[HASH_MAX_DIGEST_SIZE];
+        if (!is_destination_shared && copy_changed_chunks(source_fd, destination_path, source_entry) == 0) {
+            is_copied = true;
+            if (the_config->is_verbose) {
+                printf("Copie de %s par morceaux modifies\n", source_path);
+            }
         }
-        */
-        if (sendfile(destination_file, source_file, NULL, buffer_type.st_size) == -1) {
-            printf("Erreur lors de la copie des données avec sendfile.\n");
+        if (!is_copied && the_config->delta_threshold > 0 && source_entry->size >= the_config->delta_threshold && has_destination
+            && delta_copy(source_fd, destination_path) == 0) {
+            is_copied = true;
+            if (the_config->is_verbose) {
+                printf("Copie de %s par difference\n", source_path);
+            }
         }
 
+        //Ouverture ou création du fichier dans la destination, vidé pour que la copie reparte de zéro
+        if (!is_copied) {
+            if (is_destination_shared && unlink(destination_path) == -1 && errno != ENOENT) {
+                perror(destination_path);
+                close(source_fd);
+                return;
+            }
+            int destination_fd = open(destination_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (destination_fd == -1) {
+                perror("Erreur lors de l'ouverture/la création du fichier dans la destination.");
+                close(source_fd);
+                return;
+            }
 
-        //Modification du mtime dans la destination
-        struct utimbuf utime_buf;
-        utime_buf.actime = source_entry->mtime.tv_sec;  // Access time same as source
-        utime_buf.modtime = source_entry->mtime.tv_sec; // Modification time same as source
-        utime(destination_path, &utime_buf);
+            if (the_config->is_copy_verified) {
+                //Copie et calcul de l'empreinte en une seule lecture de la source
+                if (copy_file_contents_hashed(source_fd, destination_fd, copy_digest) == -1) {
+                    perror("Erreur lors de la copie des données");
+                } else {
+                    is_copied = true;
+                    has_copy_digest = true;
+                    check_copy_digest(source_entry, copy_digest, the_config);
+                }
+            } else {
+                //Copie du contenu par le mécanisme le moins coûteux disponible (reflink, copy_file_range, sendfile, read/write)
+                copy_method_t method;
+                if (copy_file_contents(source_fd, destination_fd, &method) == -1) {
+                    perror("Erreur lors de la copie des données");
+                } else {
+                    is_copied = true;
+                    if (the_config->is_verbose) {
+                        printf("Copie de %s par %s\n", source_path, copy_method_name(method));
+                    }
+                }
+            }
+            if (close(destination_fd) == -1) {
+                perror("Erreur lors de la fermeture du fichier copie");
+                is_copied = false;
+            }
+        }
 
-        //Modification des droits d'accès du fichier destination
-        chmod(destination_path, source_entry->mode);
+        //Sans vérification, la copie a l'empreinte de la source quand elle est connue, tant que la source n'a pas changé depuis
+        if (is_copied && !has_copy_digest && (source_entry->digest_flags & ENTRY_HAS_DIGEST) && is_source_unchanged(source_fd, source_entry)) {
+            memcpy(copy_digest, source_entry->digest, sizeof(copy_digest));
+            has_copy_digest = true;
+        }
+        close(source_fd);
 
-        //Fermeture des fichiers
-        fclose(source_file);
-        fclose(destination_file);
+        set_destination_metadata(destination_path, source_entry);
+
+        //Empreinte de la copie dans le cache : la destination n'aura pas à être relue à la prochaine synchronisation
+        if (is_copied && has_copy_digest) {
+            store_destination_digest(destination_path, copy_digest);
+        }
 
     } else {                                        //Erreur sur le type du fichier transmis
         printf("%s n'est ni un fichier ordinaire, ni un répertoire. Format non accepté.\n", source_entry->path_and_name);
@@ -368,16 +912,31 @@ void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t
  * @brief make_list lists files in a location (it recurses in directories)
  * It doesn't get files properties, only a list of paths
  * This function is used by make_files_list and make_files_list_parallel
+ * The tree is listed by several walkers when enabled ( @see walk_tree ), then sorted once for the comparison
  * @param list is a pointer to the list that will be built
  * @param target is the target dir whose content must be listed
  */
- /*!
- * Cette fonction n'est pas utilisée car il est plus simple de traiter dans un seul tour de boucle while
- * la création du path du fichier ainsi que l'obtention de ces propriétés
- * qui seront enregistrés ensemble dans la nouvelle entrée de la liste de fichiers.
- * Le contenu de cette fonction est donc directement imbriquée dans make_files_list et make_files_list_parallel.
- */
 void make_list(files_list_t *list, char *target) {
+    uint64_t start_ns = stats_now();
+    walk_tree(list, target);
+    add_stat_since(STATS_LISTING_NS, start_ns);
+
+    // Tri unique de la liste pour la comparaison (au lieu d'insertions triées en O(N²))
+    sort_files_list(list, path_root_length(target));
+}
+
+
+/*!
+ * @brief make_directory_list lists the entries of a single directory, without recursing in its subdirectories
+ * It is used by the streaming mode, which asks for each directory in turn.
+ * @param list is a pointer to the list that will be built
+ * @param target is the target dir whose entries must be listed
+ */
+void make_directory_list(files_list_t *list, char *target) {
+    uint64_t start_ns = stats_now();
+    list_directory_entries(list, target);
+    add_stat_since(STATS_LISTING_NS, start_ns);
+    sort_files_list(list, path_root_length(target));
 }
 
 
@@ -403,11 +962,10 @@ DIR *open_dir(char *path) {
  * @param dir is a pointer to the dir (as a result of opendir, @see open_dir)
  * @return a struct dirent pointer to the next relevant entry, NULL if none found (use it to stop iterating)
  * Relevant entries are all regular files and dir, except . and ..
+ * The type of the entry is checked by the caller, which has the full path of the file.
  */
 struct dirent *get_next_entry(DIR *dir) {
     struct dirent *fichier_entree;
-    struct stat buffer_type;
-
 
     do {
         fichier_entree = readdir(dir);
@@ -416,15 +974,8 @@ struct dirent *get_next_entry(DIR *dir) {
         if (fichier_entree == NULL) {
             return NULL;
         }
-
-        stat(fichier_entree->d_name, &buffer_type);
-        if (&buffer_type != NULL) {                         //Si erreur avec le fichier dans le buffer
-            printf("Erreur lors de l'obtention des stats du fichier.");
-            continue;
-        }
-    } while (strcmp(fichier_entree->d_name, ".") == 0 || strcmp(fichier_entree->d_name, "..") == 0 || (!(S_ISREG(buffer_type.st_mode)) && (!(S_ISDIR(buffer_type.st_mode)))));
+    } while (strcmp(fichier_entree->d_name, ".") == 0 || strcmp(fichier_entree->d_name, "..") == 0);
     // Ignorer les répertoires spéciaux "." et ".." + Vérification du type du fichier dans la fonction appelante.
-    //Si fichier non conforme, on relit une nouvelle entrée et on reprend ces informations.
 
     return fichier_entree;
 }
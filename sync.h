@@ -4,13 +4,24 @@
 #include "files-list.h"
 #include "configuration.h"
 #include "processes.h"
+#include "diff.h"
+#include "watch.h"
 #include <dirent.h>
 
 void synchronize(configuration_t *the_config, process_context_t *p_context);
+void synchronize_trees(configuration_t *the_config, process_context_t *p_context);
+void synchronize_paths(configuration_t *the_config, process_context_t *p_context, dirty_path_t *paths, size_t count);
+void apply_difference(diff_result_t result, files_list_entry_t *source_entry, files_list_entry_t *destination_entry, void *parameters);
 void make_files_list(files_list_t *list, char *target_path);
+void get_files_list_stats(files_list_t *list);
 bool mismatch(files_list_entry_t *lhd, files_list_entry_t *rhd, bool has_md5);
 void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, configuration_t *the_config, int msg_queue);
+void make_files_lists_threaded(files_list_t *src_list, files_list_t *dst_list, configuration_t *the_config);
 void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t *the_config);
+void set_destination_metadata(char *destination_path, files_list_entry_t *source_entry);
+int separate_destination_file(char *destination_path);
+void store_destination_digest(char *destination_path, uint8_t *digest);
 void make_list(files_list_t *list, char *target);
+void make_directory_list(files_list_t *list, char *target);
 DIR *open_dir(char *path);
 struct dirent *get_next_entry(DIR *dir);
@@ -0,0 +1,244 @@
+#include <thread-pool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Functions in this file implement a pool of worker threads with work stealing.
+// Each worker has its own deque: the tasks it submits go to it and it takes the newest ones first,
+// so a task and the tasks it creates stay on the same worker. An idle worker steals the oldest task
+// of another deque, which is usually the largest remaining piece of work.
+
+#define TASK_DEQUE_INITIAL_CAPACITY 64
+
+static __thread thread_pool_t *current_pool = NULL;
+static __thread int current_worker = -1;
+
+typedef struct {
+    thread_pool_t *pool;
+    int worker;
+} worker_start_t;
+
+/*!
+ * @brief push_task adds a task at the bottom of a deque, growing it if needed
+ * @param deque is a pointer to the deque
+ * @param task is the task to add
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+static int push_task(task_deque_t *deque, task_t task) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        size_t new_capacity = (deque->capacity == 0) ? TASK_DEQUE_INITIAL_CAPACITY : deque->capacity * 2;
+        task_t *new_tasks = malloc(new_capacity * sizeof(task_t));
+        if (new_tasks == NULL) {
+            pthread_mutex_unlock(&deque->mutex);
+            return -1;
+        }
+        for (size_t i = 0; i < deque->count; ++i) {
+            new_tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = new_tasks;
+        deque->capacity = new_capacity;
+        deque->top = 0;
+    }
+    deque->tasks[(deque->top + deque->count) % deque->capacity] = task;
+    ++deque->count;
+    pthread_mutex_unlock(&deque->mutex);
+    return 0;
+}
+
+/*!
+ * @brief take_task removes a task from a deque
+ * @param deque is a pointer to the deque
+ * @param is_steal takes the oldest task (top) when true, the newest one (bottom) else
+ * @param task is where the task is copied
+ * @return true if a task was taken, false if the deque is empty
+ */
+static bool take_task(task_deque_t *deque, bool is_steal, task_t *task) {
+    bool is_taken = false;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        if (is_steal) {
+            *task = deque->tasks[deque->top];
+            deque->top = (deque->top + 1) % deque->capacity;
+        } else {
+            *task = deque->tasks[(deque->top + deque->count - 1) % deque->capacity];
+        }
+        --deque->count;
+        is_taken = true;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return is_taken;
+}
+
+/*!
+ * @brief find_task looks for a task in the deque of a worker, then in the other ones
+ * @param pool is a pointer to the pool
+ * @param worker is the index of the worker
+ * @param task is where the task is copied
+ * @return true if a task was found, false else
+ */
+static bool find_task(thread_pool_t *pool, int worker, task_t *task) {
+    if (take_task(&pool->deques[worker], false, task)) {
+        return true;
+    }
+    for (int i = 1; i < pool->workers_count; ++i) {
+        if (take_task(&pool->deques[(worker + i) % pool->workers_count], true, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * @brief worker_loop is the function of the worker threads: it runs tasks until the pool is destroyed
+ * @param argument is a pointer to a worker_start_t, allocated by init_thread_pool
+ * @return NULL
+ */
+static void *worker_loop(void *argument) {
+    worker_start_t *start = (worker_start_t *) argument;
+    thread_pool_t *pool = current_pool = start->pool;
+    int worker = current_worker = start->worker;
+    free(start);
+    task_t task;
+
+    while (true) {
+        if (__atomic_load_n(&pool->queued_tasks, __ATOMIC_ACQUIRE) > 0 && find_task(pool, worker, &task)) {
+            __atomic_sub_fetch(&pool->queued_tasks, 1, __ATOMIC_ACQ_REL);
+            task.function(task.argument);
+            if (__atomic_sub_fetch(&pool->pending_tasks, 1, __ATOMIC_ACQ_REL) == 0) {
+                pthread_mutex_lock(&pool->mutex);
+                pthread_cond_broadcast(&pool->all_done);
+                pthread_mutex_unlock(&pool->mutex);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&pool->mutex);
+        while (__atomic_load_n(&pool->queued_tasks, __ATOMIC_ACQUIRE) == 0 && !pool->is_stopping) {
+            ++pool->idle_workers;
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+            --pool->idle_workers;
+        }
+        bool is_stopping = pool->is_stopping && __atomic_load_n(&pool->queued_tasks, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->mutex);
+        if (is_stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief init_thread_pool starts the worker threads
+ * @param pool is a pointer to the pool to initialize
+ * @param workers_count is the number of worker threads
+ * @return 0 in case of success, -1 else
+ */
+int init_thread_pool(thread_pool_t *pool, int workers_count) {
+    memset(pool, 0, sizeof(thread_pool_t));
+    if (workers_count < 1) {
+        workers_count = 1;
+    }
+    pool->threads = malloc(workers_count * sizeof(pthread_t));
+    pool->deques = calloc(workers_count, sizeof(task_deque_t));
+    if (pool->threads == NULL || pool->deques == NULL) {
+        free(pool->threads);
+        free(pool->deques);
+        return -1;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    for (int i = 0; i < workers_count; ++i) {
+        pthread_mutex_init(&pool->deques[i].mutex, NULL);
+    }
+
+    for (int i = 0; i < workers_count; ++i) {
+        worker_start_t *start = malloc(sizeof(worker_start_t));
+        if (start == NULL) {
+            break;
+        }
+        start->pool = pool;
+        start->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_loop, start) != 0) {
+            perror("Erreur lors de la creation d'un thread");
+            free(start);
+            break;
+        }
+        ++pool->workers_count;
+    }
+    if (pool->workers_count == 0) {
+        destroy_thread_pool(pool);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief submit_task adds a task to the pool
+ * From a worker of the pool, the task goes to the deque of this worker, else the deques are used in turn.
+ * @param pool is a pointer to the pool
+ * @param function is the function of the task
+ * @param argument is the argument given to the function
+ * @return 0 in case of success, -1 else
+ */
+int submit_task(thread_pool_t *pool, task_function_t function, void *argument) {
+    task_t task = {function, argument};
+    int worker = current_worker;
+    if (current_pool != pool || worker < 0) {
+        worker = __atomic_fetch_add(&pool->next_deque, 1, __ATOMIC_RELAXED) % pool->workers_count;
+    }
+    //Compteurs incrémentés avant l'ajout : un worker peut prendre la tâche dès qu'elle est dans la file
+    __atomic_add_fetch(&pool->pending_tasks, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&pool->queued_tasks, 1, __ATOMIC_ACQ_REL);
+    if (push_task(&pool->deques[worker], task) == -1) {
+        __atomic_sub_fetch(&pool->queued_tasks, 1, __ATOMIC_ACQ_REL);
+        __atomic_sub_fetch(&pool->pending_tasks, 1, __ATOMIC_ACQ_REL);
+        return -1;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->idle_workers > 0) {
+        pthread_cond_signal(&pool->work_available);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+/*!
+ * @brief wait_thread_pool waits until all the submitted tasks, and the tasks they submitted, are finished
+ * It must not be called from a task.
+ * @param pool is a pointer to the pool
+ */
+void wait_thread_pool(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (__atomic_load_n(&pool->pending_tasks, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*!
+ * @brief destroy_thread_pool stops the workers once the queued tasks are done, and frees the pool
+ * @param pool is a pointer to the pool
+ */
+void destroy_thread_pool(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->workers_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->workers_count; ++i) {
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].mutex);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->threads);
+    free(pool->deques);
+    pool->threads = NULL;
+    pool->deques = NULL;
+    pool->workers_count = 0;
+}
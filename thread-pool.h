@@ -0,0 +1,40 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*task_function_t)(void *argument);
+
+typedef struct {
+    task_function_t function;
+    void *argument;
+} task_t;
+
+// Tasks of one worker: it takes the newest ones at the bottom, the others steal the oldest ones at the top
+typedef struct {
+    pthread_mutex_t mutex;
+    task_t *tasks; // Circular buffer
+    size_t capacity;
+    size_t top;
+    size_t count;
+} task_deque_t;
+
+typedef struct {
+    pthread_t *threads;
+    task_deque_t *deques; // One per worker
+    int workers_count;
+    pthread_mutex_t mutex; // Protects the sleeping workers and the waits
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+    int idle_workers;
+    size_t queued_tasks; // Atomic: tasks in the deques
+    size_t pending_tasks; // Atomic: tasks submitted and not finished yet
+    unsigned int next_deque; // Atomic: deque of the next task submitted from outside the pool
+    bool is_stopping;
+} thread_pool_t;
+
+int init_thread_pool(thread_pool_t *pool, int workers_count);
+int submit_task(thread_pool_t *pool, task_function_t function, void *argument);
+void wait_thread_pool(thread_pool_t *pool);
+void destroy_thread_pool(thread_pool_t *pool);
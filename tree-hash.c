@@ -0,0 +1,245 @@
+#include <tree-hash.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file compute the digest of a file as the Merkle root of the digests of its
+// fixed-size chunks, so that the chunks of a very large file can be hashed by several threads at
+// once. The digest of a chunk is the digest of its bytes; a node is the digest of 0x01 followed by
+// its two children, and the last node of an odd level goes up as is. A file of a single chunk thus
+// has the usual digest of its content: the mode only changes the digests of the larger files.
+// The mode is disabled (chunk size 0) by default.
+
+static uint64_t tree_chunk_size = 0;
+
+/*!
+ * @brief set_tree_hash_chunk_size sets the size of the chunks of the tree hash mode
+ * It is set once, before the processes are created, so that analyzers inherit it.
+ * @param chunk_size is a power of two of at least TREE_HASH_MIN_CHUNK_SIZE bytes, 0 to disable the mode
+ */
+void set_tree_hash_chunk_size(uint64_t chunk_size) {
+    tree_chunk_size = chunk_size;
+}
+
+/*!
+ * @brief get_tree_hash_chunk_size gives the size of the chunks of the tree hash mode
+ * @return the size in bytes, 0 when the mode is disabled
+ */
+uint64_t get_tree_hash_chunk_size(void) {
+    return tree_chunk_size;
+}
+
+/*!
+ * @brief tree_hash_chunk_shift gives the size of the chunks as a power of two, as kept with the cached digests
+ * @return the power of two, 0 when the mode is disabled
+ */
+uint8_t tree_hash_chunk_shift(void) {
+    uint8_t shift = 0;
+    while (tree_chunk_size != 0 && ((uint64_t) 1 << shift) < tree_chunk_size) {
+        ++shift;
+    }
+    return shift;
+}
+
+/*!
+ * @brief tree_hash_chunks_count gives the number of chunks of a file hashed as a tree
+ * @param file_size is the size of the file
+ * @return the number of chunks, 0 when the file is hashed whole (mode disabled, or file of a single chunk)
+ */
+size_t tree_hash_chunks_count(uint64_t file_size) {
+    if (tree_chunk_size == 0 || file_size <= tree_chunk_size) {
+        return 0;
+    }
+    return (file_size + tree_chunk_size - 1) / tree_chunk_size;
+}
+
+/*!
+ * @brief new_chunk_digests allocates the digests of the chunks of a file
+ * @param count is the number of chunks
+ * @return a pointer to the digests, NULL if out of memory
+ */
+chunk_digests_t *new_chunk_digests(size_t count) {
+    chunk_digests_t *chunks = malloc(sizeof(chunk_digests_t));
+    if (chunks == NULL) {
+        return NULL;
+    }
+    chunks->count = count;
+    chunks->failures = 0;
+    chunks->changed = NULL;
+    chunks->digests = calloc((count > 0) ? count : 1, HASH_MAX_DIGEST_SIZE);
+    if (chunks->digests == NULL) {
+        free(chunks);
+        return NULL;
+    }
+    return chunks;
+}
+
+/*!
+ * @brief copy_chunk_digests duplicates the digests of the chunks of a file
+ * @param chunks is a pointer to the digests, may be NULL
+ * @return a pointer to the copy, NULL if chunks is NULL or if out of memory
+ */
+chunk_digests_t *copy_chunk_digests(chunk_digests_t *chunks) {
+    if (chunks == NULL) {
+        return NULL;
+    }
+    chunk_digests_t *copy = new_chunk_digests(chunks->count);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy->digests, chunks->digests, chunks->count * HASH_MAX_DIGEST_SIZE);
+    copy->failures = chunks->failures;
+    if (chunks->changed != NULL) {
+        copy->changed = malloc(chunks->count);
+        if (copy->changed == NULL) {
+            free_chunk_digests(copy);
+            return NULL;
+        }
+        memcpy(copy->changed, chunks->changed, chunks->count);
+    }
+    return copy;
+}
+
+/*!
+ * @brief free_chunk_digests releases the digests of the chunks of a file
+ * @param chunks is a pointer to the digests, may be NULL
+ */
+void free_chunk_digests(chunk_digests_t *chunks) {
+    if (chunks == NULL) {
+        return;
+    }
+    free(chunks->changed);
+    free(chunks->digests);
+    free(chunks);
+}
+
+/*!
+ * @brief tree_hash_root combines the digests of the chunks of a file into their Merkle root
+ * @param chunks is a pointer to the digests of the chunks, with the current algorithm
+ * @param root receives the HASH_MAX_DIGEST_SIZE bytes of the root, padded with zeros
+ */
+void tree_hash_root(chunk_digests_t *chunks, uint8_t root[HASH_MAX_DIGEST_SIZE]) {
+    size_t digest_size = hash_digest_size(get_hash_algorithm());
+    size_t count = chunks->count;
+    uint8_t (*level)[HASH_MAX_DIGEST_SIZE] = malloc(((count > 0) ? count : 1) * HASH_MAX_DIGEST_SIZE);
+    memset(root, 0, HASH_MAX_DIGEST_SIZE);
+    if (level == NULL || count == 0) {
+        free(level);
+        return;
+    }
+    memcpy(level, chunks->digests, count * HASH_MAX_DIGEST_SIZE);
+
+    //Chaque niveau réduit de moitié le précédent, jusqu'à la racine
+    while (count > 1) {
+        size_t parents = 0;
+        for (size_t i = 0; i < count; i += 2) {
+            if (i + 1 == count) { // Dernier noeud d'un niveau impair : remonté tel quel
+                memmove(level[parents++], level[i], HASH_MAX_DIGEST_SIZE);
+                continue;
+            }
+            hash_context_t context;
+            uint8_t node_prefix = 0x01;
+            uint8_t parent[HASH_MAX_DIGEST_SIZE];
+            if (hash_init(&context, get_hash_algorithm()) == -1) {
+                free(level);
+                return;
+            }
+            hash_update(&context, &node_prefix, 1);
+            hash_update(&context, level[i], digest_size);
+            hash_update(&context, level[i + 1], digest_size);
+            hash_final(&context, parent);
+            memcpy(level[parents++], parent, HASH_MAX_DIGEST_SIZE);
+        }
+        count = parents;
+    }
+    memcpy(root, level[0], HASH_MAX_DIGEST_SIZE);
+    free(level);
+}
+
+/*!
+ * @brief tree_hash_init starts the digest of a stream of data
+ * @param context is a pointer to the context to initialize
+ * @return 0 in case of success, -1 else
+ */
+int tree_hash_init(tree_hash_context_t *context) {
+    context->chunk_length = 0;
+    context->capacity = 16;
+    context->chunks = new_chunk_digests(context->capacity);
+    if (context->chunks == NULL) {
+        return -1;
+    }
+    context->chunks->count = 0;
+    if (hash_init(&context->chunk, get_hash_algorithm()) == -1) {
+        free_chunk_digests(context->chunks);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief finish_chunk adds the digest of the current chunk to the finished ones, then starts the next chunk
+ * @param context is a pointer to the context
+ * @param is_last is true at the end of the stream: no chunk is started
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+static int finish_chunk(tree_hash_context_t *context, bool is_last) {
+    chunk_digests_t *chunks = context->chunks;
+    if (chunks->count == context->capacity) {
+        uint8_t (*digests)[HASH_MAX_DIGEST_SIZE] = realloc(chunks->digests, 2 * context->capacity * HASH_MAX_DIGEST_SIZE);
+        if (digests == NULL) {
+            return -1;
+        }
+        chunks->digests = digests;
+        context->capacity *= 2;
+    }
+    hash_final(&context->chunk, chunks->digests[chunks->count++]);
+    context->chunk_length = 0;
+    return is_last ? 0 : hash_init(&context->chunk, get_hash_algorithm());
+}
+
+/*!
+ * @brief tree_hash_update adds data to the digest of a stream
+ * @param context is a pointer to the context
+ * @param data is a pointer to the data
+ * @param length is the size of the data
+ * @return 0 in case of success, -1 else (out of memory: the context must still be finished)
+ */
+int tree_hash_update(tree_hash_context_t *context, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    while (length > 0) {
+        if (tree_chunk_size != 0 && context->chunk_length == tree_chunk_size && finish_chunk(context, false) == -1) {
+            return -1;
+        }
+        size_t part = length;
+        if (tree_chunk_size != 0 && part > tree_chunk_size - context->chunk_length) {
+            part = tree_chunk_size - context->chunk_length;
+        }
+        hash_update(&context->chunk, bytes, part);
+        context->chunk_length += part;
+        bytes += part;
+        length -= part;
+    }
+    return 0;
+}
+
+/*!
+ * @brief tree_hash_final finishes the digest of a stream and releases its context
+ * @param context is a pointer to the context
+ * @param digest receives the HASH_MAX_DIGEST_SIZE bytes of the digest (the Merkle root when there are several chunks)
+ * @return the digests of the chunks, to release with free_chunk_digests, or NULL for a stream of a single chunk or in case of error
+ */
+chunk_digests_t *tree_hash_final(tree_hash_context_t *context, uint8_t digest[HASH_MAX_DIGEST_SIZE]) {
+    chunk_digests_t *chunks = context->chunks;
+    if (finish_chunk(context, true) == -1) {
+        hash_final(&context->chunk, digest);
+        memset(digest, 0, HASH_MAX_DIGEST_SIZE);
+        free_chunk_digests(chunks);
+        return NULL;
+    }
+    if (chunks->count == 1) {
+        memcpy(digest, chunks->digests[0], HASH_MAX_DIGEST_SIZE);
+        free_chunk_digests(chunks);
+        return NULL;
+    }
+    tree_hash_root(chunks, digest);
+    return chunks;
+}
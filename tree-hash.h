@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <hash.h>
+
+// Chunks of the tree hash mode are powers of two, from this size on
+#define TREE_HASH_MIN_CHUNK_SIZE (1024 * 1024)
+
+// Digests of the fixed-size chunks of a file, whose Merkle root is the digest of the file
+typedef struct {
+    size_t count;
+    uint32_t failures; // Chunks that could not be read, updated atomically by the threads hashing them
+    uint8_t *changed; // Set by the comparison: one byte per chunk, not 0 when it differs from the destination; NULL else
+    uint8_t (*digests)[HASH_MAX_DIGEST_SIZE];
+} chunk_digests_t;
+
+// Digest of a stream of data: the chunks are hashed one after the other as the data comes
+typedef struct {
+    hash_context_t chunk; // Digest of the current chunk
+    uint64_t chunk_length; // Bytes in the current chunk
+    chunk_digests_t *chunks; // Finished chunks, grown as needed
+    size_t capacity;
+} tree_hash_context_t;
+
+void set_tree_hash_chunk_size(uint64_t chunk_size);
+uint64_t get_tree_hash_chunk_size(void);
+uint8_t tree_hash_chunk_shift(void);
+size_t tree_hash_chunks_count(uint64_t file_size);
+
+chunk_digests_t *new_chunk_digests(size_t count);
+chunk_digests_t *copy_chunk_digests(chunk_digests_t *chunks);
+void free_chunk_digests(chunk_digests_t *chunks);
+void tree_hash_root(chunk_digests_t *chunks, uint8_t root[HASH_MAX_DIGEST_SIZE]);
+
+int tree_hash_init(tree_hash_context_t *context);
+int tree_hash_update(tree_hash_context_t *context, const void *data, size_t length);
+chunk_digests_t *tree_hash_final(tree_hash_context_t *context, uint8_t digest[HASH_MAX_DIGEST_SIZE]);
@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include <tree-walk.h>
+#include <sync.h>
+#include <utility.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// Functions in this file list a whole tree, with several walker threads.
+// Directories waiting to be listed are kept in a shared stack: each walker takes one, lists it into
+// its own list (no lock per entry) and pushes the subdirectories it found. The walk is over when the
+// stack is empty and no walker is listing a directory anymore. The lists of the walkers are then
+// moved into the result list, which the caller sorts.
+// Directories are read with getdents64, which gives the type of each entry with its name: listing a
+// tree looks up no file, the analyzers find each of them once ( @see get_entries_stats ).
+
+static int tree_walkers = 1;
+
+// Entry of a directory as given by getdents64 (the libc may not declare getdents64 itself)
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} directory_entry_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t directory_available;
+    char **directories; // Paths in the lists of the walkers, which stay valid until the end of the walk
+    size_t directories_count;
+    size_t capacity;
+    int busy_walkers; // Walkers listing a directory, which may push new ones
+    bool is_failed;
+} directory_stack_t;
+
+typedef struct {
+    directory_stack_t *stack;
+    files_list_t list;
+} walker_t;
+
+/*!
+ * @brief set_tree_walkers sets the number of walker threads used by walk_tree
+ * It is set once, before the processes are created, so that listers inherit it.
+ * @param walkers_count is the number of walkers (bounded by TREE_WALKERS_MAX)
+ */
+void set_tree_walkers(int walkers_count) {
+    if (walkers_count < 1) {
+        walkers_count = 1;
+    }
+    if (walkers_count > TREE_WALKERS_MAX) {
+        walkers_count = TREE_WALKERS_MAX;
+    }
+    tree_walkers = walkers_count;
+}
+
+/*!
+ * @brief get_tree_walkers gives the number of walker threads used by walk_tree
+ * @return the number of walkers
+ */
+int get_tree_walkers(void) {
+    return tree_walkers;
+}
+
+/*!
+ * @brief push_directories adds directories to the stack (the stack mutex must be held)
+ * @param stack is a pointer to the stack
+ * @param directories is an array of paths
+ * @param count is the number of paths
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+static int push_directories(directory_stack_t *stack, char **directories, size_t count) {
+    if (stack->directories_count + count > stack->capacity) {
+        size_t new_capacity = (stack->capacity == 0) ? 256 : stack->capacity;
+        while (new_capacity < stack->directories_count + count) {
+            new_capacity *= 2;
+        }
+        char **new_directories = realloc(stack->directories, new_capacity * sizeof(char *));
+        if (new_directories == NULL) {
+            return -1;
+        }
+        stack->directories = new_directories;
+        stack->capacity = new_capacity;
+    }
+    memcpy(stack->directories + stack->directories_count, directories, count * sizeof(char *));
+    stack->directories_count += count;
+    return 0;
+}
+
+/*!
+ * @brief entry_type_of gives the type of a directory entry, from the type given by getdents64 when the file system gives one
+ * @param directory_fd is the descriptor of the directory
+ * @param entry is a pointer to the directory entry
+ * @return DT_DIR, DT_REG, or another type for the entries that are not kept
+ */
+static unsigned char entry_type_of(int directory_fd, directory_entry_t *entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type;
+    }
+    //Type inconnu du système de fichiers : une recherche relative au répertoire, sans suivre les liens
+    struct stat file_stat;
+    if (fstatat(directory_fd, entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) == -1) {
+        printf("Erreur lors de l'obtention des informations sur le fichier.");
+        return DT_UNKNOWN;
+    }
+    if (S_ISDIR(file_stat.st_mode)) {
+        return DT_DIR;
+    }
+    return S_ISREG(file_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+}
+
+/*!
+ * @brief list_directory appends the directories and regular files of a directory to a list
+ * The directory is read with large getdents64 buffers, and the type of its entries comes with their names:
+ * the files are not looked up here, their stats are got once by the analyzers ( @see get_entries_stats ).
+ * @param list is a pointer to the list of the walker
+ * @param target is the path of the directory
+ * @param subdirectories is a pointer to an array receiving the paths of the subdirectories (grown with realloc)
+ * @param subdirectories_capacity is a pointer to the capacity of this array
+ * @return the number of subdirectories found, -1 if out of memory
+ */
+static long list_directory(files_list_t *list, char *target, char ***subdirectories, size_t *subdirectories_capacity) {
+    static __thread char buffer[DIRECTORY_READ_SIZE] __attribute__((aligned(8)));
+    int directory_fd = open(target, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd == -1) {
+        printf("Erreur lors de l'ouverture du répertoire.");
+        return 0;
+    }
+    long subdirectories_count = 0;
+    long read_bytes;
+    while (subdirectories_count != -1 && (read_bytes = syscall(SYS_getdents64, directory_fd, buffer, sizeof(buffer))) > 0) {
+        for (long offset = 0; offset < read_bytes; ) {
+            directory_entry_t *entry = (directory_entry_t *) (buffer + offset);
+            offset += entry->d_reclen;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            // Seuls les répertoires et les fichiers ordinaires sont gardés
+            unsigned char type = entry_type_of(directory_fd, entry);
+            if (type != DT_DIR && type != DT_REG) {
+                continue;
+            }
+            char file_path[PATH_SIZE];
+            if (concat_path(file_path, target, entry->d_name) == NULL) {
+                printf("Chemin trop long : %s/%s\n", target, entry->d_name);
+                continue;
+            }
+
+            // Chemin copié dans l'arène de la liste du walker
+            files_list_entry_t *new_entry = append_file_entry(list, file_path, strlen(file_path));
+            if (new_entry == NULL) {
+                subdirectories_count = -1;
+                break;
+            }
+            if (type == DT_DIR) {
+                if ((size_t) subdirectories_count == *subdirectories_capacity) {
+                    size_t new_capacity = (*subdirectories_capacity == 0) ? 64 : *subdirectories_capacity * 2;
+                    char **new_subdirectories = realloc(*subdirectories, new_capacity * sizeof(char *));
+                    if (new_subdirectories == NULL) {
+                        subdirectories_count = -1;
+                        break;
+                    }
+                    *subdirectories = new_subdirectories;
+                    *subdirectories_capacity = new_capacity;
+                }
+                (*subdirectories)[subdirectories_count++] = new_entry->path_and_name;
+            }
+        }
+    }
+    close(directory_fd);
+    return subdirectories_count;
+}
+
+/*!
+ * @brief walker_loop takes directories from the shared stack and lists them, until the whole tree is listed
+ * @param parameters is a pointer to the walker_t
+ * @return NULL
+ */
+static void *walker_loop(void *parameters) {
+    walker_t *walker = (walker_t *) parameters;
+    directory_stack_t *stack = walker->stack;
+    char **subdirectories = NULL;
+    size_t subdirectories_capacity = 0;
+
+    pthread_mutex_lock(&stack->mutex);
+    while (true) {
+        while (stack->directories_count == 0 && stack->busy_walkers > 0 && !stack->is_failed) {
+            pthread_cond_wait(&stack->directory_available, &stack->mutex);
+        }
+        if (stack->directories_count == 0 || stack->is_failed) {
+            break; // Plus rien à lister et personne ne peut en ajouter
+        }
+        char *target = stack->directories[--stack->directories_count];
+        ++stack->busy_walkers;
+        pthread_mutex_unlock(&stack->mutex);
+
+        long subdirectories_count = list_directory(&walker->list, target, &subdirectories, &subdirectories_capacity);
+
+        pthread_mutex_lock(&stack->mutex);
+        --stack->busy_walkers;
+        if (subdirectories_count == -1 || push_directories(stack, subdirectories, (subdirectories_count > 0) ? subdirectories_count : 0) == -1) {
+            printf("Erreur lors de l'allocation de mémoire lors de la constitution de la liste de fichiers.");
+            stack->is_failed = true;
+        }
+        pthread_cond_broadcast(&stack->directory_available);
+    }
+    pthread_cond_broadcast(&stack->directory_available);
+    pthread_mutex_unlock(&stack->mutex);
+    free(subdirectories);
+    return NULL;
+}
+
+/*!
+ * @brief walk_tree appends all the directories and regular files below a root to a list, recursively
+ * The entries are in no particular order: the caller sorts the list ( @see sort_files_list ).
+ * @param list is a pointer to the list to complete
+ * @param root is the path of the directory to list (not included in the list)
+ * @return 0 in case of success, -1 else (the list then holds what could be listed)
+ */
+int walk_tree(files_list_t *list, char *root) {
+    directory_stack_t stack;
+    walker_t walkers[TREE_WALKERS_MAX];
+    pthread_t threads[TREE_WALKERS_MAX];
+    int threads_count = 0;
+
+    memset(&stack, 0, sizeof(stack));
+    pthread_mutex_init(&stack.mutex, NULL);
+    pthread_cond_init(&stack.directory_available, NULL);
+    if (push_directories(&stack, &root, 1) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < tree_walkers; ++i) {
+        walkers[i].stack = &stack;
+        init_files_list(&walkers[i].list);
+    }
+
+    // Le thread appelant est le premier walker, les autres sont créés à côté de lui
+    for (int i = 1; i < tree_walkers; ++i) {
+        if (pthread_create(&threads[i], NULL, walker_loop, &walkers[i]) != 0) {
+            break;
+        }
+        ++threads_count;
+    }
+    walker_loop(&walkers[0]);
+    for (int i = 1; i <= threads_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < tree_walkers; ++i) {
+        move_files_list(list, &walkers[i].list);
+        clear_files_list(&walkers[i].list);
+    }
+    free(stack.directories);
+    pthread_mutex_destroy(&stack.mutex);
+    pthread_cond_destroy(&stack.directory_available);
+    return stack.is_failed ? -1 : 0;
+}
+
+/*!
+ * @brief list_directory_entries appends the directories and regular files of a single directory to a list
+ * @param list is a pointer to the list to complete
+ * @param target is the path of the directory
+ * @return 0 in case of success, -1 else (out of memory)
+ */
+int list_directory_entries(files_list_t *list, char *target) {
+    char **subdirectories = NULL;
+    size_t subdirectories_capacity = 0;
+    long subdirectories_count = list_directory(list, target, &subdirectories, &subdirectories_capacity);
+    free(subdirectories);
+    return (subdirectories_count == -1) ? -1 : 0;
+}
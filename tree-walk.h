@@ -0,0 +1,13 @@
+#pragma once
+
+#include <files-list.h>
+
+// Upper bound of the number of walker threads listing a tree
+#define TREE_WALKERS_MAX 64
+// Bytes of directory entries read at once by each walker
+#define DIRECTORY_READ_SIZE (128 * 1024)
+
+void set_tree_walkers(int walkers_count);
+int get_tree_walkers(void);
+int walk_tree(files_list_t *list, char *root);
+int list_directory_entries(files_list_t *list, char *target);
@@ -1,5 +1,6 @@
 #include <defines.h>
 #include <string.h>
+#include <time.h>
 
 /*!
  * @brief concat_path concatenates suffix to prefix into result
@@ -47,3 +48,31 @@ char *concat_path(char *result, char *prefix, char *suffix) {
 
     return result;
 }
+
+
+/*!
+ * @brief path_root_length gives the position at which relative paths start in paths built with concat_path
+ * @param root the root of the tree, as used as the prefix of concat_path
+ * @return the length of the root followed by its separator
+ */
+size_t path_root_length(char *root) {
+    if (root == NULL) {
+        return 0;
+    }
+    size_t root_len = strlen(root);
+    if (root_len > 0 && root[root_len - 1] != '/') { // concat_path ajoute un '/' dans ce cas
+        return root_len + 1;
+    }
+    return root_len;
+}
+
+
+/*!
+ * @brief monotonic_seconds gives the time of a clock that is not affected by changes of the system date
+ * @return the current time in seconds, to be compared with other values of this function
+ */
+double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
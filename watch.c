@@ -0,0 +1,371 @@
+#include <watch.h>
+#include <sync.h>
+#include <utility.h>
+#include <defines.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions in this file keep the destination up to date after a first full synchronization.
+// Each directory of the source is watched with inotify. Events only mark their directory as dirty;
+// they are merged until the source is quiet for WATCH_DEBOUNCE_MS, then only the dirty directories
+// are compared and copied ( @see synchronize_paths ). A new directory is synchronized with its whole
+// subtree, since its content may have been written before its watch was added.
+// When the kernel drops events (queue overflow), the watches are added again and both trees are
+// compared completely, as on the first synchronization.
+
+#define WATCH_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+typedef struct {
+    int fd;
+    char *root;
+    char **directories; // Path relative to the source of the directory of each watch descriptor, NULL when unused
+    size_t capacity;
+    bool is_limit_reached;
+} watcher_t;
+
+typedef struct {
+    dirty_path_t *paths;
+    size_t count;
+    size_t capacity;
+} dirty_set_t;
+
+static volatile sig_atomic_t is_stop_requested = 0;
+
+/*!
+ * @brief request_stop is the handler of SIGINT and SIGTERM: the watch ends after the current synchronization
+ * @param signal_number is the received signal
+ */
+static void request_stop(int signal_number) {
+    (void) signal_number;
+    is_stop_requested = 1;
+}
+
+/*!
+ * @brief join_relative_path builds the path of an entry relative to the source
+ * @param result receives the path
+ * @param directory is the path of the directory, relative to the source ("" for the source itself)
+ * @param name is the name of the entry
+ * @return a pointer to the result, NULL if the path is too long
+ */
+static char *join_relative_path(char *result, const char *directory, const char *name) {
+    int length = (directory[0] == '\0') ? snprintf(result, PATH_SIZE, "%s", name) : snprintf(result, PATH_SIZE, "%s/%s", directory, name);
+    return (length < 0 || length >= PATH_SIZE) ? NULL : result;
+}
+
+/*!
+ * @brief add_watch watches a directory of the source
+ * @param watcher is a pointer to the watcher
+ * @param relative_path is the path of the directory, relative to the source
+ * @return 0 in case of success, -1 else
+ */
+static int add_watch(watcher_t *watcher, const char *relative_path) {
+    char path[PATH_SIZE];
+    if (concat_path(path, watcher->root, (char *) relative_path) == NULL) {
+        return -1;
+    }
+    int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS);
+    if (wd == -1) {
+        if (errno == ENOSPC && !watcher->is_limit_reached) {
+            printf("Limite de surveillances inotify atteinte (fs.inotify.max_user_watches) : certains repertoires ne sont pas surveilles\n");
+            watcher->is_limit_reached = true;
+        }
+        return -1;
+    }
+    if ((size_t) wd >= watcher->capacity) {
+        size_t new_capacity = (watcher->capacity == 0) ? 256 : watcher->capacity;
+        while (new_capacity <= (size_t) wd) {
+            new_capacity *= 2;
+        }
+        char **new_directories = realloc(watcher->directories, new_capacity * sizeof(char *));
+        if (new_directories == NULL) {
+            inotify_rm_watch(watcher->fd, wd);
+            return -1;
+        }
+        memset(new_directories + watcher->capacity, 0, (new_capacity - watcher->capacity) * sizeof(char *));
+        watcher->directories = new_directories;
+        watcher->capacity = new_capacity;
+    }
+    //Un répertoire déplacé garde son descripteur : seul son chemin change
+    free(watcher->directories[wd]);
+    watcher->directories[wd] = strdup(relative_path);
+    return (watcher->directories[wd] == NULL) ? -1 : 0;
+}
+
+/*!
+ * @brief add_tree_watches watches a directory of the source and all its subdirectories
+ * @param watcher is a pointer to the watcher
+ * @param relative_path is the path of the directory, relative to the source
+ */
+static void add_tree_watches(watcher_t *watcher, const char *relative_path) {
+    char path[PATH_SIZE];
+    if (add_watch(watcher, relative_path) == -1 || concat_path(path, watcher->root, (char *) relative_path) == NULL) {
+        return;
+    }
+    DIR *directory = opendir(path);
+    if (directory == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = get_next_entry(directory)) != NULL) {
+        bool is_directory = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat file_stat;
+            is_directory = (fstatat(dirfd(directory), entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(file_stat.st_mode));
+        }
+        char child_path[PATH_SIZE];
+        if (is_directory && join_relative_path(child_path, relative_path, entry->d_name) != NULL) {
+            add_tree_watches(watcher, child_path);
+        }
+    }
+    closedir(directory);
+}
+
+/*!
+ * @brief mark_dirty adds a directory to the set of dirty directories (duplicates are merged later)
+ * @param dirty is a pointer to the set
+ * @param relative_path is the path of the directory, relative to the source
+ * @param is_recursive tells if its whole subtree must be synchronized
+ */
+static void mark_dirty(dirty_set_t *dirty, const char *relative_path, bool is_recursive) {
+    if (dirty->count == dirty->capacity) {
+        size_t new_capacity = (dirty->capacity == 0) ? 64 : dirty->capacity * 2;
+        dirty_path_t *new_paths = realloc(dirty->paths, new_capacity * sizeof(dirty_path_t));
+        if (new_paths == NULL) {
+            return;
+        }
+        dirty->paths = new_paths;
+        dirty->capacity = new_capacity;
+    }
+    dirty_path_t new_path = {strdup(relative_path), is_recursive};
+    if (new_path.path != NULL) {
+        dirty->paths[dirty->count++] = new_path;
+    }
+}
+
+/*!
+ * @brief clear_dirty empties the set of dirty directories
+ * @param dirty is a pointer to the set
+ */
+static void clear_dirty(dirty_set_t *dirty) {
+    for (size_t i = 0; i < dirty->count; ++i) {
+        free(dirty->paths[i].path);
+    }
+    dirty->count = 0;
+}
+
+/*!
+ * @brief compare_dirty_paths orders paths so that a directory is directly followed by its subtree ('/' sorts first)
+ * @param left is a pointer to a dirty_path_t
+ * @param right is a pointer to a dirty_path_t
+ * @return a negative, null or positive value, as strcmp
+ */
+static int compare_dirty_paths(const void *left, const void *right) {
+    const unsigned char *left_path = (const unsigned char *) ((const dirty_path_t *) left)->path;
+    const unsigned char *right_path = (const unsigned char *) ((const dirty_path_t *) right)->path;
+    while (*left_path != '\0' && *left_path == *right_path) {
+        ++left_path;
+        ++right_path;
+    }
+    int left_char = (*left_path == '/') ? 1 : *left_path;
+    int right_char = (*right_path == '/') ? 1 : *right_path;
+    return left_char - right_char;
+}
+
+/*!
+ * @brief is_in_subtree tests if a path is in the subtree of a directory
+ * @param path is the path to test
+ * @param directory is the path of the directory ("" for the source itself)
+ * @return true if path is the directory or one of its descendants
+ */
+static bool is_in_subtree(const char *path, const char *directory) {
+    size_t length = strlen(directory);
+    return length == 0 || (strncmp(path, directory, length) == 0 && (path[length] == '\0' || path[length] == '/'));
+}
+
+/*!
+ * @brief merge_dirty_paths sorts the dirty directories, parents first, and drops the ones already covered by another
+ * @param dirty is a pointer to the set
+ */
+static void merge_dirty_paths(dirty_set_t *dirty) {
+    qsort(dirty->paths, dirty->count, sizeof(dirty_path_t), compare_dirty_paths);
+    size_t kept = 0;
+    dirty_path_t *subtree = NULL; // Dernier sous-arbre complet gardé : ses descendants suivent directement
+    for (size_t i = 0; i < dirty->count; ++i) {
+        dirty_path_t *path = &dirty->paths[i];
+        bool is_duplicate = kept > 0 && strcmp(dirty->paths[kept - 1].path, path->path) == 0;
+        if ((subtree != NULL && is_in_subtree(path->path, subtree->path)) || is_duplicate) {
+            if (is_duplicate && path->is_recursive && !dirty->paths[kept - 1].is_recursive) {
+                dirty->paths[kept - 1].is_recursive = true;
+                subtree = &dirty->paths[kept - 1];
+            }
+            free(path->path);
+            continue;
+        }
+        dirty->paths[kept++] = *path;
+        if (path->is_recursive) {
+            subtree = &dirty->paths[kept - 1];
+        }
+    }
+    dirty->count = kept;
+}
+
+/*!
+ * @brief read_events reads the pending events and marks their directories as dirty
+ * @param watcher is a pointer to the watcher
+ * @param dirty is a pointer to the set of dirty directories
+ * @return the number of events read, -1 if events were lost (a full synchronization is needed)
+ */
+static long read_events(watcher_t *watcher, dirty_set_t *dirty) {
+    static char buffer[WATCH_READ_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    long events_count = 0;
+    bool is_overflow = false;
+    ssize_t read_bytes;
+    while ((read_bytes = read(watcher->fd, buffer, sizeof(buffer))) > 0) {
+        for (char *cursor = buffer; cursor < buffer + read_bytes; ) {
+            struct inotify_event *event = (struct inotify_event *) cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+            ++events_count;
+            if (event->mask & IN_Q_OVERFLOW) {
+                is_overflow = true;
+                continue;
+            }
+            if (event->wd < 0 || (size_t) event->wd >= watcher->capacity || watcher->directories[event->wd] == NULL) {
+                continue;
+            }
+            char *directory = watcher->directories[event->wd];
+            if (event->mask & IN_IGNORED) { // Répertoire supprimé ou sorti de la source
+                free(directory);
+                watcher->directories[event->wd] = NULL;
+                continue;
+            }
+
+            if (event->len == 0) {
+                continue; // Évènement sur le répertoire lui-même : son parent reçoit aussi le même, avec son nom
+            }
+            char child_path[PATH_SIZE];
+            mark_dirty(dirty, directory, false);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))
+                && join_relative_path(child_path, directory, event->name) != NULL) {
+                //Nouveau répertoire : surveillé, et copié en entier car il a pu être rempli avant
+                add_tree_watches(watcher, child_path);
+                mark_dirty(dirty, child_path, true);
+            }
+        }
+    }
+    return is_overflow ? -1 : events_count;
+}
+
+/*!
+ * @brief cpu_seconds gives the CPU time used by the process until now
+ * @return the user and system time, in seconds
+ */
+static double cpu_seconds(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1) {
+        return 0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/*!
+ * @brief watch_source synchronizes both trees, then keeps the destination up to date until SIGINT or SIGTERM
+ * The watches are added before the first synchronization, so that no change made during it is missed.
+ * In verbose mode, the delay between the first event of each change and its end of synchronization is displayed,
+ * and the CPU time used while watching when the watch ends.
+ * @param the_config is a pointer to the configuration
+ * @param p_context is a pointer to the processes context
+ * @return 0 when stopped by a signal, -1 if the source cannot be watched (it is then synchronized once)
+ */
+int watch_source(configuration_t *the_config, process_context_t *p_context) {
+    watcher_t watcher = {-1, the_config->source, NULL, 0, false};
+    dirty_set_t dirty = {NULL, 0, 0};
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.fd == -1) {
+        perror("Impossible de surveiller la source");
+        synchronize_trees(the_config, p_context);
+        return -1;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop; // Sans SA_RESTART : poll est interrompu
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    add_tree_watches(&watcher, "");
+    synchronize_trees(the_config, p_context);
+
+    double watch_start = monotonic_seconds();
+    double cpu_start = cpu_seconds();
+    double first_event = 0;
+    double last_event = 0;
+    bool is_overflow = false;
+    unsigned long rounds = 0;
+    while (!is_stop_requested) {
+        //Sans modification en attente, attente sans limite : aucun temps CPU au repos
+        int timeout = -1;
+        if (dirty.count > 0 || is_overflow) {
+            double now = monotonic_seconds();
+            double quiet_left = last_event + WATCH_DEBOUNCE_MS / 1000.0 - now;
+            double delay_left = first_event + WATCH_MAX_DELAY_MS / 1000.0 - now;
+            double left = (quiet_left < delay_left) ? quiet_left : delay_left;
+            timeout = (left > 0) ? (int) (left * 1000) + 1 : 0;
+        }
+        struct pollfd poll_fd = {watcher.fd, POLLIN, 0};
+        int ready = poll(&poll_fd, 1, timeout);
+        if (ready == -1) {
+            continue; // Signal : la condition de la boucle décide
+        }
+        if (ready > 0) {
+            bool had_changes = dirty.count > 0 || is_overflow;
+            long events_count = read_events(&watcher, &dirty);
+            is_overflow = is_overflow || events_count == -1;
+            if (events_count != 0) {
+                last_event = monotonic_seconds();
+                first_event = had_changes ? first_event : last_event;
+            }
+            continue;
+        }
+        if (dirty.count == 0 && !is_overflow) {
+            continue;
+        }
+
+        //Source calme (ou modifiée depuis trop longtemps) : synchronisation des seuls répertoires modifiés
+        if (is_overflow) {
+            printf("Evenements perdus, synchronisation complete\n");
+            add_tree_watches(&watcher, "");
+            synchronize_trees(the_config, p_context);
+        } else {
+            merge_dirty_paths(&dirty);
+            synchronize_paths(the_config, p_context, dirty.paths, dirty.count);
+        }
+        clear_dirty(&dirty);
+        is_overflow = false;
+        ++rounds;
+        if (the_config->is_verbose) {
+            printf("Modifications propagees %.3f s apres leur premier evenement\n", monotonic_seconds() - first_event);
+        }
+    }
+
+    if (the_config->is_verbose) {
+        printf("Surveillance terminee : %lu synchronisation(s) en %.3f s, temps CPU %.3f s\n", rounds,
+               monotonic_seconds() - watch_start, cpu_seconds() - cpu_start);
+    }
+    clear_dirty(&dirty);
+    free(dirty.paths);
+    for (size_t i = 0; i < watcher.capacity; ++i) {
+        free(watcher.directories[i]);
+    }
+    free(watcher.directories);
+    close(watcher.fd);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <configuration.h>
+#include <processes.h>
+
+// Events are merged until the source is quiet for this delay, in milliseconds
+#define WATCH_DEBOUNCE_MS 200
+// Changes are synchronized at most this long after their first event, even if events keep coming
+#define WATCH_MAX_DELAY_MS 2000
+// Bytes of events read at once
+#define WATCH_READ_SIZE (64 * 1024)
+
+// A directory of the source whose entries changed, relative to the source
+typedef struct {
+    char *path;
+    bool is_recursive; // The whole subtree is synchronized (new directory), else only the entries of the directory
+} dirty_path_t;
+
+int watch_source(configuration_t *the_config, process_context_t *p_context);